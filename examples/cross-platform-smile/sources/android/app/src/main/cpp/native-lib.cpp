@@ -1,8 +1,9 @@
 #include <jni.h>
 
 #include <chrono>
+#include <filesystem>
 #include <memory>
-#include <sstream>
+#include <new>
 #include <string>
 #include <string_view>
 
@@ -15,14 +16,14 @@
 
 #include "api.hpp"
 #include "errors.hpp"
+#include "glstate.hpp"
+#include "gputimer.hpp"
 #include "shader.hpp"
+#include "uniforms.hpp"
 
 #include "shaders.glsl.h"
 
 
-using namespace std::string_view_literals;
-
-
 #define JNI_FUNCTION_NAME(ReturnType, PackageName, Name) \
     extern "C" JNIEXPORT ReturnType JNICALL Java_ ## PackageName ## _ ## Name
 
@@ -52,6 +53,9 @@ struct GraphContext {
     bool isViewDirty{true};
 
     std::unique_ptr<gl_utils::Shader> shader_ptr{nullptr};
+    bool shader_bound{false}; // to the frame block and the texture unit
+
+    gl_utils::UniformBuffer frame_uniforms;
 
     int view_width{0};
     int view_height{0};
@@ -79,6 +83,8 @@ static JavaVM* sJvm{nullptr};
 static jclass sContextWrapperClass{nullptr};
 static jobject sContextWrapper{nullptr};
 
+static std::string sCacheDir;
+
 }
 
 
@@ -168,6 +174,121 @@ Rcode FreeAsset(AssetData* data) {
 }
 
 
+static
+std::string GetCacheDir(JNIEnv* env) {
+    jmethodID method_getCacheDir = env->GetMethodID( sContextWrapperClass, "getCacheDir"
+                                                   , "()Ljava/io/File;");
+    if (!method_getCacheDir) {
+        __android_log_print( ANDROID_LOG_ERROR, kTag
+                           , "Can't find method '%s%s'\n"
+                           , "getCacheDir", "()Ljava/io/File;");
+        return std::string();
+    }
+
+    jobject dir = env->CallObjectMethod(sContextWrapper, method_getCacheDir);
+    if (!dir) {
+        return std::string();
+    }
+
+    jclass fileClass = env->GetObjectClass(dir);
+    jmethodID method_getAbsolutePath = env->GetMethodID( fileClass, "getAbsolutePath"
+                                                       , "()Ljava/lang/String;");
+    jstring path = method_getAbsolutePath
+                 ? static_cast<jstring>(env->CallObjectMethod(dir, method_getAbsolutePath))
+                 : nullptr;
+
+    std::string result;
+    if (path) {
+        const char* chars = env->GetStringUTFChars(path, nullptr);
+        result = chars;
+        env->ReleaseStringUTFChars(path, chars);
+        env->DeleteLocalRef(path);
+    }
+
+    env->DeleteLocalRef(fileClass);
+    env->DeleteLocalRef(dir);
+
+    return result;
+}
+
+
+static
+Rcode LoadCachedAsset(AssetData* out, char* assetname) {
+    if (!assetname || !out)
+        return RC(InvalidInput);
+
+    if (sCacheDir.empty())
+        return RC(NotInitialized);
+
+    // a miss is expected on the first launch, so it isn't reported
+    FILE* f = fopen((sCacheDir + "/" + assetname).c_str(), "rb");
+    if (!f)
+        return RC(InvalidInput);
+
+    fseek(f, 0L, SEEK_END);
+    out->size = (u32)ftell(f);
+    fseek(f, 0L, SEEK_SET);
+
+    out->data = new (std::nothrow) byte[out->size];
+    if (!out->data) {
+        fclose(f);
+        return RC(MemError);
+    }
+
+    const bool ok = out->size == fread(out->data, 1, out->size, f);
+    fclose(f);
+    if (!ok) {
+        delete[] out->data;
+        out->data = nullptr;
+        return RC(InternalError);
+    }
+
+    return RC(Ok);
+}
+
+
+static
+Rcode StoreCachedAsset(char* assetname, const AssetData* chunks, u32 nbChunks) {
+    if (!assetname || (nbChunks > 0 && !chunks))
+        return RC(InvalidInput);
+
+    if (sCacheDir.empty())
+        return RC(NotInitialized);
+
+    std::filesystem::path path = std::filesystem::path(sCacheDir) / assetname;
+    std::filesystem::path tmppath = path;
+    tmppath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec)
+        return RC(InternalError);
+
+    // write aside and rename, so a reader never sees a partial entry
+    FILE* f = fopen(tmppath.c_str(), "wb");
+    if (!f)
+        return RC(InternalError);
+
+    bool ok = true;
+    for (u32 i = 0; i < nbChunks && ok; ++i) {
+        ok = chunks[i].size == fwrite(chunks[i].data, 1, chunks[i].size, f);
+    }
+    ok = (0 == fclose(f)) && ok;
+
+    if (ok) {
+        std::filesystem::rename(tmppath, path, ec);
+        ok = !ec;
+    }
+
+    if (!ok) {
+        std::filesystem::remove(tmppath, ec);
+        return RC(InternalError);
+    }
+
+    return RC(Ok);
+}
+
+
 extern "C" JNIEXPORT
 jint JNICALL JNI_OnLoad(JavaVM* vm, void*) {
     sJvm = vm;
@@ -225,9 +346,17 @@ JNI(void, setUp)(JNIEnv* env, jclass, jobject ctx) {
 
     sContextWrapper = env->NewGlobalRef(ctx);
 
+    sCacheDir = GetCacheDir(env);
+
     gl_utils::SetGraphicsApi(sContext.platform_api);
     sContext.platform_api.LoadAsset              = &LoadAsset;
     sContext.platform_api.FreeAsset              = &FreeAsset;
+    sContext.platform_api.LoadCachedAsset        = &LoadCachedAsset;
+    sContext.platform_api.StoreCachedAsset       = &StoreCachedAsset;
+    sContext.asset_pack                          = AssetData{nullptr, 0};
+    sContext.nb_smileys                          = 1;
+    sContext.nb_threads                          = 0;
+    sContext.threaded_update                     = 0;
 
     sGraphCtx.context_lost = true;
 
@@ -263,8 +392,10 @@ JNI(void, onDrawFrame)(JNIEnv* env, jclass) {
                 std::string(shaders::kVertexShaderCode),
                 std::string(shaders::kPixelShaderCode));
 
+        // after a context loss the program comes from the binary cache,
+        // otherwise it's built while the resources reload
         __android_log_print(ANDROID_LOG_DEBUG, kTag, "reload shader\n");
-        rc = sGraphCtx.shader_ptr->reload();
+        rc = sGraphCtx.shader_ptr->reloadAsync(&sContext.platform_api);
         if (eRcode_Ok != rc) {
             sGraphCtx.shader_ptr.reset();
             __android_log_print( ANDROID_LOG_ERROR, kTag
@@ -273,16 +404,34 @@ JNI(void, onDrawFrame)(JNIEnv* env, jclass) {
             return;
         }
 
+        sGraphCtx.shader_bound = false;
+
+        // nothing of the cached state survives the context
+        gl_utils::ResetGlState();
+
+        // the queries are gone with the context
+        gl_utils::TearDownGpuTimer(false);
+        gl_utils::SetUpGpuTimer();
+
+        sGraphCtx.frame_uniforms.release();
+        rc = sGraphCtx.frame_uniforms.setUp( gl_utils::kFrameBlockBinding
+                                           , sizeof(gl_utils::FrameBlock) );
+        LOG_RCODE(rc);
+
+#if !defined(NDEBUG)
+        gl_utils::EnableGlDebugOutput();
+#endif
+
         __android_log_print(ANDROID_LOG_DEBUG, kTag, "setup VAO\n");
         CALL_GL_VOID(glGenVertexArrays, 1, &sGraphCtx.frame.main);
-        CALL_GL_VOID(glBindVertexArray, sGraphCtx.frame.main);
+        CALL_GL_VOID(gl_utils::BindVertexArray, sGraphCtx.frame.main);
         sGraphCtx.frame.current = sGraphCtx.frame.main;
 
         __android_log_print(ANDROID_LOG_DEBUG, kTag, "reload resources\n");
         rc = smile_ReloadResources(&sContext, &sGraphCtx);
         LOG_RCODE(rc);
 
-        CALL_GL_VOID(glBindVertexArray, 0);
+        CALL_GL_VOID(gl_utils::BindVertexArray, 0);
         sGraphCtx.frame.current = 0;
         return;
     }
@@ -291,13 +440,27 @@ JNI(void, onDrawFrame)(JNIEnv* env, jclass) {
         return;
     }
 
+    switch (sGraphCtx.shader_ptr->poll()) {
+        case gl_utils::ShaderState::Invalid:
+            sGraphCtx.shader_ptr.reset();
+            __android_log_print(ANDROID_LOG_ERROR, kTag, "Failed to build shader\n");
+            return;
+        case gl_utils::ShaderState::Pending:
+            // keep the frames blank, no time passes until the first one
+            glClear(GL_COLOR_BUFFER_BIT);
+            sGraphCtx.skip_frame = true;
+            return;
+        case gl_utils::ShaderState::Ready:
+            break;
+    }
+
     if (sGraphCtx.skip_frame) {
         sGraphCtx.last_timepoint = default_clock_t::now();
         sGraphCtx.skip_frame = false;
         return;
     }
 
-    CALL_GL(, glBindVertexArray, sGraphCtx.frame.main);
+    CALL_GL(, gl_utils::BindVertexArray, sGraphCtx.frame.main);
     sGraphCtx.frame.current = sGraphCtx.frame.main;
 
     default_clock_t::time_point cur_timepoint = default_clock_t::now();
@@ -324,10 +487,16 @@ JNI(void, onDrawFrame)(JNIEnv* env, jclass) {
         sGraphCtx.isViewDirty = false;
     }
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_utils::EnableBlending(true);
+    gl_utils::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    // the swap is done by the view once the frame is drawn, so it's not timed
+    gl_utils::BeginGpuFrame();
+
+    {
+        gl_utils::GpuScope scope("clear");
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
 
     rc = sGraphCtx.shader_ptr->use();
     if (eRcode_Ok != rc) {
@@ -337,21 +506,38 @@ JNI(void, onDrawFrame)(JNIEnv* env, jclass) {
         return;
     }
 
-    rc = sGraphCtx.shader_ptr->setUniform("view"sv, sGraphCtx.view_matrix);
+    if (!sGraphCtx.shader_bound) {
+        gl_utils::Shader& shader = *sGraphCtx.shader_ptr;
+
+        rc = shader.bindUniformBlock(gl_utils::kFrameBlockName, gl_utils::kFrameBlockBinding);
+        LOG_RCODE(rc);
+        rc = shader.setUniform(shader.uniform<GLint>("sprite"), 0);
+        LOG_RCODE(rc);
+
+        sGraphCtx.shader_bound = true;
+    }
+
+    // uploaded only if the view has changed
+    rc = sGraphCtx.frame_uniforms.update(
+            gl_utils::FrameBlock{gl_utils::Std140Mat2(sGraphCtx.view_matrix)});
     if (eRcode_Ok != rc) {
         __android_log_print( ANDROID_LOG_ERROR, kTag
-                           , "Failed to set uniform 'view': %s\n"
+                           , "Failed to update the frame uniforms: %s\n"
                            , smile_ToString(rc));
     }
 
-    rc = smile_Render(&sContext, &sGraphCtx.frame);
+    {
+        gl_utils::GpuScope scope("render");
+        rc = smile_Render(&sContext, &sGraphCtx.frame);
+    }
     if (eRcode_Ok != rc) {
         __android_log_print( ANDROID_LOG_ERROR, kTag
                            , "Failed to render: %s\n"
                            , smile_ToString(rc));
     }
 
-    CALL_GL(, glBindVertexArray, 0);
-    sGraphCtx.frame.current = 0;
+    gl_utils::EndGpuFrame();
+
+    gl_utils::CheckGlFrameErrors();
 }
 
@@ -351,6 +351,14 @@ SetClearColor(FrameEncoderPtr pEncoder, float R, float G, float B)
     _smileCtx.platform_api.ReleaseTexture = &ReleaseTexture;
     _smileCtx.platform_api.SetTextureSlot = &SetTextureSlot;
     _smileCtx.platform_api.SetClearColor = &SetClearColor;
+    _smileCtx.platform_api.LoadCachedAsset = NULL;
+    _smileCtx.platform_api.StoreCachedAsset = NULL;
+    _smileCtx.platform_api.GetGpuTimings = NULL;
+    _smileCtx.asset_pack.data = NULL;
+    _smileCtx.asset_pack.size = 0;
+    _smileCtx.nb_smileys = 1;
+    _smileCtx.nb_threads = 0;
+    _smileCtx.threaded_update = 0;
 
     Rcode rc = smile_SetUp(&_smileCtx);
     if (rc != eRcode_Ok) {
@@ -0,0 +1,104 @@
+#include "framepacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "smile/log.hpp"
+
+
+namespace {
+
+// spun on top of the expected oversleep
+constexpr f64 kSpinSlack = 0.0002;   // sec
+constexpr f64 kMinOversleep = 0.0005; // sec
+
+// the oversleep estimate loses this part per frame if the sleeps get better
+constexpr f64 kOversleepDecay = 0.02;
+
+// frames to judge whether the swap waits for the display
+constexpr u64 kVSyncProbeFrames = 30;
+
+}
+
+
+FramePacer::FramePacer(Mode mode, f64 rate) noexcept
+    : _mode(mode), _period(1.0/rate)
+    , _last(Clock::now()), _deadline(_last + std::chrono::duration_cast<Clock::duration>(_period))
+    , _oversleep(kMinOversleep)
+    , _m2(0.0)
+{}
+
+
+f64 FramePacer::wait() noexcept {
+    if (Mode::Timer == _mode) {
+        sleep();
+    }
+
+    const Clock::time_point now = Clock::now();
+    const f64 frameTime = Duration(now - _last).count();
+    _last = now;
+
+    if (_stats.nb_frames > 0) { // the first frame waits for the set up
+        record(frameTime);
+    } else {
+        ++_stats.nb_frames;
+    }
+
+    if (Mode::VSync == _mode && kVSyncProbeFrames == _stats.nb_frames
+     && _stats.mean < 0.5*_period.count())
+    {
+        SMILE_LOG(Warning) << "Swap does not wait for vsync (" << _stats.mean*1000.0
+                           << " ms per frame), pace frames with the timer";
+        _mode = Mode::Timer;
+        _deadline = now;
+
+        // the stats are of the timer from now on
+        _stats = Stats{};
+        _stats.nb_frames = 1;
+        _m2 = 0.0;
+    }
+
+    if (Mode::Timer == _mode) {
+        _deadline += std::chrono::duration_cast<Clock::duration>(_period);
+        if (_deadline < now) {
+            _deadline = now; // fell behind, don't try to catch up
+        }
+    }
+
+    return frameTime;
+}
+
+
+void FramePacer::sleep() noexcept {
+    const Duration margin = std::min(_oversleep + Duration(kSpinSlack), _period*0.5);
+    const Clock::time_point wakeup = _deadline - std::chrono::duration_cast<Clock::duration>(margin);
+
+    if (Clock::now() < wakeup) {
+        std::this_thread::sleep_until(wakeup);
+
+        const Duration late = Clock::now() - wakeup;
+        _oversleep = std::max({ late, _oversleep*(1.0 - kOversleepDecay), Duration(kMinOversleep) });
+    }
+
+    while (Clock::now() < _deadline) {
+        std::this_thread::yield();
+    }
+}
+
+
+void FramePacer::record(f64 frameTime) noexcept {
+    ++_stats.nb_frames;
+
+    // the first frame is not timed
+    const f64 n = static_cast<f64>(_stats.nb_frames - 1);
+    const f64 delta = frameTime - _stats.mean;
+    _stats.mean += delta/n;
+    _m2 += delta*(frameTime - _stats.mean);
+    _stats.jitter = std::sqrt(_m2/n);
+
+    _stats.max = std::max(_stats.max, frameTime);
+    if (frameTime > 1.5*_period.count()) {
+        ++_stats.nb_missed;
+    }
+}
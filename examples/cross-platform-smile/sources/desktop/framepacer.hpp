@@ -0,0 +1,65 @@
+#ifndef DESKTOP_FRAMEPACER_HPP_
+
+#include <chrono>
+
+#include "smile/smile.h"
+
+
+// Schedules the frames of the main loop.
+//
+// VSync: the swap waits for the display, the pacer only measures. Drivers
+// which ignore the swap interval are detected (the frames come much faster
+// than the display refresh rate) and the pacer falls back to the timer.
+//
+// Timer: the pacer sleeps until shortly before the deadline and spins for
+// the rest. The spin margin adapts to how late the sleeps wake up, so the
+// thread sleeps most of the frame without missing the deadline.
+//
+// None: the frames run as fast as they can (the headless runs), the pacer
+// only measures.
+class FramePacer {
+public:
+    enum class Mode { VSync, Timer, None };
+
+    struct Stats {
+        u64 nb_frames{0};
+        f64 mean{0.0};   // frame time, sec
+        f64 jitter{0.0}; // standard deviation of the frame time, sec
+        f64 max{0.0};    // sec
+        u64 nb_missed{0}; // frames longer than 1.5 periods
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer(Mode mode, f64 rate) noexcept;
+
+    Mode mode() const noexcept { return _mode; }
+    f64 rate() const noexcept { return 1.0/_period.count(); }
+
+    // Blocks until the next frame is due (in the timer mode), returns the
+    // time since the previous frame, sec.
+    f64 wait() noexcept;
+
+    const Stats& stats() const noexcept { return _stats; }
+
+private:
+    using Duration = std::chrono::duration<f64>;
+
+    void sleep() noexcept;
+    void record(f64 frameTime) noexcept;
+
+    Mode _mode;
+    Duration _period;
+
+    Clock::time_point _last;
+    Clock::time_point _deadline;
+
+    Duration _oversleep; // decaying maximum of how late the sleeps wake up
+
+    Stats _stats;
+    f64 _m2; // sum of squared deviations from the mean, Welford's
+};
+
+
+#define DESKTOP_FRAMEPACER_HPP_
+#endif
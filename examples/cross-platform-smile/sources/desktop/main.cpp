@@ -1,30 +1,132 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <string_view>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #if defined(PLATFORM_WINDOWS)
 #    include <Windows.h>
+#elif defined(PLATFORM_UNIX)
+#    include <fcntl.h>
+#    include <mutex>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    include <unordered_set>
 #endif
 
 #include "api.hpp"
+#include "framepacer.hpp"
+#include "gputimer.hpp"
+#include "offscreen.hpp"
 #include "shader.hpp"
 #include "errors.hpp"
+#include "glstate.hpp"
+#include "uniforms.hpp"
 
+#include "smile/apitrace.hpp"
+#include "smile/assetpack.hpp"
+#include "smile/profiler.hpp"
 #include "smile/smile.h"
 
-using namespace std::string_view_literals;
+
+static constexpr const char* kCacheDir = "assets/cache/";
+static constexpr const char* kAssetPack = "assets/assets.pack";
+
+static constexpr int kWindowWidth = 600;
+static constexpr int kWindowHeight = 800;
+
+// Baked at build time; raw assets are served straight from it.
+static AssetData sAssetPackData{nullptr, 0};
+static smile::AssetPack sAssetPack;
 
 
 static
-Rcode LoadAsset(AssetData* out, char* assetname) {
-    if (!assetname || !out)
-        return eRcode_InvalidInput;
+bool IsInAssetPack(const byte* p) {
+    return sAssetPack.isOpen() &&
+           p >= sAssetPackData.data && p < sAssetPackData.data + sAssetPackData.size;
+}
 
-    std::string assetpath = std::string("assets/") + std::string(assetname);
 
-    FILE* f = fopen(assetpath.c_str(), "rb");
+#if defined(PLATFORM_UNIX)
+
+// Assets which are mapped into memory rather than read into a heap buffer.
+// LoadAsset is called from the texture decoders, hence the lock.
+static std::mutex sMappedAssetsMutex;
+static std::unordered_set<const void*> sMappedAssets;
+
+
+static
+bool MapAsset(AssetData* out, const std::string& assetpath) {
+    int fd = open(assetpath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (0 != fstat(fd, &st) || st.st_size <= 0 || st.st_size > UINT32_MAX) {
+        close(fd);
+        return false;
+    }
+
+    const size_t sz = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        return false;
+    }
+
+    // assets are decoded front to back right after loading
+    madvise(p, sz, MADV_SEQUENTIAL);
+    madvise(p, sz, MADV_WILLNEED);
+
+    try {
+        std::lock_guard<std::mutex> lock(sMappedAssetsMutex);
+        sMappedAssets.insert(p);
+    } catch (...) {
+        munmap(p, sz);
+        return false;
+    }
+
+    // the view is read-only, writing to it faults
+    out->data = static_cast<byte*>(p);
+    out->size = static_cast<u32>(sz);
+
+    return true;
+}
+
+
+static
+bool UnmapAsset(AssetData* data) {
+    {
+        std::lock_guard<std::mutex> lock(sMappedAssetsMutex);
+        if (0 == sMappedAssets.erase(data->data)) {
+            return false;
+        }
+    }
+
+    munmap(data->data, data->size);
+    return true;
+}
+
+#endif
+
+
+static
+Rcode LoadFile(AssetData* out, const std::string& path) {
+#if defined(PLATFORM_UNIX)
+    if (MapAsset(out, path)) {
+        return eRcode_Ok;
+    }
+#endif
+
+    FILE* f = fopen(path.c_str(), "rb");
     if (!f) {
-        std::cerr << "Failed to load asset: " << assetpath << std::endl;
         return eRcode_InvalidInput;
     }
 
@@ -41,7 +143,7 @@ Rcode LoadAsset(AssetData* out, char* assetname) {
 
     size_t nb = fread(out->data, 1, sz, f);
     if (nb != sz) {
-        std::cerr << "WARNING: read wrong number of bytes from " << assetname << std::endl;
+        std::cerr << "WARNING: read wrong number of bytes from " << path << std::endl;
     }
 
     fclose(f);
@@ -49,11 +151,96 @@ Rcode LoadAsset(AssetData* out, char* assetname) {
     return eRcode_Ok;
 }
 
+
+static
+Rcode LoadAsset(AssetData* out, char* assetname) {
+    if (!assetname || !out)
+        return eRcode_InvalidInput;
+
+    if (sAssetPack.raw(assetname, *out)) {
+        return eRcode_Ok;
+    }
+
+    std::string assetpath = std::string("assets/") + std::string(assetname);
+
+    Rcode rc = LoadFile(out, assetpath);
+    if (eRcode_InvalidInput == rc) {
+        std::cerr << "Failed to load asset: " << assetpath << std::endl;
+    }
+
+    return rc;
+}
+
+
+static
+Rcode LoadCachedAsset(AssetData* out, char* assetname) {
+    if (!assetname || !out)
+        return eRcode_InvalidInput;
+
+    // a miss is expected on the first launch, so it isn't reported
+    return LoadFile(out, std::string(kCacheDir) + std::string(assetname));
+}
+
+
+static
+Rcode StoreCachedAsset(char* assetname, const AssetData* chunks, u32 nbChunks) {
+    if (!assetname || (nbChunks > 0 && !chunks))
+        return eRcode_InvalidInput;
+
+    std::filesystem::path path = std::filesystem::path(kCacheDir) / assetname;
+    std::filesystem::path tmppath = path;
+    tmppath += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) {
+        std::cerr << "Failed to create cache directory for " << assetname << ": " << ec.message() << std::endl;
+        return eRcode_InternalError;
+    }
+
+    // write aside and rename, so a reader never sees a partial entry
+    FILE* f = fopen(tmppath.string().c_str(), "wb");
+    if (!f) {
+        return eRcode_InternalError;
+    }
+
+    bool ok = true;
+    for (u32 i = 0; i < nbChunks && ok; ++i) {
+        ok = chunks[i].size == fwrite(chunks[i].data, 1, chunks[i].size, f);
+    }
+    ok = (0 == fclose(f)) && ok;
+
+    if (ok) {
+        std::filesystem::rename(tmppath, path, ec);
+        ok = !ec;
+    }
+
+    if (!ok) {
+        std::filesystem::remove(tmppath, ec);
+        return eRcode_InternalError;
+    }
+
+    return eRcode_Ok;
+}
+
+
 static
 Rcode FreeAsset(AssetData* data) {
     if (!data || !data->data)
         return eRcode_Already;
 
+    if (IsInAssetPack(data->data)) {
+        data->data = 0;
+        return eRcode_Ok;
+    }
+
+#if defined(PLATFORM_UNIX)
+    if (UnmapAsset(data)) {
+        data->data = 0;
+        return eRcode_Ok;
+    }
+#endif
+
     free(data->data);
     data->data = 0;
 
@@ -61,46 +248,223 @@ Rcode FreeAsset(AssetData* data) {
 }
 
 
-int main() {
-    std::cout << "Smile App Launched" << std::endl;
+// Sums the GPU timings of the frame up by the scope names.
+static
+void AccumulateGpuTimings(GpuTiming* sums, u32& nbSums, const FrameStats& stats) {
+    for (u32 i = 0; i < stats.nb_gpu_timings; ++i) {
+        const GpuTiming& timing = stats.gpu_timings[i];
 
-    if (!glfwInit()) {
-        std::cerr << "Failed to init GLFW!" << std::endl;
-        return 1;
+        u32 j = 0;
+        while (j < nbSums && 0 != std::strcmp(sums[j].name, timing.name)) {
+            ++j;
+        }
+        if (j == nbSums) {
+            if (nbSums == SMILE_MAX_GPU_TIMINGS) {
+                continue;
+            }
+            sums[nbSums++] = GpuTiming{timing.name, 0.0};
+        }
+
+        sums[j].time += timing.time;
     }
+}
+
 
-    int glfwver[3];
-    glfwGetVersion(glfwver, glfwver+1, glfwver+2);
-    std::cout << "GLFW v" << glfwver[0] << "." << glfwver[1] << "." << glfwver[2] << std::endl;
+static
+f64 DisplayRefreshRate() {
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+    return mode && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
+}
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    int count;
-    GLFWmonitor** monitors = glfwGetMonitors(&count);
-    for (int i = 0; i < count; ++i) {
-        const char* name = glfwGetMonitorName(monitors[i]);
-        std::cout << "monitor[" << i << "] name: " << name << std::endl;
+// Prints the throughput of a headless run and the percentiles of its frame
+// times.
+static
+void PrintFrameTimePercentiles(std::vector<f64>& frameTimes) {
+    if (frameTimes.empty()) {
+        return;
     }
-    GLFWwindow* pwnd = glfwCreateWindow(600, 800, "Smile", nullptr, nullptr);
-    if (!pwnd) {
-        const char* buffer;
-        glfwGetError(&buffer);
-        std::cerr << "Failed to create window: " << buffer << std::endl;
-        return 1;
+
+    f64 total = 0.0;
+    for (f64 t : frameTimes) {
+        total += t;
     }
 
-    glfwMakeContextCurrent(pwnd);
+    std::sort(frameTimes.begin(), frameTimes.end());
+    auto percentile = [&frameTimes](f64 p) {
+        const size_t i = static_cast<size_t>(p*static_cast<f64>(frameTimes.size() - 1) + 0.5);
+        return frameTimes[i]*1000.0;
+    };
+
+    std::cout << "Headless: " << frameTimes.size() << " frames in " << total << " s, "
+              << static_cast<f64>(frameTimes.size())/total << " FPS" << std::endl;
+    std::cout << "Frame time: p50 " << percentile(0.5) << " ms, p90 " << percentile(0.9)
+              << " ms, p99 " << percentile(0.99) << " ms, max " << frameTimes.back()*1000.0
+              << " ms" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+    std::cout << "Smile App Launched" << std::endl;
+
+    // the update runs on its own thread with the given rate (Hz) if any;
+    // the frames are paced by vsync unless the frame rate (Hz) is given
+    u32 nbSmileys = 1;
+    u32 nbThreads = 0;
+    u32 updateRate = 0;
+    u32 frameRate = 0;
+    if (argc > 1) {
+        long n = strtol(argv[1], nullptr, 10);
+        long t = argc > 2 ? strtol(argv[2], nullptr, 10) : 0;
+        long r = argc > 3 ? strtol(argv[3], nullptr, 10) : 0;
+        long f = argc > 4 ? strtol(argv[4], nullptr, 10) : 0;
+        if (n <= 0 || n > 10000000 || t < 0 || t > 1024 || r < 0 || r > 1000 || f < 0 || f > 1000) {
+            std::cerr << "Usage: " << argv[0]
+                      << " [<number of smileys> [<number of threads> [<update rate> [<frame rate>]]]]"
+                      << std::endl;
+            return 1;
+        }
+        nbSmileys = static_cast<u32>(n);
+        nbThreads = static_cast<u32>(t);
+        updateRate = static_cast<u32>(r);
+        frameRate = static_cast<u32>(f);
+    }
+
+    // OpenGL errors are reported by the driver as they happen if requested
+    const char* glDebugEnv = std::getenv("SMILE_GL_DEBUG");
+    const bool glDebug = glDebugEnv && 0 != std::strcmp(glDebugEnv, "0");
+
+    // the given number of frames are drawn offscreen as fast as they can
+    const char* headlessEnv = std::getenv("SMILE_HEADLESS");
+    const u64 headlessFrames = headlessEnv ? std::strtoull(headlessEnv, nullptr, 10) : 0;
+    const bool headless = headlessFrames > 0;
+
+    // the calls of a trace are played instead of running the engine, as fast
+    // as the backend draws them
+    const char* replayPath = std::getenv("SMILE_REPLAY");
+    const bool replaying = replayPath && *replayPath;
+
+    OffscreenContext offscreen;
+    GLFWwindow* pwnd = nullptr;
+
+    if (headless) {
+        if (eRcode_Ok != offscreen.create(kWindowWidth, kWindowHeight, glDebug)) {
+            std::cerr << "Failed to create offscreen context!" << std::endl;
+            glfwTerminate();
+            return 1;
+        }
+        std::cout << "Headless, " << offscreen.kind() << ", " << headlessFrames << " frames" << std::endl;
+    } else {
+        if (!glfwInit()) {
+            std::cerr << "Failed to init GLFW!" << std::endl;
+            return 1;
+        }
+
+        int glfwver[3];
+        glfwGetVersion(glfwver, glfwver+1, glfwver+2);
+        std::cout << "GLFW v" << glfwver[0] << "." << glfwver[1] << "." << glfwver[2] << std::endl;
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+        if (glDebug) {
+            glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+        }
+
+        int count;
+        GLFWmonitor** monitors = glfwGetMonitors(&count);
+        for (int i = 0; i < count; ++i) {
+            const char* name = glfwGetMonitorName(monitors[i]);
+            std::cout << "monitor[" << i << "] name: " << name << std::endl;
+        }
+        pwnd = glfwCreateWindow(kWindowWidth, kWindowHeight, "Smile", nullptr, nullptr);
+        if (!pwnd) {
+            const char* buffer;
+            glfwGetError(&buffer);
+            std::cerr << "Failed to create window: " << buffer << std::endl;
+            return 1;
+        }
+
+        glfwMakeContextCurrent(pwnd);
+
+        // the swap waits for the display only if the frames are paced by vsync
+        glfwSwapInterval(replaying || frameRate > 0 ? 0 : 1);
+    }
 
     glewExperimental = GL_TRUE;
     GLenum glewError = glewInit();
+#if defined(GLEW_ERROR_NO_GLX_DISPLAY)
+    // GLEW built for GLX loads the OpenGL functions of an EGL context too,
+    // it only fails to find the GLX extensions then
+    if (headless && GLEW_ERROR_NO_GLX_DISPLAY == glewError) {
+        glewError = GLEW_OK;
+    }
+#endif
     if (glewError != GLEW_OK) {
         std::cout << "Failed to initialize GLEW: " << glewGetErrorString(glewError) << std::endl;
         return 1;
     }
     std::cout << "GLEW v" << glewGetString(GLEW_VERSION) << std::endl;
 
+    if (glDebug) {
+        gl_utils::EnableGlDebugOutput();
+    }
+
+    if (headless && eRcode_Ok != offscreen.setUpTarget()) {
+        std::cerr << "Failed to set up offscreen framebuffer!" << std::endl;
+        return 1;
+    }
+
+    // the GPU time of the frames is reported at exit
+    gl_utils::SetUpGpuTimer();
+
+    if (eRcode_Ok == LoadFile(&sAssetPackData, kAssetPack)) {
+        Rcode packrc = sAssetPack.open(sAssetPackData);
+        if (eRcode_Ok != packrc) {
+            std::cerr << "WARNING: ignore broken asset pack " << kAssetPack << ": "
+                      << smile_ToString(packrc) << std::endl;
+        }
+    }
+
+    SmileContext smile_ctx;
+    gl_utils::SetGraphicsApi(smile_ctx.platform_api);
+    smile_ctx.platform_api.LoadAsset              = &LoadAsset;
+    smile_ctx.platform_api.FreeAsset              = &FreeAsset;
+    smile_ctx.platform_api.LoadCachedAsset        = &LoadCachedAsset;
+    smile_ctx.platform_api.StoreCachedAsset       = &StoreCachedAsset;
+    smile_ctx.asset_pack = sAssetPack.isOpen() ? sAssetPackData : AssetData{nullptr, 0};
+    smile_ctx.nb_smileys = nbSmileys;
+    smile_ctx.nb_threads = nbThreads;
+    smile_ctx.threaded_update = updateRate > 0 ? 1 : 0;
+
+    // the graphics calls of the engine are written to a trace
+    const char* capturePath = std::getenv("SMILE_CAPTURE");
+
+    smile::ApiTracePlayer player;
+    if (replaying) {
+        Rcode replayrc = player.open(replayPath);
+        if (eRcode_Ok != replayrc) {
+            std::cerr << "Failed to open api trace " << replayPath << ": "
+                      << smile_ToString(replayrc) << std::endl;
+            glfwTerminate();
+            return 1;
+        }
+        std::cout << "Replay " << replayPath << std::endl;
+    }
+
+    bool capturing = false;
+    if (!replaying && capturePath && *capturePath) {
+        Rcode capturerc = smile::StartApiCapture(smile_ctx.platform_api, capturePath);
+        if (eRcode_Ok != capturerc) {
+            std::cerr << "WARNING: failed to start api capture: " << smile_ToString(capturerc) << std::endl;
+        } else {
+            capturing = true;
+            std::cout << "Capture " << capturePath << std::endl;
+        }
+    }
+
     static const char* kVertexShader = "shaders/vshader-2d.glsl";
     static const char* kPixelShader = "shaders/pshader-2d.glsl";
 
@@ -125,25 +489,16 @@ int main() {
     FreeAsset(&vshader_asset);
     FreeAsset(&pshader_asset);
 
-    rc = shader.reload();
+    // the program binary is cached next to the baked textures; the driver
+    // builds the program while the textures load, the frames are not drawn
+    // until it's ready
+    rc = shader.reloadAsync(&smile_ctx.platform_api);
     if (eRcode_Ok != rc) {
         std::cerr << "Failed to reload shader: " << smile_ToString(rc) << std::endl;
         glfwTerminate();
         return 1;
     }
 
-    rc = shader.use();
-    if (eRcode_Ok != rc) {
-        std::cerr << "Failed to set shader: " << smile_ToString(rc) << std::endl;
-        glfwTerminate();
-        return 1;
-    }
-
-    SmileContext smile_ctx;
-    gl_utils::SetGraphicsApi(smile_ctx.platform_api);
-    smile_ctx.platform_api.LoadAsset              = &LoadAsset;
-    smile_ctx.platform_api.FreeAsset              = &FreeAsset;
-
     rc = smile_SetUp(&smile_ctx);
     if (eRcode_Ok != rc) {
         std::cerr << "Failed to set up smile engine: " << smile_ToString(rc) << std::endl;
@@ -153,86 +508,318 @@ int main() {
 
     FrameEncoder frame;
     CALL_GL(1, glGenVertexArrays, 1, &frame.main);
-    CALL_GL(1, glBindVertexArray, frame.main);
+    CALL_GL(1, gl_utils::BindVertexArray, frame.main);
     frame.current = frame.main;
 
-    rc = smile_ReloadResources(&smile_ctx, 0);
+    // the calls of the trace up to its first frame load the resources
+    rc = replaying ? player.playFrame(smile_ctx.platform_api, 0, &frame)
+                   : smile_ReloadResources(&smile_ctx, 0);
     if (eRcode_Ok != rc) {
         std::cerr << "Failed to reload resources: " << smile_ToString(rc) << std::endl;
         glfwTerminate();
         return 1;
     }
+    if (capturing) {
+        smile::MarkApiCaptureFrame();
+    }
 
     glm::mat2 view_matrix(1.0f);
-    view_matrix[1][1] = 600.0f/800.0f;
+    view_matrix[1][1] = static_cast<f32>(kWindowWidth)/kWindowHeight;
+
+    gl_utils::UniformBuffer frameUniforms;
+    rc = frameUniforms.setUp(gl_utils::kFrameBlockBinding, sizeof(gl_utils::FrameBlock));
+    if (eRcode_Ok != rc) {
+        std::cerr << "Failed to set up the frame uniforms: " << smile_ToString(rc) << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    bool shaderBound = false; // to the frame block and the texture unit
 
-    CALL_GL(1, glBindVertexArray, 0);
+    CALL_GL(1, gl_utils::BindVertexArray, 0);
     frame.current = 0;
 
-    glClearColor(0.23f, 0.39f, 0.51f, 1.0f);
+    gl_utils::ClearColor(0.23f, 0.39f, 0.51f, 1.0f);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_utils::EnableBlending(true);
+    gl_utils::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     using default_clock = std::chrono::high_resolution_clock;
-    default_clock::time_point last = default_clock::now();
 
-    while(!glfwWindowShouldClose(pwnd)) {
-        glfwPollEvents();
+    const FramePacer::Mode paceMode = (headless || replaying) ? FramePacer::Mode::None
+                                    : frameRate > 0 ? FramePacer::Mode::Timer : FramePacer::Mode::VSync;
+    FramePacer pacer(paceMode, frameRate > 0 ? frameRate : headless ? 60.0 : DisplayRefreshRate());
+
+    std::vector<f64> frameTimes; // of the headless run
+    if (headless) {
+        try {
+            frameTimes.reserve(static_cast<size_t>(headlessFrames));
+        } catch (const std::exception&) {
+            std::cerr << "WARNING: too many frames to keep their times" << std::endl;
+        }
+    }
+
+    u64 nbFrames = 0;
+    u64 glIssued = 0, glElided = 0;
+    u64 nbDraws = 0, nbSprites = 0;
+    f64 cpuUpdate = 0.0, cpuRender = 0.0;
+    u64 nbGpuFrames = 0, lastGpuFrame = 0;
+    f64 gpuFrame = 0.0;
+    GpuTiming gpuScopes[SMILE_MAX_GPU_TIMINGS];
+    u32 nbGpuScopes = 0;
+    gl_utils::ResetGlStateStats();
+
+    // the measured frames all draw
+    if (headless) {
+        while (gl_utils::ShaderState::Pending == shader.poll()) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::atomic<bool> updating{updateRate > 0};
+    std::thread updater;
+    if (updating) {
+        updater = std::thread([&smile_ctx, &updating, updateRate]() {
+            smile::profiler::SetThreadName("update");
+
+            const std::chrono::duration<double> period(1.0 / updateRate);
+
+            default_clock::time_point last = default_clock::now();
+            default_clock::time_point next = last + std::chrono::duration_cast<default_clock::duration>(period);
+
+            while (updating.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_until(next);
 
-        default_clock::time_point now = default_clock::now();
-        std::chrono::duration<double> d = now - last;
-        if (d.count() >= 1.000 / 60.0) {
-            last = now;
+                default_clock::time_point now = default_clock::now();
+                std::chrono::duration<double> d = now - last;
+                last = now;
+                next += std::chrono::duration_cast<default_clock::duration>(period);
+                if (next < now) {
+                    next = now; // fell behind, don't try to catch up
+                }
 
+                Rcode rc = smile_Update(&smile_ctx, d.count());
+                if (eRcode_Ok != rc) {
+                    std::cerr << "WARNING: failed to update: " << smile_ToString(rc) << std::endl;
+                }
+            }
+        });
+    }
+
+    smile::profiler::SetThreadName("main");
+
+    while(headless ? nbFrames < headlessFrames : !glfwWindowShouldClose(pwnd)) {
+        if (replaying && player.finished()) {
+            break;
+        }
+
+        const f64 frameTime = pacer.wait();
+        SMILE_ZONE("frame");
+
+        if (headless) {
+            if (nbFrames > 0 && frameTimes.size() < frameTimes.capacity()) {
+                frameTimes.push_back(frameTime);
+            }
+        } else {
+            glfwPollEvents();
+        }
+
+        gl_utils::BeginGpuFrame();
+
+        {
+            gl_utils::GpuScope scope("clear");
             glClear(GL_COLOR_BUFFER_BIT);
+        }
 
+        const gl_utils::ShaderState shaderState = shader.poll();
+        if (gl_utils::ShaderState::Invalid == shaderState) {
+            std::cerr << "Failed to build shader" << std::endl;
+            break;
+        }
+
+        if (gl_utils::ShaderState::Ready == shaderState) {
             shader.use();
-            rc = shader.setUniform("view"sv, view_matrix);
+
+            if (!shaderBound) {
+                rc = shader.bindUniformBlock(gl_utils::kFrameBlockName, gl_utils::kFrameBlockBinding);
+                if (eRcode_Ok != rc) {
+                    std::cerr << "WARNING: failed to bind uniform block 'Frame': "
+                              << smile_ToString(rc) << std::endl;
+                }
+
+                rc = shader.setUniform(shader.uniform<GLint>("sprite"), 0);
+                if (eRcode_Ok != rc) {
+                    std::cerr << "WARNING: failed to set uniform variable 'sprite': "
+                              << smile_ToString(rc) << std::endl;
+                }
+
+                shaderBound = true;
+            }
+
+            rc = frameUniforms.update(gl_utils::FrameBlock{gl_utils::Std140Mat2(view_matrix)});
             if (eRcode_Ok != rc) {
-                std::cerr << "WARNING: failed to set uniform variable 'view': "
+                std::cerr << "WARNING: failed to update the frame uniforms: "
                           << smile_ToString(rc) << std::endl;
             }
+        }
 
-            glBindVertexArray(frame.main);
-            frame.current = frame.main;
+        gl_utils::BindVertexArray(frame.main);
+        frame.current = frame.main;
 
-            rc = smile_Update(&smile_ctx, d.count());
+        if (!replaying && !updater.joinable()) {
+            rc = smile_Update(&smile_ctx, frameTime);
             if (eRcode_Ok != rc) {
                 std::cerr << "WARNING: failed to update frame: "
                           << smile_ToString(rc) << " (state == "
                           << (int)smile_ctx.resources_state << ")"
                           << std::endl;
             }
+        }
 
-            rc = smile_Render(&smile_ctx, &frame);
+        if (gl_utils::ShaderState::Ready == shaderState) {
+            gl_utils::GpuScope scope("render");
+            rc = replaying ? player.playFrame(smile_ctx.platform_api, 0, &frame)
+                           : smile_Render(&smile_ctx, &frame);
             if (eRcode_Ok != rc) {
                 std::cerr << "WARNING: failed to render frame: "
                           << smile_ToString(rc) << std::endl;
             }
+        }
 
+        if (capturing) {
+            smile::MarkApiCaptureFrame();
+        }
+
+        gl_utils::CheckGlFrameErrors();
 
-            glBindVertexArray(0);
-            frame.current = 0;
+        SpriteStats spriteStats;
+        if (eRcode_Ok == smile_GetSpriteStats(&smile_ctx, &spriteStats)) {
+            nbDraws += spriteStats.nb_draws;
+            nbSprites += spriteStats.nb_sprites;
+        }
 
-            glfwSwapBuffers(pwnd);
+        {
+            SMILE_ZONE("swap");
+            gl_utils::GpuScope scope("swap");
+            if (headless) {
+                offscreen.present();
+            } else {
+                glfwSwapBuffers(pwnd);
+            }
+        }
+
+        gl_utils::EndGpuFrame();
+
+        FrameStats frameStats;
+        if (eRcode_Ok == smile_GetFrameStats(&smile_ctx, &frameStats)) {
+            cpuUpdate += frameStats.cpu_update;
+            cpuRender += frameStats.cpu_render;
+            if (frameStats.gpu_frame_index != lastGpuFrame) {
+                lastGpuFrame = frameStats.gpu_frame_index;
+                ++nbGpuFrames;
+                gpuFrame += frameStats.gpu_frame;
+                AccumulateGpuTimings(gpuScopes, nbGpuScopes, frameStats);
+            }
         }
+
+        const gl_utils::GlStateStats glStats = gl_utils::GetGlStateStats();
+        gl_utils::ResetGlStateStats();
+        glIssued += glStats.issued;
+        glElided += glStats.elided;
+        ++nbFrames;
     }
 
-    rc = smile_UnloadResources(&smile_ctx);
-    if (eRcode_Ok != rc) {
-        std::cerr << "WARNING: failed to unload resources: "
-                  << smile_ToString(rc) << std::endl;
+    if (headless) {
+        // a frame is measured by the wait of the next one
+        if (nbFrames > 0 && frameTimes.size() < frameTimes.capacity()) {
+            frameTimes.push_back(pacer.wait());
+        }
+        PrintFrameTimePercentiles(frameTimes);
+    }
+
+    const FramePacer::Stats& paceStats = pacer.stats();
+    if (FramePacer::Mode::None != pacer.mode() && paceStats.nb_frames > 1) {
+        std::cout << "Frame time (" << (FramePacer::Mode::VSync == pacer.mode() ? "vsync" : "timer")
+                  << ", " << pacer.rate() << " Hz): mean " << paceStats.mean*1000.0
+                  << " ms, jitter " << paceStats.jitter*1000.0 << " ms, max " << paceStats.max*1000.0
+                  << " ms, missed " << paceStats.nb_missed << " of " << paceStats.nb_frames << std::endl;
+    }
+
+    if (nbFrames > 0) {
+        std::cout << "CPU time per frame: update " << cpuUpdate/nbFrames*1000.0
+                  << " ms, render " << cpuRender/nbFrames*1000.0 << " ms" << std::endl;
+    }
+    if (nbGpuFrames > 0) {
+        std::cout << "GPU time per frame: " << gpuFrame/nbGpuFrames*1000.0 << " ms (";
+        for (u32 i = 0; i < nbGpuScopes; ++i) {
+            std::cout << (i > 0 ? ", " : "") << gpuScopes[i].name << " "
+                      << gpuScopes[i].time/nbGpuFrames*1000.0 << " ms";
+        }
+        std::cout << "), " << gl_utils::GetGpuTimerDropped() << " frames dropped" << std::endl;
+    }
+
+    if (nbFrames > 0) {
+        std::cout << "GL state calls per frame: issued " << (f64)glIssued/nbFrames
+                  << ", elided " << (f64)glElided/nbFrames << std::endl;
+    }
+    if (nbDraws > 0) {
+        std::cout << "Sprite draws per frame: " << (f64)nbDraws/nbFrames
+                  << ", sprites per draw: " << (f64)nbSprites/nbDraws << std::endl;
+    }
+
+    std::cout << "Frame uniform uploads: " << frameUniforms.uploads()
+              << ", skipped as unchanged: " << frameUniforms.skipped() << std::endl;
+
+    if (updater.joinable()) {
+        updating = false;
+        updater.join();
+    }
+
+    frameUniforms.release();
+    gl_utils::TearDownGpuTimer();
+
+    if (replaying) {
+        player.close();
+    } else {
+        rc = smile_UnloadResources(&smile_ctx);
+        if (eRcode_Ok != rc) {
+            std::cerr << "WARNING: failed to unload resources: "
+                      << smile_ToString(rc) << std::endl;
+        }
+    }
+
+    // after the unload, so the trace releases what it created
+    if (capturing) {
+        rc = smile::StopApiCapture(smile_ctx.platform_api);
+        if (eRcode_Ok != rc) {
+            std::cerr << "WARNING: failed to write api trace " << capturePath << ": "
+                      << smile_ToString(rc) << std::endl;
+        }
     }
 
+    glDeleteVertexArrays(1, &frame.main);
+    gl_utils::ForgetVertexArray(frame.main);
+
     rc = smile_TearDown(&smile_ctx);
     if (eRcode_Ok != rc) {
         std::cerr << "Error while tearing down smile engine: "
                   << smile_ToString(rc) << std::endl;
     }
 
+    sAssetPack.close();
+    FreeAsset(&sAssetPackData);
+
+    offscreen.release();
     glfwTerminate();
 
+    // the zones of the run, for chrome://tracing or Perfetto
+    const char* tracePath = std::getenv("SMILE_TRACE");
+    if (tracePath && *tracePath) {
+        rc = smile::profiler::WriteChromeTrace(tracePath);
+        if (eRcode_Ok != rc) {
+            std::cerr << "WARNING: failed to write the trace: " << smile_ToString(rc) << std::endl;
+        }
+    }
+
     std::cout << "Smile App Finished" << std::endl;
 
     return 0;
@@ -0,0 +1,249 @@
+#include "offscreen.hpp"
+
+#include <cstring>
+
+#if defined(SMILE_HAS_EGL)
+#    include <EGL/egl.h>
+#    include <EGL/eglext.h>
+#endif
+
+#include "api.hpp"
+
+#include "smile/log.hpp"
+
+
+namespace {
+
+// the same context as of the window
+constexpr int kGlMajor = 4;
+constexpr int kGlMinor = 1;
+
+// a frame not finished in this time is not waited for anymore
+constexpr GLuint64 kPresentTimeout = 1000000000; // ns
+
+}
+
+
+OffscreenContext::OffscreenContext() noexcept
+    : _width(0), _height(0)
+    , _eglDisplay(nullptr), _eglContext(nullptr)
+    , _window(nullptr)
+    , _framebuffer(0), _colorbuffer(0)
+    , _fences{}
+    , _frame(0)
+{}
+
+
+OffscreenContext::~OffscreenContext() noexcept {
+    release();
+}
+
+
+Rcode OffscreenContext::create(int width, int height, bool debug) noexcept {
+    if (_eglContext || _window) {
+        return RC(Already);
+    }
+
+    if (width <= 0 || height <= 0) {
+        return RC(InvalidInput);
+    }
+
+    _width = width;
+    _height = height;
+
+    if (createEgl(debug) || createHiddenWindow(debug)) {
+        return RC(Ok);
+    }
+
+    return RC(InternalError);
+}
+
+
+bool OffscreenContext::createEgl(bool debug) noexcept {
+#if defined(SMILE_HAS_EGL)
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!clientExtensions || !std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        SMILE_LOG(Info) << "EGL surfaceless platform is not supported";
+        return false;
+    }
+
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (!getPlatformDisplay) {
+        return false;
+    }
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major, minor;
+    if (EGL_NO_DISPLAY == display || !eglInitialize(display, &major, &minor)) {
+        SMILE_LOG(Warning) << "Failed to initialize EGL surfaceless display: " << eglGetError();
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        SMILE_LOG(Warning) << "EGL has no desktop OpenGL";
+        eglTerminate(display);
+        return false;
+    }
+
+    // no surfaces, so any config which renders OpenGL, or none at all
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT
+    ,   EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint nbConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &nbConfigs) || 0 == nbConfigs) {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, kGlMajor
+    ,   EGL_CONTEXT_MINOR_VERSION, kGlMinor
+    ,   EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT
+    ,   EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE
+    ,   EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE
+    ,   EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (EGL_NO_CONTEXT == context) {
+        SMILE_LOG(Warning) << "Failed to create EGL context: " << eglGetError();
+        eglTerminate(display);
+        return false;
+    }
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        SMILE_LOG(Warning) << "Failed to make EGL context current: " << eglGetError();
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return false;
+    }
+
+    _eglDisplay = display;
+    _eglContext = context;
+
+    return true;
+#else
+    (void)debug;
+    return false;
+#endif
+}
+
+
+bool OffscreenContext::createHiddenWindow(bool debug) noexcept {
+    if (!glfwInit()) {
+        SMILE_LOG(Warning) << "Failed to init GLFW";
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, kGlMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, kGlMinor);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GL_TRUE : GL_FALSE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    _window = glfwCreateWindow(_width, _height, "Smile", nullptr, nullptr);
+    if (!_window) {
+        const char* buffer = nullptr;
+        glfwGetError(&buffer);
+        SMILE_LOG(Warning) << "Failed to create hidden window: " << (buffer ? buffer : "unknown");
+        return false;
+    }
+
+    glfwMakeContextCurrent(_window);
+    glfwSwapInterval(0);
+
+    return true;
+}
+
+
+Rcode OffscreenContext::setUpTarget() noexcept {
+    if (!_eglContext && !_window) {
+        return RC(NotInitialized);
+    }
+
+    if (_framebuffer) {
+        return RC(Already);
+    }
+
+    CALL_GL(RC(InternalError), glGenFramebuffers, 1, &_framebuffer);
+    CALL_GL(RC(InternalError), glBindFramebuffer, GL_FRAMEBUFFER, _framebuffer);
+
+    CALL_GL(RC(InternalError), glGenRenderbuffers, 1, &_colorbuffer);
+    CALL_GL(RC(InternalError), glBindRenderbuffer, GL_RENDERBUFFER, _colorbuffer);
+    CALL_GL(RC(InternalError), glRenderbufferStorage, GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+    CALL_GL(RC(InternalError), glFramebufferRenderbuffer,
+            GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorbuffer);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (GL_FRAMEBUFFER_COMPLETE != status) {
+        SMILE_LOG(Error) << "Offscreen framebuffer is incomplete: " << status;
+        return RC(InternalError);
+    }
+
+    // a surfaceless context starts with an empty viewport
+    CALL_GL(RC(InternalError), glViewport, 0, 0, _width, _height);
+
+    return RC(Ok);
+}
+
+
+void OffscreenContext::release() noexcept {
+    if (_eglContext || _window) {
+        for (GLsync& fence : _fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+
+        if (_colorbuffer) {
+            glDeleteRenderbuffers(1, &_colorbuffer);
+        }
+        if (_framebuffer) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &_framebuffer);
+        }
+    }
+    _colorbuffer = 0;
+    _framebuffer = 0;
+
+#if defined(SMILE_HAS_EGL)
+    if (_eglContext) {
+        eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(_eglDisplay, _eglContext);
+        eglTerminate(_eglDisplay);
+    }
+#endif
+    _eglContext = nullptr;
+    _eglDisplay = nullptr;
+
+    if (_window) {
+        glfwDestroyWindow(_window);
+        _window = nullptr;
+    }
+}
+
+
+const char* OffscreenContext::kind() const noexcept {
+    if (_eglContext) return "EGL surfaceless";
+    if (_window) return "hidden GLFW window";
+    return "none";
+}
+
+
+void OffscreenContext::present() noexcept {
+    _fences[_frame % kFramesInFlight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++_frame;
+
+    GLsync& oldest = _fences[_frame % kFramesInFlight];
+    if (oldest) {
+        const GLenum rc = glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, kPresentTimeout);
+        if (GL_TIMEOUT_EXPIRED == rc || GL_WAIT_FAILED == rc) {
+            SMILE_LOG(Warning) << "Offscreen frame is not finished in time";
+        }
+
+        glDeleteSync(oldest);
+        oldest = 0;
+    }
+}
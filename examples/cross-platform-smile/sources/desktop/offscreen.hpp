@@ -0,0 +1,63 @@
+#ifndef DESKTOP_OFFSCREEN_HPP_
+
+#if defined(PLATFORM_WINDOWS)
+#    include <Windows.h>
+#endif
+
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+
+#include "smile/smile.h"
+
+
+// OpenGL context with no display for the headless runs: the frames are drawn
+// into a framebuffer object instead of a window.
+//
+// On Unix it is an EGL context on the surfaceless platform of Mesa (works
+// with the software rasterizer and no X or Wayland server), elsewhere and if
+// that fails - a hidden GLFW window.
+//
+// There is no swap chain to limit how far the CPU runs ahead, so present()
+// fences every frame and waits for the one kFramesInFlight frames back,
+// like a swap would.
+class OffscreenContext {
+    OffscreenContext(const OffscreenContext&) = delete;
+    OffscreenContext& operator = (const OffscreenContext&) = delete;
+
+public:
+    static constexpr u32 kFramesInFlight = 2;
+
+    OffscreenContext() noexcept;
+   ~OffscreenContext() noexcept;
+
+    // Creates the context and makes it current on the calling thread.
+    Rcode create(int width, int height, bool debug) noexcept;
+    // Creates and binds the framebuffer, the OpenGL functions must be loaded.
+    Rcode setUpTarget() noexcept;
+    void release() noexcept;
+
+    // "EGL surfaceless" or "hidden GLFW window"
+    const char* kind() const noexcept;
+
+    void present() noexcept;
+
+private:
+    bool createEgl(bool debug) noexcept;
+    bool createHiddenWindow(bool debug) noexcept;
+
+    int _width, _height;
+
+    void* _eglDisplay; // EGLDisplay, EGLContext
+    void* _eglContext;
+    GLFWwindow* _window;
+
+    GLuint _framebuffer;
+    GLuint _colorbuffer;
+
+    GLsync _fences[kFramesInFlight];
+    u32 _frame;
+};
+
+
+#define DESKTOP_OFFSCREEN_HPP_
+#endif
@@ -5,7 +5,10 @@ layout (location = 1) in vec4 instance_pos;
 
 out vec2 texels_out;
 
-uniform mat2 view;
+// constants of the frame shared by the programs
+layout (std140) uniform Frame {
+    mat2 view;
+};
 
 void main() {
     texels_out = pos_texels.zw;
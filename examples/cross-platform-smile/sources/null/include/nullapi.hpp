@@ -0,0 +1,65 @@
+#ifndef NULL_NULLAPI_HPP_
+
+#include "smile/smile.h"
+
+
+// Graphics functions of the platform api which draw nothing: the buffers and
+// the textures are plain memory, the calls are only validated and counted.
+// Runs the engine with no graphics API or driver at all, so its own CPU cost
+// can be measured. Like the OpenGL backend, it is for one (rendering) thread
+// and defines the ShaderBuffer, TextureData and FrameEncoder of its own, the
+// two can not be linked together.
+
+struct ShaderBuffer {
+    BufferType type;
+    u32 size;
+    byte* contents;
+};
+
+
+struct TextureData {
+    u32 width;
+    u32 height;
+    u32 szrow;
+    byte* pixels;
+};
+
+
+// what the following draws use
+struct FrameEncoder {
+    ShaderBufferPtr vertices{nullptr};
+    u32 vertices_offset{0};
+    TextureDataPtr texture{nullptr};
+    f32 clear_color[3]{};
+};
+
+
+namespace null_api {
+
+
+struct NullApiStats {
+    u64 calls{0};           // of the graphics functions
+    u64 buffers{0};         // alive
+    u64 textures{0};        // alive
+    u64 nb_commits{0};
+    u64 bytes_committed{0};
+    u64 texture_bytes{0};   // uploaded
+    u64 nb_draws{0};
+    u64 nb_instances{0};    // drawn
+    u64 nb_indices{0};      // drawn, per instance
+};
+
+
+// sets the graphics functions, the asset ones are left to the platform
+void SetGraphicsApi(PlatformApi& api) noexcept;
+
+NullApiStats GetNullApiStats() noexcept;
+// the alive buffers and textures are kept
+void ResetNullApiStats() noexcept;
+
+
+}
+
+
+#define NULL_NULLAPI_HPP_
+#endif
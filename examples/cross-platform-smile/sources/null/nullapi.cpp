@@ -0,0 +1,224 @@
+#include "nullapi.hpp"
+
+#include <cstring>
+#include <new>
+
+#include "smile/log.hpp"
+
+
+using namespace null_api;
+
+
+namespace {
+
+static NullApiStats sStats;
+
+}
+
+
+static
+Rcode CreateShaderBuffer( ShaderBufferPtr* outbuf, GraphContextPtr
+                        , u32 size, BufferType type, char*)
+{
+    ++sStats.calls;
+
+    if (!outbuf || 0 == size) {
+        return RC(InvalidInput);
+    }
+
+    ShaderBufferPtr sbuf = new (std::nothrow) ShaderBuffer{type, size, nullptr};
+    if (!sbuf) {
+        return RC(MemError);
+    }
+
+    sbuf->contents = new (std::nothrow) byte[size];
+    if (!sbuf->contents) {
+        delete sbuf;
+        return RC(MemError);
+    }
+
+    ++sStats.buffers;
+    *outbuf = sbuf;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode ReleaseShaderBuffer(ShaderBufferPtr pbuf) {
+    ++sStats.calls;
+
+    if (!pbuf) {
+        return RC(InvalidInput);
+    }
+
+    --sStats.buffers;
+    delete[] pbuf->contents;
+    delete pbuf;
+
+    return RC(Ok);
+}
+
+
+static
+void* GetShaderBufferContent(ShaderBufferPtr pbuf) {
+    ++sStats.calls;
+    return pbuf ? pbuf->contents : nullptr;
+}
+
+
+static
+Rcode CommitShaderBuffer(ShaderBufferPtr pbuf, u32 offset, u32 size) {
+    ++sStats.calls;
+
+    if (!pbuf) {
+        return RC(InvalidInput);
+    }
+
+    if (offset > pbuf->size || size > pbuf->size - offset) {
+        SMILE_LOG(Error) << "Wrong commit range";
+        return RC(InvalidInput);
+    }
+
+    ++sStats.nb_commits;
+    sStats.bytes_committed += size;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode SetVertexBuffer(FrameEncoderPtr pframe, ShaderBufferPtr pbuf, u32 offset) {
+    ++sStats.calls;
+
+    if (!pframe || !pbuf || offset > pbuf->size) {
+        return RC(InvalidInput);
+    }
+
+    pframe->vertices = pbuf;
+    pframe->vertices_offset = offset;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode DrawIndexedPrimitive(FrameEncoderPtr pframe,
+        u32 nbIndices, u32 nbInstances, ShaderBufferPtr pIndiciesBuffer)
+{
+    ++sStats.calls;
+
+    if (!pframe || !pIndiciesBuffer) {
+        return RC(InvalidInput);
+    }
+
+    if (!pframe->vertices || nbIndices*sizeof(u16) > pIndiciesBuffer->size) {
+        SMILE_LOG(Error) << "Wrong draw";
+        return RC(LogicError);
+    }
+
+    ++sStats.nb_draws;
+    sStats.nb_instances += nbInstances;
+    sStats.nb_indices += nbIndices;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode CreateTextureFromImage(TextureDataPtr* out, GraphContextPtr, ImageData* data) {
+    ++sStats.calls;
+
+    if (!out || !data || !data->data) {
+        return RC(InvalidInput);
+    }
+
+    TextureDataPtr ptex = new (std::nothrow) TextureData{data->width, data->height, data->szrow, nullptr};
+    if (!ptex) {
+        return RC(MemError);
+    }
+
+    // uploaded as a driver would do
+    ptex->pixels = new (std::nothrow) byte[data->szdata];
+    if (!ptex->pixels) {
+        delete ptex;
+        return RC(MemError);
+    }
+    std::memcpy(ptex->pixels, data->data, data->szdata);
+
+    ++sStats.textures;
+    sStats.texture_bytes += data->szdata;
+    *out = ptex;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode ReleaseTexture(TextureDataPtr tex) {
+    ++sStats.calls;
+
+    if (!tex) return RC(Already);
+
+    --sStats.textures;
+    delete[] tex->pixels;
+    delete tex;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode SetTextureSlot(FrameEncoderPtr pframe, TextureDataPtr tex) {
+    ++sStats.calls;
+
+    if (!pframe || !tex) return RC(InvalidInput);
+
+    pframe->texture = tex;
+
+    return RC(Ok);
+}
+
+
+static
+Rcode SetClearColor(FrameEncoderPtr pframe, float R, float G, float B) {
+    ++sStats.calls;
+
+    if (pframe) {
+        pframe->clear_color[0] = R;
+        pframe->clear_color[1] = G;
+        pframe->clear_color[2] = B;
+    }
+
+    return RC(Ok);
+}
+
+
+void null_api::SetGraphicsApi(PlatformApi& api) noexcept {
+    api.CreateShaderBuffer     = &CreateShaderBuffer;
+    api.ReleaseShaderBuffer    = &ReleaseShaderBuffer;
+    api.GetShaderBufferContent = &GetShaderBufferContent;
+    api.CommitShaderBuffer     = &CommitShaderBuffer;
+    api.SetVertexBuffer        = &SetVertexBuffer;
+    api.DrawIndexedPrimitive   = &DrawIndexedPrimitive;
+    api.CreateTextureFromImage = &CreateTextureFromImage;
+    api.ReleaseTexture         = &ReleaseTexture;
+    api.SetTextureSlot         = &SetTextureSlot;
+    api.SetClearColor          = &SetClearColor;
+    api.GetGpuTimings          = nullptr;
+}
+
+
+NullApiStats null_api::GetNullApiStats() noexcept {
+    return sStats;
+}
+
+
+void null_api::ResetNullApiStats() noexcept {
+    const u64 buffers = sStats.buffers;
+    const u64 textures = sStats.textures;
+
+    sStats = NullApiStats{};
+    sStats.buffers = buffers;
+    sStats.textures = textures;
+}
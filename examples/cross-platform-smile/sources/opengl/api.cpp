@@ -1,18 +1,149 @@
 #include "api.hpp"
 
+#include <cstdint>
+
 #include "smile/log.hpp"
+#include "smile/profiler.hpp"
 
 #include "errors.hpp"
+#include "glstate.hpp"
+#include "gputimer.hpp"
 
 
 static constexpr GLuint kPosTexelsVectorIndex = 0;
 static constexpr GLuint kInstancePosVectorIndex = 1;
 
+// a region not released by the GPU in this time is overwritten anyway
+static constexpr GLuint64 kStreamFenceTimeout = 1000000000; // ns
+
+
+static
+Rcode CreateStreamStorage(ShaderBufferPtr sbuf) {
+    const GLsizeiptr szStorage = static_cast<GLsizeiptr>(sbuf->size) * kStreamRegions;
+
+#if !defined(PLATFORM_ANDROID)
+    if (GLEW_ARB_buffer_storage) {
+        const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        // dynamic storage keeps glBufferSubData as a fallback
+        CALL_GL(RC(InternalError), glBufferStorage,
+                sbuf->target, szStorage, nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT);
+
+        sbuf->mapped = static_cast<byte*>(glMapBufferRange(sbuf->target, 0, szStorage, mapFlags));
+        if (sbuf->mapped) {
+            sbuf->stream = StreamMode::Persistent;
+            return RC(Ok);
+        }
+
+        SMILE_LOG(Warning) << "Failed to map the stream buffer persistently";
+        gl_utils::CheckGlCallErrors(__func__, "glMapBufferRange");
+        sbuf->stream = StreamMode::Copied;
+        return RC(Ok);
+    }
+#endif
+
+    CALL_GL(RC(InternalError), glBufferData,
+            sbuf->target, szStorage, nullptr, sbuf->usage);
+    sbuf->stream = StreamMode::Mapped;
+
+    return RC(Ok);
+}
+
+
+static void WaitStreamFence(GLsync& fence) noexcept {
+    if (!fence) {
+        return;
+    }
+
+    GLenum rc = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kStreamFenceTimeout);
+    if (GL_TIMEOUT_EXPIRED == rc || GL_WAIT_FAILED == rc) {
+        SMILE_LOG(Warning) << "Stream buffer region is not released by the GPU in time";
+    }
+
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+
+static byte* NextStreamRegion(ShaderBufferPtr pbuf) noexcept {
+    if (StreamMode::Mapped == pbuf->stream && pbuf->current && pbuf->current != pbuf->contents) {
+        // handed out, but never committed
+        gl_utils::BindBuffer(pbuf->target, pbuf->index);
+        glUnmapBuffer(pbuf->target);
+    }
+
+    // all of the draws reading the current region are issued by now
+    pbuf->fences[pbuf->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    pbuf->region = (pbuf->region + 1) % kStreamRegions;
+    WaitStreamFence(pbuf->fences[pbuf->region]);
+
+    const u32 offset = pbuf->region * pbuf->size;
+
+    switch (pbuf->stream) {
+        case StreamMode::Persistent:
+            pbuf->current = pbuf->mapped + offset;
+            break;
+
+        case StreamMode::Mapped: {
+            // the fence already guarantees the region is not in use
+            gl_utils::BindBuffer(pbuf->target, pbuf->index);
+            void* p = glMapBufferRange( pbuf->target, offset, pbuf->size
+                                      , GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+                                      | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT );
+
+            if (!p) {
+                SMILE_LOG(Warning) << "Failed to map the stream buffer region";
+                gl_utils::CheckGlCallErrors(__func__, "glMapBufferRange");
+            }
+            pbuf->current = p ? static_cast<byte*>(p) : pbuf->contents;
+            break;
+        }
+
+        default:
+            pbuf->current = pbuf->contents;
+            break;
+    }
+
+    return pbuf->current;
+}
+
+
+static
+Rcode CommitStreamRegion(ShaderBufferPtr pbuf, u32 offset, u32 size) {
+    const u32 base = pbuf->region * pbuf->size;
+
+    byte* current = pbuf->current;
+    pbuf->current = nullptr;
+    pbuf->committed = base;
+
+    if (StreamMode::Persistent == pbuf->stream) {
+        // coherent mapping, the writes are visible to the next draws
+        return RC(Ok);
+    }
+
+    CALL_GL(RC(InternalError), gl_utils::BindBuffer, pbuf->target, pbuf->index);
+
+    if (StreamMode::Mapped == pbuf->stream && current && current != pbuf->contents) {
+        CALL_GL(RC(InternalError), glFlushMappedBufferRange, pbuf->target, offset, size);
+        if (GL_FALSE == glUnmapBuffer(pbuf->target)) {
+            SMILE_LOG(Warning) << "Stream buffer region is corrupted, it is redrawn next frame";
+        }
+    } else {
+        CALL_GL(RC(InternalError), glBufferSubData,
+                pbuf->target, base + offset, size, pbuf->contents + offset);
+    }
+
+    return RC(Ok);
+}
+
 
 static
 Rcode CreateShaderBuffer( ShaderBufferPtr* outbuf, GraphContextPtr
                         , u32 size, BufferType type, char*)
 {
+    SMILE_ZONE("CreateShaderBuffer");
+
     ShaderBufferPtr sbuf = new ShaderBuffer;
     if (!sbuf) {
         return eRcode_MemError;
@@ -44,7 +175,7 @@ Rcode CreateShaderBuffer( ShaderBufferPtr* outbuf, GraphContextPtr
     else
         sbuf->usage = GL_STATIC_DRAW;
 
-    CALL_GL(RC(InternalError), glBindBuffer, sbuf->target, sbuf->index);
+    CALL_GL(RC(InternalError), gl_utils::BindBuffer, sbuf->target, sbuf->index);
 
     if (eBufferType_Geometry == type) {
         CALL_GL(RC(InternalError), glEnableVertexAttribArray, kPosTexelsVectorIndex);
@@ -56,25 +187,41 @@ Rcode CreateShaderBuffer( ShaderBufferPtr* outbuf, GraphContextPtr
                 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4, NULL);
         CALL_GL(RC(InternalError), glVertexAttribDivisor, kInstancePosVectorIndex, 1);
 
-        CALL_GL(RC(InternalError), glBufferData,
-                sbuf->target, size, sbuf->contents, sbuf->usage);
+        Rcode rc = CreateStreamStorage(sbuf);
+        if (eRcode_Ok != rc) {
+            return rc;
+        }
     }
 
     *outbuf = sbuf;
 
-    CALL_GL(RC(InternalError), glBindBuffer, sbuf->target, 0);
-
     return RC(Ok);
 }
 
 
 static
 Rcode ReleaseShaderBuffer(ShaderBufferPtr pbuf) {
+    SMILE_ZONE("ReleaseShaderBuffer");
+
     if (!pbuf) {
         return eRcode_InvalidInput;
     }
 
+    for (GLsync& fence : pbuf->fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+
+    if (pbuf->mapped || (StreamMode::Mapped == pbuf->stream && pbuf->current
+                                                             && pbuf->current != pbuf->contents))
+    {
+        gl_utils::BindBuffer(pbuf->target, pbuf->index);
+        glUnmapBuffer(pbuf->target);
+    }
+
     glDeleteBuffers(1, &pbuf->index);
+    gl_utils::ForgetBuffer(pbuf->index);
 
     delete[] pbuf->contents;
     delete pbuf;
@@ -85,18 +232,33 @@ Rcode ReleaseShaderBuffer(ShaderBufferPtr pbuf) {
 
 static
 void* GetShaderBufferContent(ShaderBufferPtr pbuf) {
+    SMILE_ZONE("GetShaderBufferContent");
+
     if (!pbuf) return nullptr;
+    if (StreamMode::None != pbuf->stream) {
+        return NextStreamRegion(pbuf);
+    }
     return pbuf->contents;
 }
 
 
 static
 Rcode CommitShaderBuffer(ShaderBufferPtr pbuf, u32 offset, u32 size) {
+    SMILE_ZONE("CommitShaderBuffer");
+
     if (!pbuf) {
         return RC(InvalidInput);
     }
 
-    CALL_GL(RC(InternalError), glBindBuffer, pbuf->target, pbuf->index);
+    if (StreamMode::None != pbuf->stream) {
+        if (offset > pbuf->size || size > pbuf->size - offset) {
+            SMILE_LOG(Error) << "Wrong commit range";
+            return RC(InvalidInput);
+        }
+        return CommitStreamRegion(pbuf, offset, size);
+    }
+
+    CALL_GL(RC(InternalError), gl_utils::BindBuffer, pbuf->target, pbuf->index);
 
     if (pbuf->usage == GL_STATIC_DRAW) {
         if (offset != 0 || pbuf->size != size) {
@@ -107,31 +269,40 @@ Rcode CommitShaderBuffer(ShaderBufferPtr pbuf, u32 offset, u32 size) {
         CALL_GL(RC(InternalError), glBufferData,
                 pbuf->target, size, pbuf->contents, pbuf->usage);
     } else {
-        if (offset + size > size) {
+        if (offset > pbuf->size || size > pbuf->size - offset) {
             SMILE_LOG(Error) << "Wrong commit range";
             return RC(InvalidInput);
         }
         CALL_GL(RC(InternalError), glBufferSubData,
-                pbuf->target, offset, size, pbuf->contents);
+                pbuf->target, offset, size, pbuf->contents + offset);
     }
 
-    CALL_GL(RC(InternalError), glBindBuffer, pbuf->target, 0);
-
     return RC(Ok);
 }
 
 
 static
-Rcode SetVertexBuffer(FrameEncoderPtr pframe, ShaderBufferPtr pbuf, u32) {
+Rcode SetVertexBuffer(FrameEncoderPtr pframe, ShaderBufferPtr pbuf, u32 offset) {
+    SMILE_ZONE("SetVertexBuffer");
+
     if (!pbuf || !pframe) {
         return RC(InvalidInput);
     }
 
     if (pframe->current != pframe->main) {
-        CALL_GL(RC(InternalError), glBindVertexArray, pframe->main);
+        CALL_GL(RC(InternalError), gl_utils::BindVertexArray, pframe->main);
         pframe->current = pframe->main;
     }
 
+    if (StreamMode::None != pbuf->stream) {
+        // the instances are read from the last committed region, starting
+        // 'offset' bytes into it
+        CALL_GL(RC(InternalError), gl_utils::BindBuffer, pbuf->target, pbuf->index);
+        CALL_GL(RC(InternalError), glVertexAttribPointer, kInstancePosVectorIndex,
+                4, GL_FLOAT, GL_FALSE, sizeof(GLfloat)*4,
+                reinterpret_cast<const void*>(static_cast<std::uintptr_t>(pbuf->committed + offset)));
+    }
+
     return eRcode_Ok;
 }
 
@@ -140,10 +311,12 @@ static
 Rcode DrawIndexedPrimitive(FrameEncoderPtr pframe,
         u32 nbIndices, u32 nbInstances, ShaderBufferPtr pIndiciesBuffer)
 {
+    SMILE_ZONE("DrawIndexedPrimitive");
+
     if (!pframe || !pIndiciesBuffer)
         return RC(InvalidInput);
 
-    CALL_GL(RC(InternalError), glBindBuffer,
+    CALL_GL(RC(InternalError), gl_utils::BindBuffer,
             pIndiciesBuffer->target, pIndiciesBuffer->index);
     CALL_GL(RC(InternalError), glDrawElementsInstanced,
             GL_TRIANGLES, nbIndices, GL_UNSIGNED_SHORT, 0, nbInstances);
@@ -158,6 +331,8 @@ static bool is_power_of_2(T v) noexcept { return v > 0 && (v & (v - 1)) == 0; }
 
 static
 Rcode CreateTextureFromImage(TextureDataPtr* out, GraphContextPtr, ImageData* data) {
+    SMILE_ZONE("CreateTextureFromImage");
+
     if (!out || !data)
         return RC(InvalidInput);
 
@@ -166,7 +341,7 @@ Rcode CreateTextureFromImage(TextureDataPtr* out, GraphContextPtr, ImageData* da
         return RC(MemError);
 
     CALL_GL(RC(InternalError), glGenTextures, 1, &ptex->index);
-    CALL_GL(RC(InternalError), glBindTexture, GL_TEXTURE_2D, ptex->index);
+    CALL_GL(RC(InternalError), gl_utils::BindTexture, GL_TEXTURE_2D, ptex->index);
 
     GLint wrap_mode;
     if (!is_power_of_2(data->width) || !is_power_of_2(data->height))
@@ -188,7 +363,6 @@ Rcode CreateTextureFromImage(TextureDataPtr* out, GraphContextPtr, ImageData* da
             GL_TEXTURE_2D, 0, GL_RGBA, data->width, data->height,
             0, GL_RGBA, GL_UNSIGNED_BYTE, data->data);
 
-    CALL_GL(RC(InternalError), glBindTexture, GL_TEXTURE_2D, 0);
     *out = ptex;
 
     return RC(Ok);
@@ -197,9 +371,12 @@ Rcode CreateTextureFromImage(TextureDataPtr* out, GraphContextPtr, ImageData* da
 
 static
 Rcode ReleaseTexture(TextureDataPtr tex) {
+    SMILE_ZONE("ReleaseTexture");
+
     if (!tex) return RC(Already);
 
     glDeleteTextures(1, &tex->index);
+    gl_utils::ForgetTexture(tex->index);
 
     return RC(Ok);
 }
@@ -207,10 +384,12 @@ Rcode ReleaseTexture(TextureDataPtr tex) {
 
 static
 Rcode SetTextureSlot(FrameEncoderPtr, TextureDataPtr tex) {
+    SMILE_ZONE("SetTextureSlot");
+
     if (!tex) return RC(InvalidInput);
 
-    CALL_GL(RC(InternalError), glActiveTexture, GL_TEXTURE0);
-    CALL_GL(RC(InternalError), glBindTexture, GL_TEXTURE_2D, tex->index);
+    CALL_GL(RC(InternalError), gl_utils::ActiveTexture, GL_TEXTURE0);
+    CALL_GL(RC(InternalError), gl_utils::BindTexture, GL_TEXTURE_2D, tex->index);
 
     return RC(Ok);
 }
@@ -218,7 +397,9 @@ Rcode SetTextureSlot(FrameEncoderPtr, TextureDataPtr tex) {
 
 static
 Rcode SetClearColor(FrameEncoderPtr, float R, float G, float B) {
-    glClearColor(R, G, B, 1.0f);
+    SMILE_ZONE("SetClearColor");
+
+    gl_utils::ClearColor(R, G, B, 1.0f);
     return RC(Ok);
 }
 
@@ -234,5 +415,6 @@ void gl_utils::SetGraphicsApi(PlatformApi& api) noexcept {
     api.ReleaseTexture         = &ReleaseTexture;
     api.SetTextureSlot         = &SetTextureSlot;
     api.SetClearColor          = &SetClearColor;
+    api.GetGpuTimings          = &gl_utils::GetGpuTimings;
 }
 
@@ -1,5 +1,29 @@
+#if defined(PLATFORM_WINDOWS)
+#    include <Windows.h>
+#endif
+
+#if defined(PLATFORM_ANDROID)
+#   include <EGL/egl.h>
+#   include <GLES3/gl32.h>
+#   include <GLES2/gl2ext.h>
+#else
+#   include "GL/glew.h"
+#endif
+
+#include <cstring>
+
 #include "errors.hpp"
 
+#include "smile/log.hpp"
+
+
+// GLES exposes KHR_debug through the suffixed entry points only
+#if defined(PLATFORM_ANDROID)
+#   define KHR_DEBUG(Name) Name ## _KHR
+#else
+#   define KHR_DEBUG(Name) Name
+#endif
+
 
 const char* gl_utils::to_string(GLenum err) noexcept {
     switch(err) {
@@ -20,3 +44,85 @@ const char* gl_utils::to_string(GLenum err) noexcept {
     }
 }
 
+
+bool gl_utils::CheckGlErrors(const char* where, const char* what) noexcept {
+    GLenum err = glGetError();
+    if (GL_NO_ERROR == err)
+        return false;
+
+    do {
+        SMILE_LOG(Error).format("%s, OpenGL error %s in %s", where, to_string(err), what);
+        err = glGetError();
+    } while (err != GL_NO_ERROR);
+
+    return true;
+}
+
+
+static void
+#if !defined(PLATFORM_ANDROID)
+GLAPIENTRY
+#endif
+on_debug_message( GLenum source, GLenum type, GLuint id, GLenum severity
+                , GLsizei, const GLchar* message, const void*) {
+    SmileLogLevel level;
+    switch (severity) {
+        case KHR_DEBUG(GL_DEBUG_SEVERITY_HIGH): level = eSmileLogLevel_Error; break;
+        case KHR_DEBUG(GL_DEBUG_SEVERITY_MEDIUM): level = eSmileLogLevel_Warning; break;
+        case KHR_DEBUG(GL_DEBUG_SEVERITY_LOW): level = eSmileLogLevel_Info; break;
+        default: return; // notifications are mostly buffer placement chatter
+    }
+
+    if (KHR_DEBUG(GL_DEBUG_TYPE_ERROR) == type) {
+        level = eSmileLogLevel_Error;
+    }
+
+    smile::LogBase<511>(level).format( "OpenGL debug message %u (source 0x%x, type 0x%x): %s"
+                                     , id, source, type, message);
+}
+
+
+Rcode gl_utils::EnableGlDebugOutput() noexcept {
+#if defined(PLATFORM_ANDROID)
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    auto glDebugMessageCallbackKHR = reinterpret_cast<PFNGLDEBUGMESSAGECALLBACKKHRPROC>(
+            eglGetProcAddress("glDebugMessageCallbackKHR"));
+    if (!extensions || !std::strstr(extensions, "GL_KHR_debug") || !glDebugMessageCallbackKHR) {
+        SMILE_LOG(Warning) << "KHR_debug is not supported, OpenGL debug output is not enabled";
+        return RC(LogicError);
+    }
+
+    glDebugMessageCallbackKHR(&on_debug_message, nullptr);
+#else
+    if (!GLEW_KHR_debug) {
+        SMILE_LOG(Warning) << "KHR_debug is not supported, OpenGL debug output is not enabled";
+        return RC(LogicError);
+    }
+
+    glDebugMessageCallback(&on_debug_message, nullptr);
+#endif
+
+    // no GL_DEBUG_OUTPUT_SYNCHRONOUS: the messages come asynchronously
+    glEnable(KHR_DEBUG(GL_DEBUG_OUTPUT));
+    if (CheckGlErrors(__func__, "glEnable")) {
+        return RC(InternalError);
+    }
+
+#if defined(PLATFORM_ANDROID)
+    // GL_CONTEXT_FLAGS is GLES 3.2, older contexts would queue GL_INVALID_ENUM
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 3 || (3 == major && minor < 2)) {
+        return RC(Ok);
+    }
+#endif
+
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    if (0 == (flags & KHR_DEBUG(GL_CONTEXT_FLAG_DEBUG_BIT))) {
+        SMILE_LOG(Info) << "OpenGL debug output is enabled for a non-debug context";
+    }
+
+    return RC(Ok);
+}
@@ -0,0 +1,246 @@
+#include "glstate.hpp"
+
+
+using namespace gl_utils;
+
+
+namespace {
+
+// the cached value is unknown, the next call goes to the driver
+constexpr GLuint kUnknown = ~0u;
+
+constexpr u32 kMaxTextureUnits = 16;
+constexpr u32 kMaxVertexArrays = 8;
+
+
+struct vao_elements_t {
+    GLuint vao{kUnknown};
+    GLuint buffer{kUnknown};
+};
+
+struct gl_state_t {
+    GLuint program{kUnknown};
+    GLuint vao{kUnknown};
+    GLuint array_buffer{kUnknown};
+
+    vao_elements_t elements[kMaxVertexArrays];
+
+    GLenum active_unit{kUnknown};
+    GLuint textures[kMaxTextureUnits]; // GL_TEXTURE_2D ones
+
+    GLfloat clear_color[4];
+    bool clear_color_known{false};
+
+    GLuint blending{kUnknown};
+    GLenum blend_src{kUnknown};
+    GLenum blend_dst{kUnknown};
+
+    GlStateStats stats;
+
+    gl_state_t() noexcept {
+        for (GLuint& texture : textures) {
+            texture = kUnknown;
+        }
+    }
+};
+
+static gl_state_t sState;
+
+
+// returns true if the call has to be issued
+static bool update(GLuint& cached, GLuint value) noexcept {
+    if (kUnknown != cached && cached == value) {
+        ++sState.stats.elided;
+        return false;
+    }
+
+    cached = value;
+    ++sState.stats.issued;
+    return true;
+}
+
+
+static void pass() noexcept {
+    ++sState.stats.issued;
+}
+
+
+static GLuint* vao_elements(GLuint vao) noexcept {
+    if (kUnknown == vao) {
+        return nullptr;
+    }
+
+    vao_elements_t* free = nullptr;
+    for (vao_elements_t& e : sState.elements) {
+        if (vao == e.vao) {
+            return &e.buffer;
+        }
+        if (!free && kUnknown == e.vao) {
+            free = &e;
+        }
+    }
+
+    if (!free) {
+        return nullptr;
+    }
+
+    free->vao = vao;
+    free->buffer = kUnknown;
+    return &free->buffer;
+}
+
+}
+
+
+void gl_utils::ResetGlState() noexcept {
+    const GlStateStats stats = sState.stats;
+    sState = gl_state_t();
+    sState.stats = stats;
+}
+
+
+GlStateStats gl_utils::GetGlStateStats() noexcept {
+    return sState.stats;
+}
+
+
+void gl_utils::ResetGlStateStats() noexcept {
+    sState.stats = GlStateStats();
+}
+
+
+void gl_utils::UseProgram(GLuint program) noexcept {
+    if (update(sState.program, program)) {
+        glUseProgram(program);
+    }
+}
+
+
+void gl_utils::BindVertexArray(GLuint vao) noexcept {
+    if (update(sState.vao, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+
+void gl_utils::BindBuffer(GLenum target, GLuint buffer) noexcept {
+    GLuint* cached = nullptr;
+    if (GL_ARRAY_BUFFER == target) {
+        cached = &sState.array_buffer;
+    } else if (GL_ELEMENT_ARRAY_BUFFER == target) {
+        cached = vao_elements(sState.vao);
+    }
+
+    if (!cached) {
+        pass();
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (update(*cached, buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+
+void gl_utils::ActiveTexture(GLenum unit) noexcept {
+    if (update(sState.active_unit, unit)) {
+        glActiveTexture(unit);
+    }
+}
+
+
+void gl_utils::BindTexture(GLenum target, GLuint texture) noexcept {
+    const GLuint unit = sState.active_unit - GL_TEXTURE0;
+    if (GL_TEXTURE_2D != target || kUnknown == sState.active_unit || unit >= kMaxTextureUnits) {
+        pass();
+        glBindTexture(target, texture);
+        return;
+    }
+
+    if (update(sState.textures[unit], texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+
+void gl_utils::ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) noexcept {
+    GLfloat* cached = sState.clear_color;
+    if (sState.clear_color_known && cached[0] == r && cached[1] == g && cached[2] == b && cached[3] == a) {
+        ++sState.stats.elided;
+        return;
+    }
+
+    cached[0] = r; cached[1] = g; cached[2] = b; cached[3] = a;
+    sState.clear_color_known = true;
+
+    pass();
+    glClearColor(r, g, b, a);
+}
+
+
+void gl_utils::EnableBlending(bool enable) noexcept {
+    if (update(sState.blending, enable ? 1 : 0)) {
+        if (enable) {
+            glEnable(GL_BLEND);
+        } else {
+            glDisable(GL_BLEND);
+        }
+    }
+}
+
+
+void gl_utils::BlendFunc(GLenum sfactor, GLenum dfactor) noexcept {
+    if (sState.blend_src == sfactor && sState.blend_dst == dfactor) {
+        ++sState.stats.elided;
+        return;
+    }
+
+    sState.blend_src = sfactor;
+    sState.blend_dst = dfactor;
+
+    pass();
+    glBlendFunc(sfactor, dfactor);
+}
+
+
+void gl_utils::ForgetProgram(GLuint program) noexcept {
+    if (program == sState.program) {
+        sState.program = kUnknown;
+    }
+}
+
+
+void gl_utils::ForgetVertexArray(GLuint vao) noexcept {
+    if (vao == sState.vao) {
+        sState.vao = kUnknown;
+    }
+
+    for (vao_elements_t& e : sState.elements) {
+        if (vao == e.vao) {
+            e = vao_elements_t();
+        }
+    }
+}
+
+
+void gl_utils::ForgetBuffer(GLuint buffer) noexcept {
+    if (buffer == sState.array_buffer) {
+        sState.array_buffer = kUnknown;
+    }
+
+    for (vao_elements_t& e : sState.elements) {
+        if (buffer == e.buffer) {
+            e.buffer = kUnknown;
+        }
+    }
+}
+
+
+void gl_utils::ForgetTexture(GLuint texture) noexcept {
+    for (GLuint& cached : sState.textures) {
+        if (texture == cached) {
+            cached = kUnknown;
+        }
+    }
+}
@@ -0,0 +1,281 @@
+#include "gputimer.hpp"
+
+#if defined(PLATFORM_WINDOWS)
+#    include <Windows.h>
+#endif
+
+#if defined(PLATFORM_ANDROID)
+#   include <EGL/egl.h>
+#   include <GLES3/gl3.h>
+#   include <GLES2/gl2ext.h>
+#else
+#   include "GL/glew.h"
+#endif
+
+#include <cstring>
+
+#include "errors.hpp"
+
+#include "smile/log.hpp"
+
+
+// GLES has the timer queries through EXT_disjoint_timer_query only
+#if defined(PLATFORM_ANDROID)
+#   define TIMER_QUERY(Name) Name ## _EXT
+#else
+#   define TIMER_QUERY(Name) Name
+#endif
+
+
+using namespace gl_utils;
+
+
+namespace {
+
+#if defined(PLATFORM_ANDROID)
+using QueryCounterProc = PFNGLQUERYCOUNTEREXTPROC;
+using GetQueryObjectui64vProc = PFNGLGETQUERYOBJECTUI64VEXTPROC;
+#else
+using QueryCounterProc = PFNGLQUERYCOUNTERPROC;
+using GetQueryObjectui64vProc = PFNGLGETQUERYOBJECTUI64VPROC;
+#endif
+
+constexpr u32 kMaxScopes = SMILE_MAX_GPU_TIMINGS;
+
+// queries of a frame: its begin and end timestamps, then the scopes
+constexpr u32 kFrameBegin = 0;
+constexpr u32 kFrameEnd = 1;
+constexpr u32 kFirstScope = 2;
+constexpr u32 kQueriesPerFrame = kFirstScope + kMaxScopes;
+
+
+struct frame_queries_t {
+    GLuint ids[kQueriesPerFrame];
+    const char* names[kMaxScopes];
+    u32 nb_scopes{0};
+    u64 index{0};
+    bool pending{false}; // issued, not read back yet
+};
+
+struct gpu_timer_t {
+    bool ready{false};
+
+    QueryCounterProc queryCounter{nullptr};
+    GetQueryObjectui64vProc getQueryObjectui64v{nullptr};
+
+    frame_queries_t frames[kGpuTimerLatency];
+    u64 frame{0}; // index of the current one, from 1
+
+    bool in_frame{false};
+    bool in_scope{false};
+
+    FrameStats latest{};
+    u64 dropped{0};
+};
+
+static gpu_timer_t sTimer;
+
+
+static bool timer_queries_supported() noexcept {
+#if defined(PLATFORM_ANDROID)
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!extensions || !std::strstr(extensions, "GL_EXT_disjoint_timer_query")) {
+        return false;
+    }
+
+    sTimer.queryCounter = reinterpret_cast<QueryCounterProc>(
+            eglGetProcAddress("glQueryCounterEXT"));
+    sTimer.getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64vProc>(
+            eglGetProcAddress("glGetQueryObjectui64vEXT"));
+#else
+    if (!GLEW_ARB_timer_query) {
+        return false;
+    }
+
+    sTimer.queryCounter = glQueryCounter;
+    sTimer.getQueryObjectui64v = glGetQueryObjectui64v;
+#endif
+
+    return sTimer.queryCounter && sTimer.getQueryObjectui64v;
+}
+
+
+// Reads the results back if they are there, never waits for them.
+static void collect(frame_queries_t& frame) noexcept {
+    frame.pending = false;
+
+    // the queries complete in order, the frame end is the last one
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(frame.ids[kFrameEnd], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (GL_FALSE == available) {
+        ++sTimer.dropped;
+        return;
+    }
+
+#if defined(PLATFORM_ANDROID)
+    // the GPU changed its clock or was interrupted, the results are garbage
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (GL_FALSE != disjoint) {
+        ++sTimer.dropped;
+        return;
+    }
+#endif
+
+    GLuint64 begin = 0, end = 0;
+    sTimer.getQueryObjectui64v(frame.ids[kFrameBegin], TIMER_QUERY(GL_QUERY_RESULT), &begin);
+    sTimer.getQueryObjectui64v(frame.ids[kFrameEnd], TIMER_QUERY(GL_QUERY_RESULT), &end);
+
+    FrameStats& latest = sTimer.latest;
+    latest.gpu_frame_index = frame.index;
+    latest.gpu_frame = end > begin ? static_cast<f64>(end - begin)*1e-9 : 0.0;
+    latest.nb_gpu_timings = frame.nb_scopes;
+
+    for (u32 i = 0; i < frame.nb_scopes; ++i) {
+        GLuint64 elapsed = 0;
+        sTimer.getQueryObjectui64v(frame.ids[kFirstScope + i], TIMER_QUERY(GL_QUERY_RESULT), &elapsed);
+
+        latest.gpu_timings[i].name = frame.names[i];
+        latest.gpu_timings[i].time = static_cast<f64>(elapsed)*1e-9;
+    }
+}
+
+}
+
+
+Rcode gl_utils::SetUpGpuTimer() noexcept {
+    if (sTimer.ready) {
+        return RC(Already);
+    }
+
+    if (!timer_queries_supported()) {
+        SMILE_LOG(Warning) << "Timer queries are not supported, no GPU timings";
+        return RC(LogicError);
+    }
+
+    for (frame_queries_t& frame : sTimer.frames) {
+        glGenQueries(kQueriesPerFrame, frame.ids);
+        frame.nb_scopes = 0;
+        frame.pending = false;
+    }
+    if (CheckGlErrors(__func__, "glGenQueries")) {
+        TearDownGpuTimer();
+        return RC(InternalError);
+    }
+
+    sTimer.ready = true;
+    sTimer.frame = 0;
+    sTimer.in_frame = false;
+    sTimer.in_scope = false;
+    sTimer.latest = FrameStats{};
+    sTimer.dropped = 0;
+
+    return RC(Ok);
+}
+
+
+void gl_utils::TearDownGpuTimer(bool hasContext) noexcept {
+    for (frame_queries_t& frame : sTimer.frames) {
+        if (hasContext && frame.ids[0]) {
+            glDeleteQueries(kQueriesPerFrame, frame.ids);
+        }
+        std::memset(frame.ids, 0, sizeof(frame.ids));
+        frame.pending = false;
+    }
+
+    sTimer.ready = false;
+}
+
+
+void gl_utils::BeginGpuFrame() noexcept {
+    if (!sTimer.ready) {
+        return;
+    }
+
+    // the previous frame has been left early
+    if (sTimer.in_frame) {
+        EndGpuFrame();
+    }
+
+    // the slot is reused once the frame issued kGpuTimerLatency frames ago
+    // has been read back
+    frame_queries_t& frame = sTimer.frames[sTimer.frame % kGpuTimerLatency];
+    if (frame.pending) {
+        collect(frame);
+    }
+
+    frame.index = ++sTimer.frame;
+    frame.nb_scopes = 0;
+
+    sTimer.queryCounter(frame.ids[kFrameBegin], TIMER_QUERY(GL_TIMESTAMP));
+    sTimer.in_frame = true;
+}
+
+
+void gl_utils::EndGpuFrame() noexcept {
+    if (!sTimer.in_frame) {
+        return;
+    }
+
+    if (sTimer.in_scope) {
+        EndGpuScope();
+    }
+
+    frame_queries_t& frame = sTimer.frames[(sTimer.frame - 1) % kGpuTimerLatency];
+    sTimer.queryCounter(frame.ids[kFrameEnd], TIMER_QUERY(GL_TIMESTAMP));
+    frame.pending = true;
+
+    sTimer.in_frame = false;
+}
+
+
+void gl_utils::BeginGpuScope(const char* name) noexcept {
+    if (!sTimer.in_frame || sTimer.in_scope) {
+        return;
+    }
+
+    frame_queries_t& frame = sTimer.frames[(sTimer.frame - 1) % kGpuTimerLatency];
+    if (frame.nb_scopes == kMaxScopes) {
+        return;
+    }
+
+    frame.names[frame.nb_scopes] = name;
+    glBeginQuery(TIMER_QUERY(GL_TIME_ELAPSED), frame.ids[kFirstScope + frame.nb_scopes]);
+    sTimer.in_scope = true;
+}
+
+
+void gl_utils::EndGpuScope() noexcept {
+    if (!sTimer.in_scope) {
+        return;
+    }
+
+    frame_queries_t& frame = sTimer.frames[(sTimer.frame - 1) % kGpuTimerLatency];
+    glEndQuery(TIMER_QUERY(GL_TIME_ELAPSED));
+    ++frame.nb_scopes;
+
+    sTimer.in_scope = false;
+}
+
+
+Rcode gl_utils::GetGpuTimings(FrameStats* stats) noexcept {
+    if (!stats) {
+        return RC(InvalidInput);
+    }
+
+    if (0 == sTimer.latest.gpu_frame_index) {
+        return RC(NotInitialized);
+    }
+
+    stats->gpu_frame_index = sTimer.latest.gpu_frame_index;
+    stats->gpu_frame = sTimer.latest.gpu_frame;
+    stats->nb_gpu_timings = sTimer.latest.nb_gpu_timings;
+    std::memcpy(stats->gpu_timings, sTimer.latest.gpu_timings, sizeof(stats->gpu_timings));
+
+    return RC(Ok);
+}
+
+
+u64 gl_utils::GetGpuTimerDropped() noexcept {
+    return sTimer.dropped;
+}
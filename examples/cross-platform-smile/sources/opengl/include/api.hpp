@@ -16,23 +16,75 @@
 #include "smile/log.hpp"
 #include "smile/smile.h"
 
+#include "errors.hpp"
+
+
+// OpenGL error checking level, chosen at compile time:
+// - OFF:   CALL_GL is the bare call;
+// - FRAME: CALL_GL is the bare call, the errors are fetched once a frame by
+//          CheckGlFrameErrors, so only the frame they happened in is known;
+// - CALL:  glGetError after every CALL_GL, which stalls the pipeline.
+// Defaults to CALL in debug builds and to FRAME in release ones.
+#define SMILE_GL_CHECKS_OFF   0
+#define SMILE_GL_CHECKS_FRAME 1
+#define SMILE_GL_CHECKS_CALL  2
+
+#if !defined(SMILE_GL_CHECKS)
+#   if defined(NDEBUG)
+#       define SMILE_GL_CHECKS SMILE_GL_CHECKS_FRAME
+#   else
+#       define SMILE_GL_CHECKS SMILE_GL_CHECKS_CALL
+#   endif
+#endif
+
 
-#define CALL_GL(ReturnCode, Func, ...) \
-    do { \
-        Func(__VA_ARGS__); \
-        std::stringstream ss; \
-        if (gl_utils::dump_gl_errors(ss)) { \
-            SMILE_LOG(Error).format( "%s, OpenGL error %s in %s\n" \
-                                   , __func__, ss.str().c_str(), #Func); \
-            return ReturnCode; \
-        }\
-    } while(0)
+#if SMILE_GL_CHECKS >= SMILE_GL_CHECKS_CALL
+#   define CALL_GL(ReturnCode, Func, ...) \
+        do { \
+            Func(__VA_ARGS__); \
+            if (gl_utils::CheckGlErrors(__func__, #Func)) { \
+                return ReturnCode; \
+            } \
+        } while(0)
+#else
+#   define CALL_GL(ReturnCode, Func, ...) \
+        Func(__VA_ARGS__)
+#endif
 
 
 #define CALL_GL_VOID(Func, ...) \
     CALL_GL(, Func, __VA_ARGS__)
 
 
+namespace gl_utils {
+
+// CheckGlErrors at the CALL level, for the calls whose result is checked
+// as well; at the other levels the errors are left to the frame check.
+inline bool CheckGlCallErrors(const char* where, const char* what) noexcept {
+#if SMILE_GL_CHECKS >= SMILE_GL_CHECKS_CALL
+    return CheckGlErrors(where, what);
+#else
+    return false;
+#endif
+}
+
+}
+
+
+// Instance buffers are rewritten every frame, so they hold kStreamRegions
+// regions of 'size' bytes each: the next frame writes the next region while
+// the GPU may still read the previous ones. A region is reused only after
+// the fence put behind its draws is signaled.
+constexpr u32 kStreamRegions = 3;
+
+enum class StreamMode {
+    None        // not streamed, written through the contents
+,   Persistent  // mapped once, coherently (ARB_buffer_storage)
+,   Mapped      // every region is mapped unsynchronized and flushed explicitly
+,   Copied      // written through the contents, copied with glBufferSubData
+};
+
+
 struct ShaderBuffer {
     GLuint index;
     BufferType type;
@@ -40,6 +92,13 @@ struct ShaderBuffer {
     GLenum target;
     GLenum usage;
     u32 size;
+
+    StreamMode stream{StreamMode::None};
+    byte* mapped{nullptr};  // the whole storage if mapped persistently
+    byte* current{nullptr}; // the region handed out, not committed yet
+    u32 region{0};
+    u32 committed{0};       // offset of the last committed region
+    GLsync fences[kStreamRegions]{};
 };
 
 
@@ -57,9 +116,19 @@ struct FrameEncoder {
 namespace gl_utils {
 
 
+// sets the graphics functions and GetGpuTimings (of the GPU timer)
 void SetGraphicsApi(PlatformApi& api) noexcept;
 
 
+// Logs the errors of the frame at the FRAME and CALL checking levels, should
+// be called once the frame is encoded.
+inline void CheckGlFrameErrors() noexcept {
+#if SMILE_GL_CHECKS >= SMILE_GL_CHECKS_FRAME
+    CheckGlErrors("frame", "the frame calls");
+#endif
+}
+
+
 }
 
 #define OPENGL_API_HPP_
@@ -12,6 +12,8 @@
 #   include <GL/gl.h>
 #endif
 
+#include "smile/smile.h"
+
 
 namespace gl_utils {
 
@@ -19,6 +21,16 @@ namespace gl_utils {
 const char* to_string(GLenum err) noexcept;
 
 
+// Logs the pending OpenGL errors as raised by 'what' called in 'where',
+// returns true if there were any.
+bool CheckGlErrors(const char* where, const char* what) noexcept;
+
+// Installs the KHR_debug message callback, so the driver reports errors and
+// warnings as they happen (possibly from its own threads) with no glGetError
+// round trips. The messages are reliable only for a debug context.
+Rcode EnableGlDebugOutput() noexcept;
+
+
 template < class OStream >
 bool dump_gl_errors(OStream& os) noexcept {
     GLenum err = glGetError();
@@ -0,0 +1,60 @@
+#ifndef OPENGL_GLSTATE_HPP_
+
+#if defined(PLATFORM_WINDOWS)
+#   include <Windows.h>
+#endif
+
+#if defined(PLATFORM_ANDROID)
+#   include <GLES3/gl3.h>
+#else
+#   include "GL/glew.h"
+#endif
+
+#include "smile/smile.h"
+
+
+namespace gl_utils {
+
+
+// Shadow of the OpenGL state which is set every frame: the calls below reach
+// the driver only if they change the state. Everything is tracked for the
+// only context current on the calling (rendering) thread, so the cache must
+// be reset whenever the context is (re)created or touched bypassing it.
+
+struct GlStateStats {
+    u32 issued{0}; // calls passed to the driver
+    u32 elided{0}; // calls skipped as not changing the state
+};
+
+
+void ResetGlState() noexcept;
+
+GlStateStats GetGlStateStats() noexcept;
+void ResetGlStateStats() noexcept;
+
+void UseProgram(GLuint program) noexcept;
+void BindVertexArray(GLuint vao) noexcept;
+
+// the element array buffer binding is tracked per vertex array
+void BindBuffer(GLenum target, GLuint buffer) noexcept;
+
+void ActiveTexture(GLenum unit) noexcept;
+void BindTexture(GLenum target, GLuint texture) noexcept;
+
+void ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) noexcept;
+
+void EnableBlending(bool enable) noexcept;
+void BlendFunc(GLenum sfactor, GLenum dfactor) noexcept;
+
+// deleted objects are unbound by OpenGL, these forget them in the cache too
+void ForgetProgram(GLuint program) noexcept;
+void ForgetVertexArray(GLuint vao) noexcept;
+void ForgetBuffer(GLuint buffer) noexcept;
+void ForgetTexture(GLuint texture) noexcept;
+
+
+}
+
+
+#define OPENGL_GLSTATE_HPP_
+#endif
@@ -0,0 +1,52 @@
+#ifndef OPENGL_GPUTIMER_HPP_
+
+#include "smile/smile.h"
+
+
+namespace gl_utils {
+
+
+// GPU time of the frames and of their named scopes, measured with timer
+// queries (GL_TIMESTAMP for the frame, GL_TIME_ELAPSED for the scopes;
+// EXT_disjoint_timer_query on GLES). The queries of a frame are read back
+// kGpuTimerLatency frames later, and only if their results are available,
+// so reading never stalls the pipeline; late results are dropped instead.
+// Like the state cache, the timer is of the context current on the calling
+// (rendering) thread.
+
+constexpr u32 kGpuTimerLatency = 3; // frames
+
+// LogicError if the timer queries are not supported.
+Rcode SetUpGpuTimer() noexcept;
+// Deletes the queries, with no context (lost) just forgets them.
+void TearDownGpuTimer(bool hasContext = true) noexcept;
+
+void BeginGpuFrame() noexcept;
+void EndGpuFrame() noexcept;
+
+// The scopes of a frame do not nest, at most SMILE_MAX_GPU_TIMINGS of them.
+// The name must outlive the timer (a literal).
+void BeginGpuScope(const char* name) noexcept;
+void EndGpuScope() noexcept;
+
+struct GpuScope {
+    explicit GpuScope(const char* name) noexcept { BeginGpuScope(name); }
+   ~GpuScope() noexcept { EndGpuScope(); }
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator = (const GpuScope&) = delete;
+};
+
+// PlatformApi::GetGpuTimings: the latest complete frame, NotInitialized if
+// there is none yet.
+Rcode GetGpuTimings(FrameStats* stats) noexcept;
+
+// frames which results were not ready in time or were disjoint
+u64 GetGpuTimerDropped() noexcept;
+
+
+}
+
+
+#define OPENGL_GPUTIMER_HPP_
+#endif
@@ -1,5 +1,6 @@
 #ifndef OPENGL_SHADER_HPP_
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -8,10 +9,19 @@
 
 #include "smile/smile.h"
 
+#include "uniforms.hpp"
+
 
 namespace gl_utils {
 
 
+enum class ShaderState {
+    Invalid, // not reloaded or failed to build
+    Pending, // compiling and linking in the driver
+    Ready
+};
+
+
 class Shader {
 public:
     Shader(const std::string& vshader_code, const std::string& pshader_code) noexcept;
@@ -19,22 +29,78 @@ public:
 
     bool valid() const noexcept;
 
-    Rcode reload() noexcept;
+    // With the cache functions of the api (LoadCachedAsset, StoreCachedAsset
+    // and FreeAsset) the linked program binary is cached, keyed by the
+    // sources and the driver; sources are built if the binary is missing or
+    // rejected.
+    Rcode reload(const PlatformApi* cache = nullptr) noexcept;
+
+    // Same as reload, but returns as soon as the sources are handed to the
+    // driver, poll() tells when the program is ready. With
+    // KHR_parallel_shader_compile the driver builds on its own threads and
+    // poll() never blocks, otherwise the first poll() waits for the build.
+    Rcode reloadAsync(const PlatformApi* cache = nullptr) noexcept;
+    ShaderState poll() noexcept;
+    ShaderState state() const noexcept { return _state; }
+
     Rcode use() const noexcept;
 
+    // of the last reload, until the program is ready
+    f64 reloadTime() const noexcept { return _reload_time; } // sec
+    bool reloadedFromCache() const noexcept { return _from_cache; }
+
+    // Resolves the location of the uniform once, the handle sets the value
+    // with no lookups. Handles are valid until the next reload.
+    template < class T >
+    Uniform<T> uniform(UniformName name) noexcept { return Uniform<T>{getUniformLocation(name)}; }
+
+    Rcode setUniform(Uniform<glm::mat2> handle, const glm::mat2& mat) noexcept;
+    Rcode setUniform(Uniform<GLint> handle, GLint value) noexcept;
+
+    // looks the location up by the hash of the name, handles are cheaper;
+    // InvalidInput if the name is longer than 255 characters
     Rcode setUniform(std::string_view name, const glm::mat2& mat) noexcept;
 
+    // Attaches the uniform block of the program to the binding point of a
+    // UniformBuffer; InvalidInput if there is no such block.
+    Rcode bindUniformBlock(UniformName block, GLuint binding) noexcept;
+
 private:
-    static Rcode compile(u32 shader_id) noexcept;
+    static u32 create(GLenum type, const char* const* codes) noexcept;
+    static void dumpCompileLog(u32 shader_id, const char* what) noexcept;
+
+    void release() noexcept;
+
+    Rcode submit(bool retrievable) noexcept;
+    Rcode finish() noexcept;
 
-    u32 getUniformLocation(std::string_view name) noexcept;
+    Rcode loadBinary(const PlatformApi& cache, u64 key) noexcept;
+    Rcode storeBinary(const PlatformApi& cache, u64 key) const noexcept;
+
+    GLint getUniformLocation(UniformName name) noexcept;
 
     std::string _vcode, _pcode;
     std::unique_ptr<const char*[]> _vcodes, _pcodes;
 
-    std::unordered_map<std::string_view, u32> _locations;
+    // the name tells apart the uniforms of the same UniformId
+    struct CachedLocation {
+        std::string name;
+        GLint location;
+    };
+
+    std::unordered_map<u32, CachedLocation> _locations; // by UniformId
 
     u32 _program_id;
+    u32 _vshader_id, _pshader_id; // while pending
+
+    ShaderState _state;
+    bool _parallel;
+    const PlatformApi* _cache; // to store the binary once linked
+    u64 _key;
+
+    std::chrono::steady_clock::time_point _reload_start;
+    f64 _reload_time;
+    bool _from_cache;
 };
 
 
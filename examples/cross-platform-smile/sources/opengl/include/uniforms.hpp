@@ -0,0 +1,126 @@
+#ifndef OPENGL_UNIFORMS_HPP_
+
+#include <memory>
+#include <string_view>
+
+#if defined(PLATFORM_WINDOWS)
+#   include <Windows.h>
+#endif
+
+#if defined(PLATFORM_ANDROID)
+#   include <GLES3/gl3.h>
+#else
+#   include "GL/glew.h"
+#endif
+
+#include "glm/matrix.hpp"
+
+#include "smile/smile.h"
+
+
+namespace gl_utils {
+
+
+// FNV-1a of a uniform name, folded at compile time for literals.
+constexpr u32 UniformId(std::string_view name) noexcept {
+    u32 hash = 0x811c9dc5u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<byte>(c)) * 0x01000193u;
+    }
+    return hash;
+}
+
+
+// A uniform name along with its id, implicitly made of a string literal:
+//     shader.uniform<glm::mat2>("view")
+struct UniformName {
+    u32 id;
+    const char* name; // zero terminated
+
+    template < std::size_t N >
+    constexpr UniformName(const char (&literal)[N]) noexcept
+        : id(UniformId(std::string_view(literal, N - 1))), name(literal) {}
+
+    constexpr UniformName(u32 id, const char* name) noexcept : id(id), name(name) {}
+};
+
+
+// Location of a uniform of the type T resolved once, valid until the program
+// is reloaded. Setting a value through a handle of a missing uniform (say,
+// optimized out) is a no-op, as OpenGL ignores the location -1.
+template < class T >
+struct Uniform {
+    GLint location{-1};
+
+    bool valid() const noexcept { return location >= 0; }
+};
+
+
+// std140 layout of a mat2: the columns are padded to vec4.
+struct Std140Mat2 {
+    f32 columns[2][4];
+
+    Std140Mat2() noexcept = default;
+    explicit Std140Mat2(const glm::mat2& m) noexcept
+        : columns{ {m[0][0], m[0][1], 0.0f, 0.0f}
+                 , {m[1][0], m[1][1], 0.0f, 0.0f} } {}
+};
+
+
+// The std140 Frame uniform block of the 2D vertex shader on every platform
+// (desktop/shaders/vshader-2d.glsl, android shaders.glsl.h), which must
+// match it byte for byte, and the binding point it is attached to.
+struct FrameBlock {
+    Std140Mat2 view;
+};
+
+static_assert(sizeof(FrameBlock) == 32, "FrameBlock is uploaded as the std140 block");
+
+constexpr char kFrameBlockName[] = "Frame";
+constexpr GLuint kFrameBlockBinding = 0;
+
+
+// Uniform block shared by the programs bound to the same binding point
+// (Shader::bindUniformBlock): the constants of a frame are uploaded once for
+// all the programs. The upload is skipped if the contents do not change.
+class UniformBuffer {
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator = (const UniformBuffer&) = delete;
+
+public:
+    UniformBuffer() noexcept;
+   ~UniformBuffer() noexcept;
+
+    // size of the block in bytes, std140 layout
+    Rcode setUp(GLuint binding, u32 size) noexcept;
+    void release() noexcept;
+
+    bool valid() const noexcept { return 0 != _buffer_id; }
+    GLuint binding() const noexcept { return _binding; }
+
+    Rcode update(const void* data, u32 size) noexcept;
+
+    template < class Block >
+    Rcode update(const Block& block) noexcept { return update(&block, sizeof(block)); }
+
+    // of the updates since the set up
+    u32 uploads() const noexcept { return _uploads; }
+    u32 skipped() const noexcept { return _skipped; }
+
+private:
+    GLuint _buffer_id;
+    GLuint _binding;
+    u32 _size;
+
+    std::unique_ptr<byte[]> _last; // last uploaded contents
+    bool _last_known;
+
+    u32 _uploads, _skipped;
+};
+
+
+}
+
+
+#define OPENGL_UNIFORMS_HPP_
+#endif
@@ -1,6 +1,11 @@
 #include "shader.hpp"
 
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
 #include <limits>
+#include <new>
 
 #if defined(PLATFORM_WINDOWS)
 #    include <Windows.h>
@@ -9,33 +14,137 @@
 
 #if defined(PLATFORM_ANDROID)
 #   include <EGL/egl.h>
+#   include <GLES3/gl32.h>
+#   include <GLES2/gl2ext.h>
 #else
 #   include "GL/glew.h"
 #endif
 
 #include "glm/gtc/type_ptr.hpp"
 
+#include "api.hpp"
 #include "errors.hpp"
+#include "glstate.hpp"
 
 #include "smile/log.hpp"
 
 
-#define CALL_GL(Func, ...) \
-    do { \
-        Func(__VA_ARGS__); \
-        if (dump_gl_errors(SMILE_LOG(Error))) \
-            return eRcode_InternalError; \
-    } while(0)
-
 static constexpr u32 kInvalidId = std::numeric_limits<u32>::max();
 
 using namespace gl_utils;
 
 
+namespace {
+
+constexpr u32 kProgramBlobMagic = 0x42504D53; // 'SMPB'
+constexpr u32 kProgramBlobVersion = 1;
+
+constexpr u32 kMaxProgramBlobName = 64;
+
+// with the terminating zero
+constexpr u32 kMaxUniformName = 256;
+
+// Cached program binary: this header followed by 'size' bytes of the
+// binary in the driver's 'format'.
+struct ProgramBlobHeader {
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 format;
+    u32 size;
+};
+
+static_assert(sizeof(ProgramBlobHeader) == 24, "ProgramBlobHeader is stored as is");
+
+
+constexpr u64 kFnvOffsetBasis = 0xcbf29ce484222325ull;
+constexpr u64 kFnvPrime = 0x100000001b3ull;
+
+// FNV-1a, the size is mixed in so concatenations never collide
+static u64 hash_string(u64 hash, const char* str, std::size_t size) noexcept {
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<byte>(str[i])) * kFnvPrime;
+    }
+
+    return (hash ^ size) * kFnvPrime;
+}
+
+
+static u64 hash_string(u64 hash, const GLubyte* str) noexcept {
+    const char* s = str ? reinterpret_cast<const char*>(str) : "";
+    return hash_string(hash, s, std::strlen(s));
+}
+
+
+// A binary is valid for the same sources and the same driver only.
+static u64 program_key(const std::string& vcode, const std::string& pcode) noexcept {
+    u64 key = kFnvOffsetBasis;
+    key = hash_string(key, vcode.data(), vcode.size());
+    key = hash_string(key, pcode.data(), pcode.size());
+    key = hash_string(key, glGetString(GL_RENDERER));
+    key = hash_string(key, glGetString(GL_VERSION));
+
+    return key;
+}
+
+
+static bool program_binaries_supported() noexcept {
+#if !defined(PLATFORM_ANDROID)
+    if (!GLEW_ARB_get_program_binary) {
+        return false;
+    }
+#endif
+
+    GLint nbFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats);
+
+    return nbFormats > 0;
+}
+
+
+static void blob_name(char (&name)[kMaxProgramBlobName], u64 key) noexcept {
+    snprintf(name, sizeof(name), "shaders/program-%016" PRIx64 ".bin", key);
+}
+
+
+// Lets the driver compile and link on its own threads, so the status queries
+// can be polled with GL_COMPLETION_STATUS_KHR instead of blocking.
+static bool parallel_compile_supported() noexcept {
+#if defined(PLATFORM_ANDROID)
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!extensions || !std::strstr(extensions, "GL_KHR_parallel_shader_compile")) {
+        return false;
+    }
+
+    auto glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            eglGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    if (!glMaxShaderCompilerThreadsKHR) {
+        return false;
+    }
+
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver likes
+#else
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver likes
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    } else {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+}
+
+
 Shader::Shader(const std::string& vshader_code, const std::string& pshader_code) noexcept
     : _vcode(vshader_code), _pcode(pshader_code)
     , _vcodes(std::make_unique<const char*[]>(1)), _pcodes(std::make_unique<const char*[]>(1))
-    , _program_id(kInvalidId)
+    , _program_id(kInvalidId), _vshader_id(0), _pshader_id(0)
+    , _state(ShaderState::Invalid), _parallel(false), _cache(nullptr), _key(0)
+    , _reload_time(0.0), _from_cache(false)
 {
     _vcodes[0] = _vcode.c_str();
     _pcodes[0] = _pcode.c_str();
@@ -43,121 +152,374 @@ Shader::Shader(const std::string& vshader_code, const std::string& pshader_code)
 
 
 Shader::~Shader() noexcept {
+    release();
+}
+
+
+bool Shader::valid() const noexcept { return _program_id != kInvalidId; }
+
+
+void Shader::release() noexcept {
+    if (_vshader_id) {
+        glDeleteShader(_vshader_id);
+        _vshader_id = 0;
+    }
+    if (_pshader_id) {
+        glDeleteShader(_pshader_id);
+        _pshader_id = 0;
+    }
+
     if (valid()) {
         glDeleteProgram(_program_id);
+        ForgetProgram(_program_id);
+        _program_id = kInvalidId;
     }
+
+    // the locations are of the released program
+    _locations.clear();
+    _state = ShaderState::Invalid;
 }
 
 
-bool Shader::valid() const noexcept { return _program_id != kInvalidId; }
+Rcode Shader::reload(const PlatformApi* cache) noexcept {
+    Rcode rc = reloadAsync(cache);
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
 
+    return ShaderState::Pending == _state ? finish() : eRcode_Ok;
+}
 
-Rcode Shader::reload() noexcept {
-    SMILE_LOG(Debug) << "Create vertex shader";
-    GLuint vshader_id = glCreateShader(GL_VERTEX_SHADER);
-    if (!vshader_id) {
-        dump_gl_errors(SMILE_LOG(Error));
-        return eRcode_InternalError;
+
+Rcode Shader::reloadAsync(const PlatformApi* cache) noexcept {
+    release();
+
+    _reload_start = std::chrono::steady_clock::now();
+
+    const bool cacheable = cache && cache->LoadCachedAsset && cache->StoreCachedAsset
+                        && cache->FreeAsset && program_binaries_supported();
+
+    _cache = cacheable ? cache : nullptr;
+    _key = cacheable ? program_key(_vcode, _pcode) : 0;
+    _parallel = false;
+
+    _from_cache = cacheable && eRcode_Ok == loadBinary(*cache, _key);
+    if (_from_cache) {
+        _state = ShaderState::Pending;
+        return finish();
     }
 
-    SMILE_LOG(Debug) << "Set shader source";
-    CALL_GL(glShaderSource, vshader_id, 1, _vcodes.get(), nullptr);
+    _parallel = parallel_compile_supported();
 
-    Rcode rc;
-    SMILE_LOG(Debug) << "Compile vertex shader";
-    rc = compile(vshader_id);
-    if (eRcode_Ok != rc)
+    Rcode rc = submit(cacheable);
+    if (eRcode_Ok != rc) {
+        release();
+        return rc;
+    }
+
+    _state = ShaderState::Pending;
+
+    return eRcode_Ok;
+}
+
+
+ShaderState Shader::poll() noexcept {
+    if (ShaderState::Pending != _state) {
+        return _state;
+    }
+
+    if (_parallel) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(_program_id, GL_COMPLETION_STATUS_KHR, &completed);
+        if (GL_FALSE == completed) {
+            return _state;
+        }
+    }
+
+    finish();
+
+    return _state;
+}
+
+
+Rcode Shader::finish() noexcept {
+    if (!_from_cache) {
+        GLint link_status = GL_FALSE;
+        glGetProgramiv(_program_id, GL_LINK_STATUS, &link_status);
+        if (GL_FALSE == link_status) {
+            // a failed compile shows up as a failed link, so the compile
+            // status is only looked at to explain it
+            dumpCompileLog(_vshader_id, "Vertex");
+            dumpCompileLog(_pshader_id, "Fragment");
+
+            GLchar message[1024];
+            glGetProgramInfoLog(_program_id, sizeof(message), 0, &message[0]);
+            SMILE_LOG(Error) << "Program Link Error:\n" << message << "\n";
+
+            release();
+            return eRcode_InternalError;
+        }
+
+        glDeleteShader(_vshader_id);
+        glDeleteShader(_pshader_id);
+        _vshader_id = 0;
+        _pshader_id = 0;
+
+        if (_cache) {
+            Rcode rc = storeBinary(*_cache, _key);
+            if (eRcode_Ok != rc) {
+                SMILE_LOG(Warning) << "Failed to cache the program binary: " << smile_ToString(rc);
+            }
+        }
+    }
+
+    _state = ShaderState::Ready;
+
+    _reload_time = std::chrono::duration<f64>(std::chrono::steady_clock::now() - _reload_start).count();
+    SMILE_LOG(Info) << "Shader program " << (_from_cache ? "loaded from the binary cache" : "built from source")
+                    << " in " << _reload_time*1000.0 << " ms";
+
+    return eRcode_Ok;
+}
+
+
+Rcode Shader::loadBinary(const PlatformApi& cache, u64 key) noexcept {
+    char name[kMaxProgramBlobName];
+    blob_name(name, key);
+
+    AssetData blob{nullptr, 0};
+    if (eRcode_Ok != cache.LoadCachedAsset(&blob, name)) {
+        return eRcode_InvalidInput;
+    }
+
+    ProgramBlobHeader header;
+    bool intact = blob.data && blob.size >= sizeof(header);
+    if (intact) {
+        std::memcpy(&header, blob.data, sizeof(header));
+        intact = kProgramBlobMagic == header.magic && kProgramBlobVersion == header.version
+              && key == header.key && header.size == blob.size - sizeof(header);
+    }
+    if (!intact) {
+        cache.FreeAsset(&blob);
+        return eRcode_InvalidInput;
+    }
+
+    GLuint program_id = glCreateProgram();
+    if (!program_id) {
+        cache.FreeAsset(&blob);
+        CheckGlCallErrors(__func__, "glCreateProgram");
         return eRcode_InternalError;
+    }
+
+    // the errors left by earlier calls are logged, not taken for the binary's
+    CheckGlErrors(__func__, "an earlier call");
+
+    glProgramBinary(program_id, header.format, blob.data + sizeof(header), header.size);
+    cache.FreeAsset(&blob);
 
-    SMILE_LOG(Debug) << "Create fragment shader";
-    GLuint pshader_id = glCreateShader(GL_FRAGMENT_SHADER);
-    if (!pshader_id) {
-        dump_gl_errors(SMILE_LOG(Error));
+    // drivers reject binaries of their other versions (with GL_INVALID_ENUM
+    // for an unknown format or a failed link), that's not an error
+    const GLenum err = glGetError();
+    GLint link_status = GL_FALSE;
+    if (GL_NO_ERROR == err) {
+        glGetProgramiv(program_id, GL_LINK_STATUS, &link_status);
+    }
+    if (GL_FALSE == link_status) {
+        SMILE_LOG(Info) << "Program binary is rejected by the driver ("
+                        << (GL_NO_ERROR == err ? "not linked" : to_string(err))
+                        << "), build from source";
+        glDeleteProgram(program_id);
+        return eRcode_InvalidInput;
+    }
+
+    _program_id = program_id;
+
+    return eRcode_Ok;
+}
+
+
+Rcode Shader::storeBinary(const PlatformApi& cache, u64 key) const noexcept {
+    GLint size = 0;
+    CALL_GL(eRcode_InternalError, glGetProgramiv,
+            _program_id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) {
         return eRcode_InternalError;
     }
 
-    SMILE_LOG(Debug) << "Set shader source";
-    CALL_GL(glShaderSource, pshader_id, 1, _pcodes.get(), nullptr);
+    std::unique_ptr<byte[]> binary;
+    try {
+        binary = std::make_unique<byte[]>(size);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
+
+    ProgramBlobHeader header;
+    header.magic = kProgramBlobMagic;
+    header.version = kProgramBlobVersion;
+    header.key = key;
+
+    GLsizei length = 0;
+    GLenum format = 0;
+    CALL_GL(eRcode_InternalError, glGetProgramBinary,
+            _program_id, size, &length, &format, binary.get());
+
+    header.format = format;
+    header.size = static_cast<u32>(length);
+
+    const AssetData chunks[] = {
+        { reinterpret_cast<byte*>(&header), static_cast<u32>(sizeof(header)) },
+        { binary.get(), header.size },
+    };
+
+    char name[kMaxProgramBlobName];
+    blob_name(name, key);
+
+    return cache.StoreCachedAsset(name, chunks, sizeof(chunks)/sizeof(chunks[0]));
+}
+
+
+Rcode Shader::submit(bool retrievable) noexcept {
+    // no status queries until the link is done, each of them would wait for
+    // the driver to finish the compile
+    SMILE_LOG(Debug) << "Compile vertex shader";
+    _vshader_id = create(GL_VERTEX_SHADER, _vcodes.get());
+    if (!_vshader_id) {
+        return eRcode_InternalError;
+    }
 
     SMILE_LOG(Debug) << "Compile fragment shader";
-    rc = compile(pshader_id);
-    if (eRcode_Ok != rc)
+    _pshader_id = create(GL_FRAGMENT_SHADER, _pcodes.get());
+    if (!_pshader_id) {
         return eRcode_InternalError;
+    }
 
     SMILE_LOG(Debug) << "Create program";
     u32 program_id = glCreateProgram();
     if (!program_id) {
-        dump_gl_errors(SMILE_LOG(Error));
+        CheckGlCallErrors(__func__, "glCreateProgram");
         return eRcode_InternalError;
     }
+    _program_id = program_id;
 
-    CALL_GL(glAttachShader, program_id, vshader_id);
-    CALL_GL(glAttachShader, program_id, pshader_id);
-
-    SMILE_LOG(Debug) << "Link program";
-    CALL_GL(glLinkProgram, program_id);
+    CALL_GL(eRcode_InternalError, glAttachShader, program_id, _vshader_id);
+    CALL_GL(eRcode_InternalError, glAttachShader, program_id, _pshader_id);
 
-    GLint compile_status;
-    CALL_GL(glGetProgramiv, program_id, GL_LINK_STATUS, &compile_status);
-    if (GL_FALSE == compile_status) {
-        GLchar message[1024];
-        glGetProgramInfoLog(program_id, sizeof(message), 0, &message[0]);
-        SMILE_LOG(Error) << "Program Link Error:\n" << message << "\n";
-        return eRcode_InternalError;
+    if (retrievable) {
+        CALL_GL(eRcode_InternalError, glProgramParameteri,
+                program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
 
-    glDeleteShader(vshader_id);
-    glDeleteShader(pshader_id);
-
-    _program_id = program_id;
+    SMILE_LOG(Debug) << "Link program";
+    CALL_GL(eRcode_InternalError, glLinkProgram, program_id);
 
     return eRcode_Ok;
 }
 
 
 Rcode Shader::use() const noexcept {
-    if (!valid())
+    if (ShaderState::Ready != _state)
         return eRcode_NotInitialized;
 
-    CALL_GL(glUseProgram, _program_id);
+    CALL_GL(eRcode_InternalError, UseProgram, _program_id);
+    return eRcode_Ok;
+}
+
+
+Rcode Shader::setUniform(Uniform<glm::mat2> handle, const glm::mat2& mat) noexcept {
+    CALL_GL(eRcode_InternalError, glUniformMatrix2fv,
+            handle.location, 1, GL_FALSE, glm::value_ptr(mat));
+    return eRcode_Ok;
+}
+
+
+Rcode Shader::setUniform(Uniform<GLint> handle, GLint value) noexcept {
+    CALL_GL(eRcode_InternalError, glUniform1i, handle.location, value);
     return eRcode_Ok;
 }
 
 
 Rcode Shader::setUniform(std::string_view name, const glm::mat2& mat) noexcept {
-    u32 loc = getUniformLocation(std::move(name));
-    CALL_GL(glUniformMatrix2fv, loc, 1, GL_FALSE, glm::value_ptr(mat));
+    // the view is not zero terminated, unlike the name OpenGL takes
+    char zname[kMaxUniformName];
+    if (name.size() >= sizeof(zname)) {
+        SMILE_LOG(Error) << "Uniform name " << name << " is too long";
+        return eRcode_InvalidInput;
+    }
+    std::memcpy(zname, name.data(), name.size());
+    zname[name.size()] = '\0';
+
+    return setUniform(uniform<glm::mat2>(UniformName(UniformId(name), zname)), mat);
+}
+
+
+Rcode Shader::bindUniformBlock(UniformName block, GLuint binding) noexcept {
+    if (ShaderState::Ready != _state)
+        return eRcode_NotInitialized;
+
+    GLuint index = glGetUniformBlockIndex(_program_id, block.name);
+    if (GL_INVALID_INDEX == index) {
+        SMILE_LOG(Error) << "No uniform block " << block.name << " in the program";
+        return eRcode_InvalidInput;
+    }
+
+    CALL_GL(eRcode_InternalError, glUniformBlockBinding, _program_id, index, binding);
     return eRcode_Ok;
 }
 
 
 /*static*/
-Rcode Shader::compile(u32 shader_id) noexcept {
+u32 Shader::create(GLenum type, const char* const* codes) noexcept {
+    GLuint shader_id = glCreateShader(type);
+    if (!shader_id) {
+        CheckGlCallErrors(__func__, "glCreateShader");
+        return 0;
+    }
+
+    glShaderSource(shader_id, 1, codes, nullptr);
     glCompileShader(shader_id);
+    if (CheckGlCallErrors(__func__, "glCompileShader")) {
+        glDeleteShader(shader_id);
+        return 0;
+    }
+
+    return shader_id;
+}
+
 
-    GLint compile_status;
-    CALL_GL(glGetShaderiv, shader_id, GL_COMPILE_STATUS, &compile_status);
+/*static*/
+void Shader::dumpCompileLog(u32 shader_id, const char* what) noexcept {
+    GLint compile_status = GL_FALSE;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compile_status);
     if (GL_FALSE == compile_status) {
         GLchar message[1024];
         glGetShaderInfoLog(shader_id, sizeof(message), 0, &message[0]);
-        SMILE_LOG(Error) << "Shader Compile Error:\n" << message;
-        return eRcode_InternalError;
+        SMILE_LOG(Error) << what << " Shader Compile Error:\n" << message;
     }
-
-    return eRcode_Ok;
 }
 
 
-u32 Shader::getUniformLocation(std::string_view name) noexcept {
-    auto foundIt = _locations.find(name);
-    if (_locations.end() == foundIt) {
-        u32 loc = glGetUniformLocation(_program_id, name.data());
-        auto [it, ok] = _locations.insert(std::make_pair(name, loc));
-        if (!ok) {
-            return 0;
-        }
-        return loc;
+GLint Shader::getUniformLocation(UniformName name) noexcept {
+    if (ShaderState::Ready != _state)
+        return -1;
+
+    auto foundIt = _locations.find(name.id);
+    if (_locations.end() != foundIt) {
+        if (foundIt->second.name == name.name)
+            return foundIt->second.location;
+
+        // another uniform of the same id holds the entry
+        SMILE_LOG(Warning) << "Uniforms " << foundIt->second.name << " and " << name.name
+                           << " have the same id, the latter is not cached";
+        return glGetUniformLocation(_program_id, name.name);
     }
-    return foundIt->second;
+
+    GLint loc = glGetUniformLocation(_program_id, name.name);
+    try {
+        _locations.emplace(name.id, CachedLocation{name.name, loc});
+    } catch (std::bad_alloc&) {
+        // not cached, looked up again next time
+    }
+
+    return loc;
 }
 
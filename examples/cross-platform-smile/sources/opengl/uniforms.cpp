@@ -0,0 +1,109 @@
+#include "uniforms.hpp"
+
+#include <cstring>
+#include <new>
+
+#include "api.hpp"
+#include "glstate.hpp"
+
+#include "smile/log.hpp"
+
+
+using namespace gl_utils;
+
+
+static
+Rcode create_buffer(GLuint binding, u32 size, GLuint& buffer_id) noexcept {
+    CALL_GL(eRcode_InternalError, glGenBuffers, 1, &buffer_id);
+    CALL_GL(eRcode_InternalError, BindBuffer, GL_UNIFORM_BUFFER, buffer_id);
+    CALL_GL(eRcode_InternalError, glBufferData, GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    // the binding point stays attached to the buffer, no binds per frame
+    CALL_GL(eRcode_InternalError, glBindBufferBase, GL_UNIFORM_BUFFER, binding, buffer_id);
+
+    return eRcode_Ok;
+}
+
+
+UniformBuffer::UniformBuffer() noexcept
+    : _buffer_id(0), _binding(0), _size(0)
+    , _last(nullptr), _last_known(false)
+    , _uploads(0), _skipped(0)
+{}
+
+
+UniformBuffer::~UniformBuffer() noexcept {
+    release();
+}
+
+
+Rcode UniformBuffer::setUp(GLuint binding, u32 size) noexcept {
+    if (valid()) {
+        return eRcode_Already;
+    }
+
+    GLint maxBindings = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxBindings);
+    if (binding >= static_cast<GLuint>(maxBindings) || 0 == size) {
+        return eRcode_InvalidInput;
+    }
+
+    try {
+        _last = std::make_unique<byte[]>(size);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
+
+    Rcode rc = create_buffer(binding, size, _buffer_id);
+    if (eRcode_Ok != rc) {
+        release();
+        return rc;
+    }
+
+    _binding = binding;
+    _size = size;
+    _last_known = false;
+    _uploads = 0;
+    _skipped = 0;
+
+    return eRcode_Ok;
+}
+
+
+void UniformBuffer::release() noexcept {
+    if (valid()) {
+        glDeleteBuffers(1, &_buffer_id);
+        ForgetBuffer(_buffer_id);
+    }
+
+    _buffer_id = 0;
+    _size = 0;
+    _last.reset();
+    _last_known = false;
+}
+
+
+Rcode UniformBuffer::update(const void* data, u32 size) noexcept {
+    if (!valid()) {
+        return eRcode_NotInitialized;
+    }
+    if (size != _size) {
+        return eRcode_InvalidInput;
+    }
+
+    if (_last_known && 0 == std::memcmp(_last.get(), data, size)) {
+        ++_skipped;
+        return eRcode_Ok;
+    }
+
+    // unknown until the upload succeeds
+    _last_known = false;
+
+    BindBuffer(GL_UNIFORM_BUFFER, _buffer_id);
+    CALL_GL(eRcode_InternalError, glBufferSubData, GL_UNIFORM_BUFFER, 0, size, data);
+
+    std::memcpy(_last.get(), data, size);
+    _last_known = true;
+    ++_uploads;
+
+    return eRcode_Ok;
+}
@@ -0,0 +1,562 @@
+#include "smile/apitrace.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+#include "smile/log.hpp"
+
+
+using namespace smile;
+
+
+namespace {
+
+// the commits of a frame are written out in big chunks
+constexpr size_t kCaptureBufferSize = 1 << 20;
+
+
+struct captured_buffer_t {
+    u32 id;
+    const byte* contents; // the last handed out
+};
+
+struct capture_t {
+    std::FILE* file{nullptr};
+    bool failed{false};
+    bool untracked{false}; // a call on a resource created before the capture
+
+    PlatformApi real{};
+
+    std::unordered_map<ShaderBufferPtr, captured_buffer_t> buffers;
+    std::unordered_map<TextureDataPtr, u32> textures;
+    u32 nb_buffers{0};
+    u32 nb_textures{0};
+};
+
+static capture_t sCapture;
+
+
+static void write_bytes(const void* data, size_t size) noexcept {
+    if (size > 0 && 1 != std::fwrite(data, size, 1, sCapture.file)) {
+        sCapture.failed = true;
+    }
+}
+
+
+template <typename... Args>
+static void write_call(ApiTraceOp op, Args... args) noexcept {
+    const byte code = static_cast<byte>(op);
+    write_bytes(&code, 1);
+
+    const u32 values[] = { static_cast<u32>(args)..., 0 };
+    write_bytes(values, sizeof(u32)*sizeof...(Args));
+}
+
+
+static u32 f32_bits(f32 value) noexcept {
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+
+static captured_buffer_t* find_buffer(ShaderBufferPtr pbuf) noexcept {
+    auto it = sCapture.buffers.find(pbuf);
+    if (sCapture.buffers.end() == it) {
+        if (pbuf && !sCapture.untracked) {
+            SMILE_LOG(Warning) << "Buffers created before the capture are not captured";
+            sCapture.untracked = true;
+        }
+        return nullptr;
+    }
+    return &it->second;
+}
+
+
+static const u32* find_texture(TextureDataPtr tex) noexcept {
+    auto it = sCapture.textures.find(tex);
+    if (sCapture.textures.end() == it) {
+        if (tex && !sCapture.untracked) {
+            SMILE_LOG(Warning) << "Textures created before the capture are not captured";
+            sCapture.untracked = true;
+        }
+        return nullptr;
+    }
+    return &it->second;
+}
+
+
+static
+Rcode CaptureCreateShaderBuffer( ShaderBufferPtr* outbuf, GraphContextPtr graph
+                               , u32 size, BufferType type, char* name)
+{
+    Rcode rc = sCapture.real.CreateShaderBuffer(outbuf, graph, size, type, name);
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
+
+    try {
+        sCapture.buffers[*outbuf] = captured_buffer_t{sCapture.nb_buffers, nullptr};
+    } catch (const std::bad_alloc&) {
+        sCapture.failed = true;
+        return RC(Ok);
+    }
+
+    write_call(ApiTraceOp::CreateShaderBuffer, sCapture.nb_buffers++, size, type);
+
+    return RC(Ok);
+}
+
+
+static
+Rcode CaptureReleaseShaderBuffer(ShaderBufferPtr pbuf) {
+    if (const captured_buffer_t* buffer = find_buffer(pbuf)) {
+        write_call(ApiTraceOp::ReleaseShaderBuffer, buffer->id);
+        sCapture.buffers.erase(pbuf);
+    }
+
+    return sCapture.real.ReleaseShaderBuffer(pbuf);
+}
+
+
+static
+void* CaptureGetShaderBufferContent(ShaderBufferPtr pbuf) {
+    void* contents = sCapture.real.GetShaderBufferContent(pbuf);
+
+    if (captured_buffer_t* buffer = find_buffer(pbuf)) {
+        buffer->contents = static_cast<const byte*>(contents);
+        write_call(ApiTraceOp::GetShaderBufferContent, buffer->id);
+    }
+
+    return contents;
+}
+
+
+static
+Rcode CaptureCommitShaderBuffer(ShaderBufferPtr pbuf, u32 offset, u32 size) {
+    // written before the commit, which may unmap the contents
+    captured_buffer_t* buffer = find_buffer(pbuf);
+    if (buffer && buffer->contents) {
+        write_call(ApiTraceOp::CommitShaderBuffer, buffer->id, offset, size);
+        write_bytes(buffer->contents + offset, size);
+    }
+
+    return sCapture.real.CommitShaderBuffer(pbuf, offset, size);
+}
+
+
+static
+Rcode CaptureSetVertexBuffer(FrameEncoderPtr pframe, ShaderBufferPtr pbuf, u32 offset) {
+    if (const captured_buffer_t* buffer = find_buffer(pbuf)) {
+        write_call(ApiTraceOp::SetVertexBuffer, buffer->id, offset);
+    }
+
+    return sCapture.real.SetVertexBuffer(pframe, pbuf, offset);
+}
+
+
+static
+Rcode CaptureDrawIndexedPrimitive(FrameEncoderPtr pframe,
+        u32 nbIndices, u32 nbInstances, ShaderBufferPtr pIndiciesBuffer)
+{
+    if (const captured_buffer_t* buffer = find_buffer(pIndiciesBuffer)) {
+        write_call(ApiTraceOp::DrawIndexedPrimitive, nbIndices, nbInstances, buffer->id);
+    }
+
+    return sCapture.real.DrawIndexedPrimitive(pframe, nbIndices, nbInstances, pIndiciesBuffer);
+}
+
+
+static
+Rcode CaptureCreateTextureFromImage(TextureDataPtr* out, GraphContextPtr graph, ImageData* data) {
+    Rcode rc = sCapture.real.CreateTextureFromImage(out, graph, data);
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
+
+    try {
+        sCapture.textures[*out] = sCapture.nb_textures;
+    } catch (const std::bad_alloc&) {
+        sCapture.failed = true;
+        return RC(Ok);
+    }
+
+    write_call( ApiTraceOp::CreateTextureFromImage, sCapture.nb_textures++
+              , data->width, data->height, data->szrow, data->szdata );
+    write_bytes(data->data, data->szdata);
+
+    return RC(Ok);
+}
+
+
+static
+Rcode CaptureReleaseTexture(TextureDataPtr tex) {
+    if (const u32* id = find_texture(tex)) {
+        write_call(ApiTraceOp::ReleaseTexture, *id);
+        sCapture.textures.erase(tex);
+    }
+
+    return sCapture.real.ReleaseTexture(tex);
+}
+
+
+static
+Rcode CaptureSetTextureSlot(FrameEncoderPtr pframe, TextureDataPtr tex) {
+    if (const u32* id = find_texture(tex)) {
+        write_call(ApiTraceOp::SetTextureSlot, *id);
+    }
+
+    return sCapture.real.SetTextureSlot(pframe, tex);
+}
+
+
+static
+Rcode CaptureSetClearColor(FrameEncoderPtr pframe, float R, float G, float B) {
+    write_call(ApiTraceOp::SetClearColor, f32_bits(R), f32_bits(G), f32_bits(B));
+
+    return sCapture.real.SetClearColor(pframe, R, G, B);
+}
+
+}
+
+
+Rcode smile::StartApiCapture(PlatformApi& api, const char* path) noexcept {
+    if (!path) {
+        return RC(InvalidInput);
+    }
+
+    if (sCapture.file) {
+        return RC(Already);
+    }
+
+    sCapture.file = std::fopen(path, "wb");
+    if (!sCapture.file) {
+        SMILE_LOG(Error) << "Failed to open " << path << " for writing";
+        return RC(InternalError);
+    }
+    std::setvbuf(sCapture.file, nullptr, _IOFBF, kCaptureBufferSize);
+
+    sCapture.failed = false;
+    sCapture.untracked = false;
+    sCapture.buffers.clear();
+    sCapture.textures.clear();
+    sCapture.nb_buffers = 0;
+    sCapture.nb_textures = 0;
+
+    const ApiTraceHeader header{kApiTraceMagic, kApiTraceVersion};
+    write_bytes(&header, sizeof(header));
+
+    sCapture.real = api;
+
+    api.CreateShaderBuffer     = &CaptureCreateShaderBuffer;
+    api.ReleaseShaderBuffer    = &CaptureReleaseShaderBuffer;
+    api.GetShaderBufferContent = &CaptureGetShaderBufferContent;
+    api.CommitShaderBuffer     = &CaptureCommitShaderBuffer;
+    api.SetVertexBuffer        = &CaptureSetVertexBuffer;
+    api.DrawIndexedPrimitive   = &CaptureDrawIndexedPrimitive;
+    api.CreateTextureFromImage = &CaptureCreateTextureFromImage;
+    api.ReleaseTexture         = &CaptureReleaseTexture;
+    api.SetTextureSlot         = &CaptureSetTextureSlot;
+    api.SetClearColor          = &CaptureSetClearColor;
+
+    return RC(Ok);
+}
+
+
+Rcode smile::MarkApiCaptureFrame() noexcept {
+    if (!sCapture.file) {
+        return RC(NotInitialized);
+    }
+
+    write_call(ApiTraceOp::Frame);
+
+    return RC(Ok);
+}
+
+
+Rcode smile::StopApiCapture(PlatformApi& api) noexcept {
+    if (!sCapture.file) {
+        return RC(NotInitialized);
+    }
+
+    // only the graphics functions, the platform may have changed the rest
+    api.CreateShaderBuffer     = sCapture.real.CreateShaderBuffer;
+    api.ReleaseShaderBuffer    = sCapture.real.ReleaseShaderBuffer;
+    api.GetShaderBufferContent = sCapture.real.GetShaderBufferContent;
+    api.CommitShaderBuffer     = sCapture.real.CommitShaderBuffer;
+    api.SetVertexBuffer        = sCapture.real.SetVertexBuffer;
+    api.DrawIndexedPrimitive   = sCapture.real.DrawIndexedPrimitive;
+    api.CreateTextureFromImage = sCapture.real.CreateTextureFromImage;
+    api.ReleaseTexture         = sCapture.real.ReleaseTexture;
+    api.SetTextureSlot         = sCapture.real.SetTextureSlot;
+    api.SetClearColor          = sCapture.real.SetClearColor;
+
+    const bool failed = (0 != std::fclose(sCapture.file)) || sCapture.failed;
+    sCapture.file = nullptr;
+    sCapture.buffers.clear();
+    sCapture.textures.clear();
+
+    if (failed) {
+        SMILE_LOG(Error) << "Failed to write the api trace";
+        return RC(InternalError);
+    }
+
+    return RC(Ok);
+}
+
+
+ApiTracePlayer::ApiTracePlayer() noexcept
+    : _cursor(0), _nbFrames(0), _api{}
+{}
+
+
+ApiTracePlayer::~ApiTracePlayer() noexcept {
+    close();
+}
+
+
+Rcode ApiTracePlayer::open(const char* path) noexcept {
+    if (!path) {
+        return RC(InvalidInput);
+    }
+
+    close();
+
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        SMILE_LOG(Error) << "Failed to open " << path;
+        return RC(InvalidInput);
+    }
+
+    std::fseek(file, 0L, SEEK_END);
+    const long size = std::ftell(file);
+    std::fseek(file, 0L, SEEK_SET);
+
+    try {
+        _trace.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    } catch (const std::bad_alloc&) {
+        std::fclose(file);
+        return RC(MemError);
+    }
+
+    const bool ok = _trace.size() >= sizeof(ApiTraceHeader)
+                 && 1 == std::fread(_trace.data(), _trace.size(), 1, file);
+    std::fclose(file);
+
+    ApiTraceHeader header{};
+    if (ok) {
+        std::memcpy(&header, _trace.data(), sizeof(header));
+    }
+    if (!ok || kApiTraceMagic != header.magic || kApiTraceVersion != header.version) {
+        SMILE_LOG(Error) << "Not an api trace (or of another version): " << path;
+        _trace.clear();
+        return RC(InvalidInput);
+    }
+
+    _cursor = sizeof(ApiTraceHeader);
+    _nbFrames = 0;
+
+    return RC(Ok);
+}
+
+
+void ApiTracePlayer::close() noexcept {
+    for (Buffer& buffer : _buffers) {
+        if (buffer.ptr && _api.ReleaseShaderBuffer) {
+            _api.ReleaseShaderBuffer(buffer.ptr);
+        }
+    }
+    for (TextureDataPtr texture : _textures) {
+        if (texture && _api.ReleaseTexture) {
+            _api.ReleaseTexture(texture);
+        }
+    }
+
+    _buffers.clear();
+    _textures.clear();
+    _trace.clear();
+    _cursor = 0;
+    _nbFrames = 0;
+}
+
+
+bool ApiTracePlayer::read(u32& value) noexcept {
+    if (_trace.size() - _cursor < sizeof(u32)) {
+        return false;
+    }
+
+    std::memcpy(&value, _trace.data() + _cursor, sizeof(u32));
+    _cursor += sizeof(u32);
+
+    return true;
+}
+
+
+bool ApiTracePlayer::skip(u32 size, const byte*& bytes) noexcept {
+    if (_trace.size() - _cursor < size) {
+        return false;
+    }
+
+    bytes = _trace.data() + _cursor;
+    _cursor += size;
+
+    return true;
+}
+
+
+Rcode ApiTracePlayer::playFrame(const PlatformApi& api, GraphContextPtr graph, FrameEncoderPtr encoder) noexcept {
+    if (_trace.empty()) {
+        return RC(NotInitialized);
+    }
+
+    if (finished()) {
+        return RC(Already);
+    }
+
+    _api = api;
+
+    while (!finished()) {
+        const ApiTraceOp op = static_cast<ApiTraceOp>(_trace[_cursor++]);
+        if (ApiTraceOp::Frame == op) {
+            ++_nbFrames;
+            return RC(Ok);
+        }
+
+        Rcode rc = playCall(op, graph, encoder);
+        if (eRcode_Ok != rc) {
+            return rc;
+        }
+    }
+
+    // the calls after the last frame
+    return RC(Ok);
+}
+
+
+Rcode ApiTracePlayer::playCall(ApiTraceOp op, GraphContextPtr graph, FrameEncoderPtr encoder) noexcept {
+    u32 args[5] = {};
+    const byte* bytes = nullptr;
+
+    auto read_args = [this, &args](u32 nb) {
+        for (u32 i = 0; i < nb; ++i) {
+            if (!read(args[i])) return false;
+        }
+        return true;
+    };
+    auto buffer = [this](u32 id) -> Buffer* {
+        return id < _buffers.size() && _buffers[id].ptr ? &_buffers[id] : nullptr;
+    };
+    auto texture = [this](u32 id) -> TextureDataPtr {
+        return id < _textures.size() ? _textures[id] : nullptr;
+    };
+
+    switch (op) {
+        case ApiTraceOp::CreateShaderBuffer: {
+            if (!read_args(3)) break;
+            if (args[0] != _buffers.size()) break;
+
+            ShaderBufferPtr ptr = nullptr;
+            Rcode rc = _api.CreateShaderBuffer(&ptr, graph, args[1], static_cast<BufferType>(args[2]), nullptr);
+            if (eRcode_Ok != rc) {
+                return rc;
+            }
+            try {
+                _buffers.push_back(Buffer{ptr, args[1], nullptr});
+            } catch (const std::bad_alloc&) {
+                _api.ReleaseShaderBuffer(ptr);
+                return RC(MemError);
+            }
+            return RC(Ok);
+        }
+
+        case ApiTraceOp::ReleaseShaderBuffer: {
+            Buffer* b = read_args(1) ? buffer(args[0]) : nullptr;
+            if (!b) break;
+
+            ShaderBufferPtr ptr = b->ptr;
+            *b = Buffer{};
+            return _api.ReleaseShaderBuffer(ptr);
+        }
+
+        case ApiTraceOp::GetShaderBufferContent: {
+            Buffer* b = read_args(1) ? buffer(args[0]) : nullptr;
+            if (!b) break;
+
+            b->contents = static_cast<byte*>(_api.GetShaderBufferContent(b->ptr));
+            return b->contents ? RC(Ok) : RC(InternalError);
+        }
+
+        case ApiTraceOp::CommitShaderBuffer: {
+            Buffer* b = read_args(3) ? buffer(args[0]) : nullptr;
+            if (!b || !b->contents || args[1] > b->size || args[2] > b->size - args[1]) break;
+            if (!skip(args[2], bytes)) break;
+
+            std::memcpy(b->contents + args[1], bytes, args[2]);
+            return _api.CommitShaderBuffer(b->ptr, args[1], args[2]);
+        }
+
+        case ApiTraceOp::SetVertexBuffer: {
+            Buffer* b = read_args(2) ? buffer(args[0]) : nullptr;
+            if (!b) break;
+
+            return _api.SetVertexBuffer(encoder, b->ptr, args[1]);
+        }
+
+        case ApiTraceOp::DrawIndexedPrimitive: {
+            Buffer* b = read_args(3) ? buffer(args[2]) : nullptr;
+            if (!b) break;
+
+            return _api.DrawIndexedPrimitive(encoder, args[0], args[1], b->ptr);
+        }
+
+        case ApiTraceOp::CreateTextureFromImage: {
+            if (!read_args(5) || args[0] != _textures.size() || !skip(args[4], bytes)) break;
+
+            ImageData image{const_cast<byte*>(bytes), args[4], args[1], args[2], args[3]};
+            TextureDataPtr ptr = nullptr;
+            Rcode rc = _api.CreateTextureFromImage(&ptr, graph, &image);
+            if (eRcode_Ok != rc) {
+                return rc;
+            }
+            try {
+                _textures.push_back(ptr);
+            } catch (const std::bad_alloc&) {
+                _api.ReleaseTexture(ptr);
+                return RC(MemError);
+            }
+            return RC(Ok);
+        }
+
+        case ApiTraceOp::ReleaseTexture: {
+            TextureDataPtr ptr = read_args(1) ? texture(args[0]) : nullptr;
+            if (!ptr) break;
+
+            _textures[args[0]] = nullptr;
+            return _api.ReleaseTexture(ptr);
+        }
+
+        case ApiTraceOp::SetTextureSlot: {
+            TextureDataPtr ptr = read_args(1) ? texture(args[0]) : nullptr;
+            if (!ptr) break;
+
+            return _api.SetTextureSlot(encoder, ptr);
+        }
+
+        case ApiTraceOp::SetClearColor: {
+            if (!read_args(3)) break;
+
+            f32 color[3];
+            std::memcpy(color, args, sizeof(color));
+            return _api.SetClearColor(encoder, color[0], color[1], color[2]);
+        }
+
+        default:
+            break;
+    }
+
+    SMILE_LOG(Error) << "Broken api trace at " << _cursor;
+    _cursor = _trace.size();
+    return RC(InvalidInput);
+}
@@ -0,0 +1,124 @@
+#include "smile/assetpack.hpp"
+
+#include <cstring>
+
+
+using namespace smile;
+
+
+AssetPack::AssetPack() noexcept
+    : _data(nullptr), _entries(nullptr), _nbEntries(0), _pixelconvVersion(0)
+{}
+
+
+Rcode AssetPack::open(const AssetData& pack) noexcept {
+    close();
+
+    AssetPackHeader header;
+    if (!pack.data || pack.size < sizeof(header)) {
+        return eRcode_InvalidInput;
+    }
+
+    std::memcpy(&header, pack.data, sizeof(header));
+
+    if (kAssetPackMagic != header.magic || kAssetPackVersion != header.version) {
+        return eRcode_InvalidInput;
+    }
+
+    const u64 szTable = static_cast<u64>(header.nb_entries) * sizeof(AssetPackEntry);
+    if (szTable > pack.size - sizeof(header)) {
+        return eRcode_InvalidInput;
+    }
+
+    // the table is right after the 16 bytes header, so it is aligned enough
+    // as long as the pack memory is
+    const AssetPackEntry* entries =
+        reinterpret_cast<const AssetPackEntry*>(pack.data + sizeof(header));
+
+    for (u32 i = 0; i < header.nb_entries; ++i) {
+        const AssetPackEntry& e = entries[i];
+        if (static_cast<u64>(e.offset) + e.size > pack.size ||
+            '\0' != e.name[kMaxAssetPackName - 1])
+        {
+            return eRcode_InvalidInput;
+        }
+
+        if (static_cast<u32>(AssetPackKind::Texture) == e.kind &&
+            static_cast<u64>(e.szrow) * e.height > e.size)
+        {
+            return eRcode_InvalidInput;
+        }
+
+        if (i > 0 && std::strcmp(entries[i - 1].name, e.name) >= 0) {
+            return eRcode_InvalidInput;
+        }
+    }
+
+    _data = pack.data;
+    _entries = entries;
+    _nbEntries = header.nb_entries;
+    _pixelconvVersion = header.pixelconv_version;
+
+    return eRcode_Ok;
+}
+
+
+void AssetPack::close() noexcept {
+    _data = nullptr;
+    _entries = nullptr;
+    _nbEntries = 0;
+    _pixelconvVersion = 0;
+}
+
+
+const AssetPackEntry* AssetPack::find(const char* name) const noexcept {
+    if (!_entries || !name) {
+        return nullptr;
+    }
+
+    u32 lo = 0, hi = _nbEntries;
+    while (lo < hi) {
+        const u32 mid = lo + (hi - lo) / 2;
+        const int cmp = std::strcmp(_entries[mid].name, name);
+        if (0 == cmp) {
+            return &_entries[mid];
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return nullptr;
+}
+
+
+bool AssetPack::raw(const char* name, AssetData& out) const noexcept {
+    const AssetPackEntry* e = find(name);
+    if (!e || static_cast<u32>(AssetPackKind::Raw) != e->kind) {
+        return false;
+    }
+
+    out.data = _data + e->offset;
+    out.size = e->size;
+
+    return true;
+}
+
+
+bool AssetPack::texture(const char* name, u32 format, ImageData& out) const noexcept {
+    const AssetPackEntry* e = find(name);
+    if (!e || static_cast<u32>(AssetPackKind::Texture) != e->kind || format != e->format) {
+        return false;
+    }
+
+    out.data = _data + e->offset;
+    out.szdata = e->size;
+    out.width = e->width;
+    out.height = e->height;
+    out.szrow = e->szrow;
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "cpu.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#   define CPU_X86_64 1
+#   if defined(_MSC_VER) && !defined(__clang__)
+#       include <intrin.h>
+#       include <immintrin.h>
+#   endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#   define CPU_NEON 1
+#endif
+
+
+using namespace smile;
+
+
+namespace {
+
+struct cpu_features_t {
+    bool sse2{false};
+    bool avx2{false};
+    bool neon{false};
+};
+
+
+static cpu_features_t detect_cpu_features() noexcept {
+    cpu_features_t features;
+
+#if defined(CPU_X86_64)
+    // a part of the x86-64 baseline
+    features.sse2 = true;
+#   if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 1);
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+    __cpuidex(regs, 7, 0);
+    const bool avx2 = (regs[1] & (1 << 5)) != 0;
+    features.avx2 = osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6;
+#   else
+    __builtin_cpu_init();
+    features.avx2 = __builtin_cpu_supports("avx2");
+#   endif
+#elif defined(CPU_NEON)
+    // the target is built with NEON, so it runs only where it's present
+    features.neon = true;
+#endif
+
+    return features;
+}
+
+}
+
+
+bool smile::HasCpuFeature(CpuFeature feature) noexcept {
+    static const cpu_features_t sFeatures = detect_cpu_features();
+
+    switch (feature) {
+        case CpuFeature::Sse2: return sFeatures.sse2;
+        case CpuFeature::Avx2: return sFeatures.avx2;
+        case CpuFeature::Neon: return sFeatures.neon;
+        default: return false;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef SMILE_CPU_HPP_
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Instruction set extensions the engine has kernels for.
+enum class CpuFeature {
+    Sse2 = 0
+,   Avx2
+,   Neon
+};
+
+
+// Detected once, on the first call; true if the CPU (and the OS) runs the
+// instructions of the feature.
+bool HasCpuFeature(CpuFeature feature) noexcept;
+
+
+}
+
+
+#define SMILE_CPU_HPP_
+#endif
@@ -2,8 +2,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <cstring>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <new>
 #include <tuple>
@@ -11,6 +13,11 @@
 
 #include "png.h"
 
+#include "jobsystem.hpp"
+#include "pixelconv.hpp"
+
+#include "smile/profiler.hpp"
+
 
 using namespace imageutils;
 
@@ -57,151 +64,221 @@ static __raii_t<Params...> __ToRaii(typename __raii_t<Params...>::Deleter delete
 typedef struct {
     size_t offset;
     const byte*const* ppData;
+    size_t size;
 } read_data_t;
 
 static void read_png_data(png_structp pngPtr, png_bytep data, png_size_t len) {
     read_data_t& rd = *(read_data_t*)png_get_io_ptr(pngPtr);
+    // a truncated asset ends where its mapping does
+    if (len > rd.size - rd.offset) {
+        png_error(pngPtr, "Read past the end of the asset");
+    }
     std::memcpy(data, *rd.ppData + rd.offset, len);
     rd.offset += len;
 }
 
 
-class ColorObject {
-public:
+// Images smaller than this are not worth waking up a worker for.
+constexpr u32 kMinPixelsPerBand = 64 * 1024;
 
-    static
-    ColorObject FromFormat(ColorFormat format) noexcept;
+static bool worth_bands(const smile::JobSystem* jobs, u32 width, u32 height) noexcept {
+    return jobs && jobs->nbWorkers() > 0
+        && static_cast<u64>(width) * height >= 2 * kMinPixelsPerBand;
+}
 
-    ColorObject(u32 nbBitsR, u32 nbBitsG, u32 nbBitsB, u32 nbBitsA) noexcept;
 
-    bool isValid() const noexcept { return _nbBits > 0 && _nbBits <= 32; }
+struct convert_rows_t {
+    const RowConverter* converter;
+    byte* dst;
+    size_t szDstRow;
+    const byte* src;
+    size_t szSrcRow;
+    u32 width;
+};
 
-    u32 size() const noexcept { return _nbBytes; }
+static void convert_rows_job(void* arg, u32 begin, u32 end) {
+    const convert_rows_t& rows = *static_cast<const convert_rows_t*>(arg);
+    for (u32 y = begin; y < end; ++y) {
+        (*rows.converter)(rows.dst + rows.szDstRow * y, rows.src + rows.szSrcRow * y, rows.width);
+    }
+}
 
-    byte R() const noexcept { return _r; }
-    byte G() const noexcept { return _g; }
-    byte B() const noexcept { return _b; }
-    byte A() const noexcept { return _a; }
+// Converts bands of rows as jobs, or all of them on the calling thread if
+// bands are not worth it. The bands are disjoint, so the result does not
+// depend on how they are scheduled.
+static void convert_rows(convert_rows_t& rows, u32 height, smile::JobSystem* jobs) noexcept {
+    if (!worth_bands(jobs, rows.width, height)) {
+        convert_rows_job(&rows, 0, height);
+        return;
+    }
 
-    void set(byte r, byte g, byte b, byte a) noexcept;
+    smile::JobCounter counter;
+    jobs->parallelFor( height, std::max(1u, kMinPixelsPerBand / rows.width)
+                     , &convert_rows_job, &rows, counter );
+    jobs->wait(counter);
+}
 
-    Rcode save(byte* pBuffer) const noexcept;
-    Rcode load(const byte* pBuffer) noexcept;
 
-private:
+// The image decoded by decode_png.
+struct decoded_png_t {
+    std::vector<uint8_t*> rows;
+    std::unique_ptr<byte[]> data;
+    std::unique_ptr<byte[]> decoded; // before the conversion
+    png_uint_32 width{0};
+    png_uint_32 height{0};
+    png_size_t szrow{0};
+    ColorFormat format{ColorFormat::Undefined};
+};
 
-    u32 _nbBitsR;
-    u32 _nbBitsG;
-    u32 _nbBitsB;
-    u32 _nbBitsA;
 
-    u32 _nbBits;
-    u32 _nbBytes;
+// Decodes the image, converted to the target format if it is defined. The
+// libpng calls may longjmp to the setjmp of the caller, so this works on its
+// own locals and the buffers are owned by the caller.
+static Rcode decode_png( png_structp pPng, png_infop pPngInfo, ColorFormat target
+                       , smile::JobSystem* jobs, decoded_png_t& out) noexcept
+{
+    png_uint_32 w, h;
+    int bDepth, colorType, interlaceType;
+    ColorFormat fmt = ColorFormat::Undefined;
+    png_size_t szRowInBytes = 0;
+    png_size_t szDstRow = 0;
+    RowConverter converter;
 
-    byte _r, _g, _b, _a;
-};
+    png_read_info(pPng, pPngInfo);
 
-/*static*/
-ColorObject ColorObject::FromFormat(ColorFormat format) noexcept {
-
-    switch (format) {
-        case ColorFormat::R8G8B8X8 : return ColorObject(8, 8, 8, 8);
-        case ColorFormat::R8G8B8A8 : return ColorObject(8, 8, 8, 8);
-        case ColorFormat::R8G8B8   : return ColorObject(8, 8, 8, 0);
-        case ColorFormat::R4G4B4A4 : return ColorObject(4, 4, 4, 4);
-        case ColorFormat::R5G6B5   : return ColorObject(5, 6, 5, 0);
-        case ColorFormat::A8       : return ColorObject(0, 0, 0, 8);
-        case ColorFormat::Undefined: return ColorObject(0, 0, 0, 0);
+    png_get_IHDR(pPng, pPngInfo, &w, &h, &bDepth, &colorType, &interlaceType, NULL, NULL);
+
+    png_set_strip_16(pPng);
+
+    // convert the grayscale image to the RGBA 8 bit image
+    if (colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        fmt = ColorFormat::R8G8B8A8;
+        png_set_gray_to_rgb(pPng);
     }
 
-    return ColorObject(0, 0, 0, 0);
-}
+    // extract multiple pixels with bit depths of 1, 2, and 4 from a single
+    // byte into separate bytes (useful for paletted and grayscale images)
+    png_set_packing(pPng);
 
+    // expand paletted colors into true RGB triplets
+    if (colorType == PNG_COLOR_TYPE_PALETTE) {
+        fmt = ColorFormat::R8G8B8;
+        png_set_palette_to_rgb(pPng);
+    }
 
-ColorObject::ColorObject(u32 nbBitsR, u32 nbBitsG, u32 nbBitsB, u32 nbBitsA) noexcept
-    : _nbBitsR(nbBitsR), _nbBitsG(nbBitsG), _nbBitsB(nbBitsB), _nbBitsA(nbBitsA)
-    , _nbBits(nbBitsA + nbBitsB + nbBitsG + nbBitsR)
-    , _r(0), _g(0), _b(0), _a(0)
-{
-    _nbBytes = _nbBits / 8;
-    if ((_nbBits % 8) != 0) {
-        _nbBytes += 1;
+    // expand grayscale images to the full 8 bits from 1, 2, or 4 bits/pixel
+    if (colorType == PNG_COLOR_TYPE_GRAY && bDepth < 8) {
+        fmt = ColorFormat::A8;
+        png_set_expand_gray_1_2_4_to_8(pPng);
     }
-}
 
+    // expand paletted or RGB images with transparency to full alpha channels
+    // so the data will be available as RGBA quartets
+    if (png_get_valid(pPng, pPngInfo, PNG_INFO_tRNS) != 0) {
+        png_set_tRNS_to_alpha(pPng);
+    }
 
-void ColorObject::set(byte r, byte g, byte b, byte a) noexcept {
+    // set the background color to draw transparent and alpha images over.
+    // It is possible to set the red, green, and blue components directly
+    // for paletted images instead of supplying a palette index. Note that
+    // even if the PNG file supplies a background, you are not required to
+    // use it - you should use the (solid) application background if it has one.
+    if (colorType != PNG_COLOR_TYPE_RGBA) {
+        png_color_16 myBackground, *pImageBackground;
 
-    u32 maxR = (1 << _nbBitsR) - 1;
-    u32 maxG = (1 << _nbBitsG) - 1;
-    u32 maxB = (1 << _nbBitsB) - 1;
-    u32 maxA = (1 << _nbBitsA) - 1;
+        if (png_get_bKGD(pPng, pPngInfo, &pImageBackground) != 0) {
+            png_set_background(pPng, pImageBackground, PNG_BACKGROUND_GAMMA_FILE, 1, 1.0);
+        } else {
+            png_set_background(pPng, &myBackground, PNG_BACKGROUND_GAMMA_SCREEN, 0, 1.0);
+        }
+    }
 
-    _r = static_cast<byte>(std::min((u32)r, maxR));
-    _g = static_cast<byte>(std::min((u32)g, maxG));
-    _b = static_cast<byte>(std::min((u32)b, maxB));
-    _a = static_cast<byte>(std::min((u32)a, maxA));
-}
+    // let libpng combine the Adam7 passes of interlaced images
+    png_set_interlace_handling(pPng);
 
+    /* Optional call to gamma correct and add the background to the palette
+     * and update info structure. REQUIRED if you are expecting libpng to
+     * update the palette for you (ie you selected such a transform above). */
+    png_read_update_info(pPng, pPngInfo);
 
-Rcode ColorObject::save(byte* pBuffer) const noexcept {
+    if (ColorFormat::Undefined == fmt) {
+        switch (colorType) {
+            case PNG_COLOR_TYPE_GRAY     : fmt = ColorFormat::A8;       break;
+            case PNG_COLOR_TYPE_RGB      : fmt = ColorFormat::R8G8B8;   break;
+            case PNG_COLOR_TYPE_RGB_ALPHA: fmt = ColorFormat::R8G8B8A8; break;
+            default: fmt = ColorFormat::Undefined;
+        }
+    }
 
-    if (!isValid()) {
+    if (fmt == ColorFormat::Undefined || 8 != bDepth) {
         return eRcode_InvalidInput;
     }
 
-    assert(_nbBits <= 32);
-
-    if (_nbBits <= 8) {
-        byte colorval = (_r << (_nbBits-_nbBitsR))
-                      | (_g << (_nbBitsB + _nbBitsA))
-                      | (_b << _nbBitsA)
-                      | (_a);
-        *pBuffer = colorval;
-    } else if (_nbBits <= 16) {
-        u16 colorval = (static_cast<u16>(_r) << (_nbBits-_nbBitsR))
-                     | (static_cast<u16>(_g) << (_nbBitsB + _nbBitsA))
-                     | (static_cast<u16>(_b) << _nbBitsA)
-                     | static_cast<u16>(_a);
-        *reinterpret_cast<u16*>(pBuffer) = colorval;
-    } else {
-        u32 colorval = (static_cast<u32>(_r) << (_nbBits-_nbBitsR))
-                     | (static_cast<u32>(_g) << (_nbBitsB + _nbBitsA))
-                     | (static_cast<u32>(_b) << _nbBitsA)
-                     | static_cast<u32>(_a);
-        *reinterpret_cast<u32*>(pBuffer) = colorval;
+    const ColorFormat dstFmt = (ColorFormat::Undefined == target) ? fmt : target;
+
+    if (eRcode_Ok != converter.setUp(fmt, dstFmt)) {
+        return eRcode_InvalidInput;
     }
 
-    return eRcode_Ok;
-}
+    szRowInBytes = png_get_rowbytes(pPng, pPngInfo);
+    if (szRowInBytes < w * converter.source().size) {
+        return eRcode_InvalidInput;
+    }
 
+    szDstRow = (fmt == dstFmt) ? szRowInBytes : w * converter.target().size;
 
-Rcode ColorObject::load(const byte* pBuffer) noexcept {
+    // Rows of an interlaced image are complete only after the last pass, so
+    // such images are decoded whole and converted afterwards. So are large
+    // ones, to be converted in bands on the jobs.
+    const bool whole = PNG_INTERLACE_NONE != interlaceType
+                    || (fmt != dstFmt && worth_bands(jobs, w, h));
 
-    if (!isValid()) {
-        return eRcode_InvalidInput;
+    try {
+        out.data = std::make_unique<byte[]>(h * szDstRow);
+
+        if (whole) {
+            out.rows.resize(static_cast<std::size_t>(h));
+            if (fmt != dstFmt) {
+                out.decoded = std::make_unique<byte[]>(h * szRowInBytes);
+            }
+        } else if (fmt != dstFmt) {
+            out.decoded = std::make_unique<byte[]>(szRowInBytes);
+        }
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
     }
 
-    assert(_nbBits <= 32);
+    if (whole) {
+        byte* pDecoded = out.decoded ? out.decoded.get() : out.data.get();
+        for (png_uint_32 r = 0; r < h; r++) {
+            out.rows[h - 1 - r] = pDecoded + szRowInBytes * r;
+        }
 
-    u32 maxG = (1 << _nbBitsG) - 1;
-    u32 maxB = (1 << _nbBitsB) - 1;
-    u32 maxA = (1 << _nbBitsA) - 1;
+        png_read_image(pPng, out.rows.data());
 
-    u32 colorval;
-    if (_nbBits <= 8) {
-        colorval = static_cast<u32>(*pBuffer);
-    } else if (_nbBits <= 16) {
-        colorval = static_cast<u32>(*reinterpret_cast<const u16*>(pBuffer));
+        if (out.decoded) {
+            convert_rows_t rows{&converter, out.data.get(), szDstRow, out.decoded.get(), szRowInBytes, w};
+            convert_rows(rows, h, jobs);
+        }
     } else {
-        colorval = *reinterpret_cast<const u32*>(pBuffer);
+        // decode (and convert) row by row right into the flipped destination
+        for (png_uint_32 r = 0; r < h; r++) {
+            byte* pDst = out.data.get() + szDstRow * (h - 1 - r);
+            if (out.decoded) {
+                png_read_row(pPng, out.decoded.get(), nullptr);
+                converter(pDst, out.decoded.get(), w);
+            } else {
+                png_read_row(pPng, pDst, nullptr);
+            }
+        }
     }
 
-    byte rv = _nbBitsR > 0 ? static_cast<byte>(colorval >> (_nbBits-_nbBitsR)) : 0;
-    byte gv = _nbBitsG > 0 ? static_cast<byte>((colorval >> (_nbBitsB + _nbBitsA)) & maxG) : 0;
-    byte bv = _nbBitsB > 0 ? static_cast<byte>((colorval >> _nbBitsA) & maxB) : 0;
-    byte av = _nbBitsA > 0 ? static_cast<byte>(colorval & maxA) : 255;
-    set(rv, gv, bv, av);
+    png_read_end(pPng, pPngInfo);
+
+    out.width = w;
+    out.height = h;
+    out.szrow = szDstRow;
+    out.format = dstFmt;
 
     return eRcode_Ok;
 }
@@ -223,11 +300,31 @@ Png::~Png() noexcept {
 
 Rcode imageutils::Png::load(const AssetData& asset) noexcept
 {
-    if (!asset.data || png_sig_cmp(asset.data, 0, 8)) {
+    return load(asset, ColorFormat::Undefined);
+}
+
+
+Rcode imageutils::Png::load(const AssetData& asset, ColorFormat target) noexcept
+{
+    return decode(asset, target, nullptr);
+}
+
+
+Rcode imageutils::Png::load(const AssetData& asset, ColorFormat target, smile::JobSystem& jobs) noexcept
+{
+    return decode(asset, target, &jobs);
+}
+
+
+Rcode imageutils::Png::decode(const AssetData& asset, ColorFormat target, smile::JobSystem* jobs) noexcept
+{
+    SMILE_ZONE("Png::load");
+
+    if (!asset.data || asset.size < 8 || png_sig_cmp(asset.data, 0, 8)) {
         return eRcode_InvalidInput;
     }
 
-    read_data_t rd{8, &asset.data};
+    read_data_t rd{8, &asset.data, asset.size};
 
     png_structp pPng =
         png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
@@ -247,11 +344,7 @@ Rcode imageutils::Png::load(const AssetData& asset) noexcept
         png_destroy_read_struct(p1, p2, nullptr);
     }, &pPng, &pPngInfo);
 
-    png_uint_32 w, h;
-    int bDepth, colorType, interlaceType;
-    ColorFormat fmt = ColorFormat::Undefined;
-    png_size_t szRowInBytes = 0;
-    std::vector<uint8_t*> rows;
+    decoded_png_t png;
 
     if (setjmp(png_jmpbuf(pPng))) {
         return eRcode_LogicError;
@@ -261,118 +354,87 @@ Rcode imageutils::Png::load(const AssetData& asset) noexcept
 
     png_set_sig_bytes(pPng, 8);
 
-    png_read_info(pPng, pPngInfo);
+    Rcode rc = decode_png(pPng, pPngInfo, target, jobs, png);
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
 
-    png_get_IHDR(pPng, pPngInfo, &w, &h, &bDepth, &colorType, &interlaceType, NULL, NULL);
+    raii__pPngInfo.release();
+    png_destroy_read_struct(&pPng, &pPngInfo, NULL);
 
-    rows.resize(static_cast<std::size_t>(h));
-    std::memset(rows.data(), 0, rows.size() * sizeof(rows[0]));
+    delete[] _image.data;
 
-    png_set_strip_16(pPng);
+    _image.data = png.data.release();
+    _image.szdata = static_cast<u32>(png.height*png.szrow);
+    _image.width = static_cast<u32>(png.width);
+    _image.height = static_cast<u32>(png.height);
+    _image.szrow = static_cast<u32>(png.szrow);
 
-    // convert the grayscale image to the RGBA 8 bit image
-    if (colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        fmt = ColorFormat::R8G8B8A8;
-        png_set_gray_to_rgb(pPng);
-    }
+    _format = png.format;
 
-    // extract multiple pixels with bit depths of 1, 2, and 4 from a single
-    // byte into separate bytes (useful for paletted and grayscale images)
-    png_set_packing(pPng);
+    return eRcode_Ok;
+}
 
-    // expand paletted colors into true RGB triplets
-    if (colorType == PNG_COLOR_TYPE_PALETTE) {
-        fmt = ColorFormat::R8G8B8;
-        png_set_palette_to_rgb(pPng);
-    }
 
-    // expand grayscale images to the full 8 bits from 1, 2, or 4 bits/pixel
-    if (colorType == PNG_COLOR_TYPE_GRAY && bDepth < 8) {
-        fmt = ColorFormat::A8;
-        png_set_expand_gray_1_2_4_to_8(pPng);
+Rcode Png::convert(ColorFormat target) noexcept {
+    if (_format == target) {
+        return eRcode_Ok;
     }
 
-    // expand paletted or RGB images with transparency to full alpha channels
-    // so the data will be available as RGBA quartets
-    if (png_get_valid(pPng, pPngInfo, PNG_INFO_tRNS) != 0) {
-        png_set_tRNS_to_alpha(pPng);
+    Png tmp;
+    Rcode rc = convert(tmp, *this, target, nullptr);
+    if (eRcode_Ok != rc) {
+        return rc;
     }
 
-    // set the background color to draw transparent and alpha images over.
-    // It is possible to set the red, green, and blue components directly
-    // for paletted images instead of supplying a palette index. Note that
-    // even if the PNG file supplies a background, you are not required to
-    // use it - you should use the (solid) application background if it has one.
-    if (colorType != PNG_COLOR_TYPE_RGBA) {
-        png_color_16 myBackground, *pImageBackground;
-
-        if (png_get_bKGD(pPng, pPngInfo, &pImageBackground) != 0) {
-            png_set_background(pPng, pImageBackground, PNG_BACKGROUND_GAMMA_FILE, 1, 1.0);
-        } else {
-            png_set_background(pPng, &myBackground, PNG_BACKGROUND_GAMMA_SCREEN, 0, 1.0);
-        }
-    }
+    swap(tmp, *this);
 
-    /* Optional call to gamma correct and add the background to the palette
-     * and update info structure. REQUIRED if you are expecting libpng to
-     * update the palette for you (ie you selected such a transform above). */
-    png_read_update_info(pPng, pPngInfo);
+    return eRcode_Ok;
+}
 
-    szRowInBytes = png_get_rowbytes(pPng, pPngInfo);
 
-    _image.szdata = static_cast<u32>(h*szRowInBytes);
-    std::unique_ptr<byte[]> data = std::make_unique<byte[]>(_image.szdata);
-    if (!data.get()) {
-        return eRcode_MemError;
+Rcode Png::convert(ColorFormat target, smile::JobSystem& jobs) noexcept {
+    if (_format == target) {
+        return eRcode_Ok;
     }
 
-    for (png_uint_32 r = 0; r < h; r++) {
-        rows[h - 1 - r] = data.get() + szRowInBytes * r;
+    Png tmp;
+    Rcode rc = convert(tmp, *this, target, &jobs);
+    if (eRcode_Ok != rc) {
+        return rc;
     }
 
-    png_read_image(pPng, rows.data());
+    swap(tmp, *this);
 
-    png_read_end(pPng, pPngInfo);
+    return eRcode_Ok;
+}
 
-    raii__pPngInfo.release();
-    png_destroy_read_struct(&pPng, &pPngInfo, NULL);
 
-    if (ColorFormat::Undefined == fmt) {
-        switch (colorType) {
-            case PNG_COLOR_TYPE_GRAY     : fmt = ColorFormat::A8;       break;
-            case PNG_COLOR_TYPE_RGB      : fmt = ColorFormat::R8G8B8;   break;
-            case PNG_COLOR_TYPE_RGB_ALPHA: fmt = ColorFormat::R8G8B8A8; break;
-            default: fmt = ColorFormat::Undefined;
-        }
+Rcode Png::create(u32 width, u32 height, ColorFormat format) noexcept {
+    PixelLayout layout;
+    if (!GetPixelLayout(format, layout) || 0 == width || 0 == height) {
+        return eRcode_InvalidInput;
     }
 
-    if (fmt == ColorFormat::Undefined || 8 != bDepth) {
+    const u64 szdata = static_cast<u64>(width) * height * layout.size;
+    if (szdata > std::numeric_limits<u32>::max()) {
         return eRcode_InvalidInput;
     }
 
-    _image.data = data.release();
-    _image.width = static_cast<u32>(w);
-    _image.height = static_cast<u32>(h);
-    _image.szrow = static_cast<u32>(szRowInBytes);
-
-    _format = fmt;
-
-    return eRcode_Ok;
-}
-
-
-Rcode Png::convert(ColorFormat target) noexcept {
-    if (_format == target) {
-        return eRcode_Ok;
+    byte* data = new (std::nothrow) byte[szdata];
+    if (!data) {
+        return eRcode_MemError;
     }
 
-    Png tmp;
-    Rcode rc = convert(tmp, *this, target);
-    if (eRcode_Ok != rc) {
-        return rc;
-    }
+    delete[] _image.data;
 
-    swap(tmp, *this);
+    _image.data = data;
+    _image.szdata = static_cast<u32>(szdata);
+    _image.width = width;
+    _image.height = height;
+    _image.szrow = width * layout.size;
+
+    _format = format;
 
     return eRcode_Ok;
 }
@@ -390,64 +452,22 @@ void Png::swap(Png& a, Png& b) noexcept {
 }
 
 /*static*/
-Rcode Png::convert_A8_to_RGBA(Png& dest, const Png& source) noexcept {
-    assert(source._format == ColorFormat::A8);
-
-    ColorObject srcColor = ColorObject::FromFormat(ColorFormat::A8);
-    assert(srcColor.isValid());
+Rcode Png::convert(Png& dest, const Png& source, ColorFormat target, smile::JobSystem* jobs) noexcept {
+    SMILE_ZONE("Png::convert");
 
-    ColorObject dstColor = ColorObject::FromFormat(ColorFormat::R8G8B8A8);
-    assert(srcColor.isValid());
-
-    dest._image.szrow = source._image.width * dstColor.size();
-    dest._image.width = source._image.width;
-    dest._image.height = source._image.height;
-    dest._format = ColorFormat::R8G8B8A8;
-    dest._image.szdata = source._image.width * source._image.height * dstColor.size();
-
-    try {
-        dest._image.data = new byte[dest._image.szdata];
-        if (!dest._image.data) {
-            return eRcode_MemError;
-        }
-    } catch (std::bad_alloc&) {
-        return eRcode_MemError;
-    }
-
-    for ( u32 y = 0, w = 0
-        ; y < source._image.height * source._image.szrow
-        ; y += source._image.szrow, w += dest._image.szrow)
-    {
-        for ( u32 x = 0, v = 0
-            ; x < source._image.width * srcColor.size()
-            ; x += srcColor.size(), v += dstColor.size())
-        {
-            assert(y + x < source._image.szdata);
-            assert(w + v < dest._image.szdata);
-            srcColor.load(&(source._image.data[y + x]));
-            dstColor.set(srcColor.A(), srcColor.A(), srcColor.A(), 255);
-            dstColor.save(&(dest._image.data[w + v]));
-        }
+    RowConverter converter;
+    Rcode rc = converter.setUp(source._format, target);
+    if (eRcode_Ok != rc) {
+        return rc;
     }
 
-    return eRcode_Ok;
-}
-
-/*static*/
-Rcode Png::convert_RGB_to_A8(Png& dest, const Png& source) noexcept {
-    assert(source._format == ColorFormat::R8G8B8);
+    const u32 bpp = converter.target().size;
 
-    ColorObject srcColor = ColorObject::FromFormat(ColorFormat::R8G8B8);
-    assert(srcColor.isValid());
-
-    ColorObject dstColor = ColorObject::FromFormat(ColorFormat::A8);
-    assert(srcColor.isValid());
-
-    dest._image.szrow = source._image.width * dstColor.size();
+    dest._image.szrow = source._image.width * bpp;
     dest._image.width = source._image.width;
     dest._image.height = source._image.height;
-    dest._format = ColorFormat::A8;
-    dest._image.szdata = source._image.width * source._image.height * dstColor.size();
+    dest._format = target;
+    dest._image.szdata = source._image.width * source._image.height * bpp;
 
     try {
         dest._image.data = new byte[dest._image.szdata];
@@ -458,71 +478,9 @@ Rcode Png::convert_RGB_to_A8(Png& dest, const Png& source) noexcept {
         return eRcode_MemError;
     }
 
-    for ( u32 y = 0, w = 0
-        ; y < source._image.height * source._image.szrow
-        ; y += source._image.szrow, w += dest._image.szrow)
-    {
-        for ( u32 x = 0, v = 0
-            ; x < source._image.width * srcColor.size()
-            ; x += srcColor.size(), v += dstColor.size())
-        {
-            assert(y + x < source._image.szdata);
-            assert(w + v < dest._image.szdata);
-            srcColor.load(&(source._image.data[y + x]));
-            float clr = 0.299 * srcColor.R() + 0.587 * srcColor.G() + 0.114 * srcColor.B();
-            dstColor.set(clr, clr, clr, clr);
-            dstColor.save(&(dest._image.data[w + v]));
-        }
-    }
-
-    return eRcode_Ok;
-}
-
-/*static*/
-Rcode Png::convert(Png& dest, const Png& source, ColorFormat target) noexcept {
-    if (source._format == ColorFormat::A8 && target == ColorFormat::R8G8B8A8) {
-        return convert_A8_to_RGBA(dest, source);
-    }
-
-    if (source._format == ColorFormat::R8G8B8 && target == ColorFormat::A8) {
-        return convert_RGB_to_A8(dest, source);
-    }
-
-    ColorObject srcColor = ColorObject::FromFormat(source._format);
-    if (!srcColor.isValid()) {
-        return eRcode_InvalidInput;
-    }
-
-    ColorObject dstColor = ColorObject::FromFormat(target);
-    if (!dstColor.isValid()) {
-        return eRcode_InvalidInput;
-    }
-
-    dest._image.szrow = source._image.width * dstColor.size();
-    dest._image.width = source._image.width;
-    dest._image.height = source._image.height;
-    dest._format = target;
-    dest._image.szdata = source._image.width * source._image.height * dstColor.size();
-    dest._image.data = new byte[dest._image.szdata];
-    if (!dest._image.data) {
-        return eRcode_MemError;
-    }
-
-    for ( u32 y = 0, w = 0
-        ; y < source._image.height * source._image.szrow
-        ; y += source._image.szrow, w += dest._image.szrow)
-    {
-        for ( u32 x = 0, v = 0
-            ; x < source._image.width * srcColor.size()
-            ; x += srcColor.size(), v += dstColor.size())
-        {
-            assert(y + x < source._image.szdata);
-            assert(w + v < dest._image.szdata);
-            srcColor.load(&(source._image.data[y + x]));
-            dstColor.set(srcColor.R(), srcColor.G(), srcColor.B(), srcColor.A());
-            dstColor.save(&(dest._image.data[w + v]));
-        }
-    }
+    convert_rows_t rows{ &converter, dest._image.data, dest._image.szrow
+                       , source._image.data, source._image.szrow, source._image.width };
+    convert_rows(rows, source._image.height, jobs);
 
     return eRcode_Ok;
 }
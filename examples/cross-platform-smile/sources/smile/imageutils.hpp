@@ -3,6 +3,11 @@
 #include "smile/smile.h"
 
 
+namespace smile {
+class JobSystem;
+}
+
+
 namespace imageutils {
 
 enum class ColorFormat {
@@ -21,7 +26,16 @@ public:
    ~Png() noexcept;
     
     Rcode load(const AssetData& asset) noexcept;
+    Rcode load(const AssetData& asset, ColorFormat target) noexcept;
+    // Large images are decoded whole and converted as convert() does.
+    Rcode load(const AssetData& asset, ColorFormat target, smile::JobSystem& jobs) noexcept;
     Rcode convert(ColorFormat target) noexcept;
+    // Converts row bands as jobs (small images on the calling thread); the
+    // result is identical to the single threaded one.
+    Rcode convert(ColorFormat target, smile::JobSystem& jobs) noexcept;
+
+    // makes an image of the format with its pixels left undefined
+    Rcode create(u32 width, u32 height, ColorFormat format) noexcept;
     
     ImageData& image() noexcept { return _image; }
     const ImageData& image() const noexcept { return _image; }
@@ -31,9 +45,9 @@ public:
 private:
     static void swap(Png& a, Png& b) noexcept;
 
-    static Rcode convert_A8_to_RGBA(Png& dest, const Png& source) noexcept;
-    static Rcode convert_RGB_to_A8(Png& dest, const Png& source) noexcept;
-    static Rcode convert(Png& dest, const Png& source, ColorFormat target) noexcept;
+    static Rcode convert(Png& dest, const Png& source, ColorFormat target, smile::JobSystem* jobs) noexcept;
+
+    Rcode decode(const AssetData& asset, ColorFormat target, smile::JobSystem* jobs) noexcept;
     
     ImageData _image;
     ColorFormat _format;
@@ -0,0 +1,106 @@
+#ifndef SMILE_APITRACE_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Trace of the graphics calls of the platform api, to replay the workload of
+// the engine on a backend with no game logic running:
+//
+//   ApiTraceHeader | record...
+//
+// A record is a one byte ApiTraceOp followed by its u32 arguments (the
+// buffers and the textures are numbered in the order they are created) and
+// the payload: the committed bytes of CommitShaderBuffer and the pixels of
+// CreateTextureFromImage. Frame ends the calls of a frame.
+
+constexpr u32 kApiTraceMagic = 0x54414D53; // 'SMAT'
+constexpr u32 kApiTraceVersion = 1;
+
+
+enum class ApiTraceOp : byte {
+    CreateShaderBuffer = 1  // buffer, size, type
+,   ReleaseShaderBuffer     // buffer
+,   GetShaderBufferContent  // buffer
+,   CommitShaderBuffer      // buffer, offset, size, bytes[size]
+,   SetVertexBuffer         // buffer, offset
+,   DrawIndexedPrimitive    // indices, instances, index buffer
+,   CreateTextureFromImage  // texture, width, height, szrow, szdata, bytes[szdata]
+,   ReleaseTexture          // texture
+,   SetTextureSlot          // texture
+,   SetClearColor           // r, g, b (f32 bits)
+,   Frame
+};
+
+
+struct ApiTraceHeader {
+    u32 magic;
+    u32 version;
+};
+
+static_assert(sizeof(ApiTraceHeader) == 8, "ApiTraceHeader is stored as is");
+
+
+// Replaces the graphics functions of the api with ones which write the calls
+// into the trace file and pass them to the replaced ones. One capture at a
+// time, of the rendering thread.
+Rcode StartApiCapture(PlatformApi& api, const char* path) noexcept;
+// ends the frame in the trace
+Rcode MarkApiCaptureFrame() noexcept;
+// Restores the api and closes the trace, InternalError if it failed to write.
+Rcode StopApiCapture(PlatformApi& api) noexcept;
+
+
+// Plays a trace back into the graphics functions of an api frame by frame.
+class ApiTracePlayer {
+    ApiTracePlayer(const ApiTracePlayer&) = delete;
+    ApiTracePlayer& operator = (const ApiTracePlayer&) = delete;
+
+public:
+    ApiTracePlayer() noexcept;
+   ~ApiTracePlayer() noexcept;
+
+    // reads the whole trace into memory
+    Rcode open(const char* path) noexcept;
+    // Releases what the trace left alive with the api of the last play.
+    void close() noexcept;
+
+    u64 nbFrames() const noexcept { return _nbFrames; }
+    bool finished() const noexcept { return _cursor == _trace.size(); }
+
+    // Plays the calls up to the end of the next frame, Already if there are
+    // none left.
+    Rcode playFrame(const PlatformApi& api, GraphContextPtr graph, FrameEncoderPtr encoder) noexcept;
+
+private:
+    bool read(u32& value) noexcept;
+    bool skip(u32 size, const byte*& bytes) noexcept;
+
+    Rcode playCall(ApiTraceOp op, GraphContextPtr graph, FrameEncoderPtr encoder) noexcept;
+
+    std::vector<byte> _trace;
+    size_t _cursor;
+    u64 _nbFrames;
+
+    PlatformApi _api; // of the last play
+
+    struct Buffer {
+        ShaderBufferPtr ptr{nullptr};
+        u32 size{0};
+        byte* contents{nullptr}; // the last handed out
+    };
+    std::vector<Buffer> _buffers;
+    std::vector<TextureDataPtr> _textures;
+};
+
+
+}
+
+
+#define SMILE_APITRACE_HPP_
+#endif
@@ -0,0 +1,82 @@
+#ifndef SMILE_ASSETPACK_HPP_
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Asset pack is a single file baked at build time (see tools/bake-assets):
+//
+//   AssetPackHeader | AssetPackEntry[nb_entries] | entry data...
+//
+// Entries are sorted by name, entry data is aligned to kAssetPackAlignment.
+// Textures are stored already converted and flipped, exactly the way
+// imageutils::Png::load leaves them.
+
+constexpr u32 kAssetPackMagic = 0x4B504D53; // 'SMPK'
+constexpr u32 kAssetPackVersion = 1;
+constexpr u32 kAssetPackAlignment = 16;
+constexpr u32 kMaxAssetPackName = 104;
+
+
+enum class AssetPackKind : u32 {
+    Raw = 0
+,   Texture
+};
+
+
+struct AssetPackHeader {
+    u32 magic;
+    u32 version;
+    u32 pixelconv_version; // of the converter the textures were baked with
+    u32 nb_entries;
+};
+
+struct AssetPackEntry {
+    char name[kMaxAssetPackName]; // zero terminated
+    u32 kind;                     // AssetPackKind
+    u32 offset;
+    u32 size;
+    u32 format;                   // imageutils::ColorFormat of textures
+    u32 width;
+    u32 height;
+    u32 szrow;
+    u32 reserved;
+};
+
+static_assert(sizeof(AssetPackHeader) == 16, "AssetPackHeader is stored as is");
+static_assert(sizeof(AssetPackEntry) == 136, "AssetPackEntry is stored as is");
+
+
+// Read-only view of a pack in memory; the memory must outlive the view.
+class AssetPack {
+public:
+    AssetPack() noexcept;
+
+    Rcode open(const AssetData& pack) noexcept;
+    void close() noexcept;
+
+    bool isOpen() const noexcept { return nullptr != _entries; }
+
+    u32 pixelConvVersion() const noexcept { return _pixelconvVersion; }
+
+    const AssetPackEntry* find(const char* name) const noexcept;
+
+    bool raw(const char* name, AssetData& out) const noexcept;
+    bool texture(const char* name, u32 format, ImageData& out) const noexcept;
+
+private:
+    byte* _data;
+
+    const AssetPackEntry* _entries;
+    u32 _nbEntries;
+    u32 _pixelconvVersion;
+};
+
+
+}
+
+
+#define SMILE_ASSETPACK_HPP_
+#endif
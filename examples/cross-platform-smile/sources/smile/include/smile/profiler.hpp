@@ -0,0 +1,118 @@
+#ifndef SMILE_PROFILER_HPP_
+
+#include <atomic>
+
+#include "smile/smile.h"
+
+
+// SMILE_ZONE("name") records the time spent in the enclosing scope. The
+// zones are written into a per-thread ring of the last kZoneRingSize ones
+// with no locks, and dumped as Chrome trace JSON (chrome://tracing, Perfetto)
+// on demand. Built with SMILE_PROFILER=0 the zones are compiled out.
+#if !defined(SMILE_PROFILER)
+#   define SMILE_PROFILER 1
+#endif
+
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#endif
+
+
+namespace smile::profiler {
+
+
+constexpr u32 kZoneRingSize = 1u << 14; // zones per thread, power of two
+
+
+u64 TicksFallback() noexcept;
+
+// Ticks of the cheapest monotonic counter: the TSC on x86, the virtual
+// counter on ARM64, steady_clock nanoseconds elsewhere. The trace converts
+// them to time.
+inline u64 Ticks() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    u64 ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return TicksFallback();
+#endif
+}
+
+
+struct ZoneRecord {
+    const char* name; // static
+    u64 begin;        // ticks
+    u64 end;          // ticks
+};
+
+// Written by the owning thread only; the head is published with release so
+// a concurrent dump sees complete records.
+struct ZoneRing {
+    ZoneRecord records[kZoneRingSize];
+    std::atomic<u64> head{0};
+    const char* thread_name{nullptr};
+    u32 thread_index{0};
+};
+
+// of the calling thread, registered on the first use
+ZoneRing* ThisThreadRing() noexcept;
+
+inline void RecordZone(const char* name, u64 begin, u64 end) noexcept {
+    static thread_local ZoneRing* tls_ring = ThisThreadRing();
+    if (!tls_ring) {
+        return; // out of memory
+    }
+
+    const u64 head = tls_ring->head.load(std::memory_order_relaxed);
+    tls_ring->records[head & (kZoneRingSize - 1)] = ZoneRecord{name, begin, end};
+    tls_ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+class Zone {
+    Zone(const Zone&) = delete;
+    Zone& operator = (const Zone&) = delete;
+
+public:
+    explicit Zone(const char* name) noexcept : _name(name), _begin(Ticks()) {}
+   ~Zone() noexcept { RecordZone(_name, _begin, Ticks()); }
+
+private:
+    const char* _name;
+    u64 _begin;
+};
+
+
+// names the threads in the trace; the name must be static
+void SetThreadName(const char* name) noexcept;
+
+// Writes the zones recorded so far (the last kZoneRingSize ones of every
+// thread) as Chrome trace JSON. May run concurrently with the recording,
+// the zones overwritten meanwhile are skipped.
+Rcode WriteChromeTrace(const char* path) noexcept;
+
+
+}
+
+
+#define SMILE_ZONE_CONCAT_(A, B) A ## B
+#define SMILE_ZONE_CONCAT(A, B) SMILE_ZONE_CONCAT_(A, B)
+
+#if SMILE_PROFILER
+#   define SMILE_ZONE(Name) \
+        ::smile::profiler::Zone SMILE_ZONE_CONCAT(smile_zone_, __LINE__)(Name)
+#else
+#   define SMILE_ZONE(Name) do {} while (0)
+#endif
+
+
+#define SMILE_PROFILER_HPP_
+#endif
@@ -18,6 +18,7 @@ typedef uint8_t byte;
 typedef uint32_t u32;
 typedef int32_t i32;
 typedef uint16_t u16;
+typedef uint64_t u64;
 typedef float f32;
 typedef double f64;
 
@@ -46,6 +47,25 @@ typedef struct {
     u32 szrow;
 } ImageData;
 
+#define SMILE_MAX_GPU_TIMINGS 8
+
+// GPU time of a named part of a frame.
+typedef struct {
+    const char* name; // static
+    f64 time;         // sec
+} GpuTiming;
+
+// Timings of the latest frames. The GPU ones are measured by the platform
+// and lag a few frames behind, zero if the platform does not measure them.
+typedef struct {
+    f64 cpu_update;      // the last smile_Update, sec
+    f64 cpu_render;      // the last smile_Render, sec
+    u64 gpu_frame_index; // frame of the GPU timings, 0 if none yet
+    f64 gpu_frame;       // first to last GPU command of the frame, sec
+    u32 nb_gpu_timings;
+    GpuTiming gpu_timings[SMILE_MAX_GPU_TIMINGS];
+} FrameStats;
+
 struct SmileContextData;
 struct GraphContext;
 struct FrameEncoder;
@@ -80,6 +100,15 @@ typedef struct {
     Rcode (*ReleaseTexture)         (TextureDataPtr);
     Rcode (*SetTextureSlot)         (FrameEncoderPtr, TextureDataPtr);
     Rcode (*SetClearColor)          (FrameEncoderPtr, float, float, float);
+
+    // Optional (may be NULL): persistent cache of derived assets. A cached
+    // asset is released with FreeAsset; stored ones are the concatenation
+    // of the given chunks.
+    Rcode (*LoadCachedAsset)        (AssetData*, char*);
+    Rcode (*StoreCachedAsset)       (char*, const AssetData*, u32);
+
+    // Optional (may be NULL): fills the GPU timings of the stats.
+    Rcode (*GetGpuTimings)          (FrameStats*);
 } PlatformApi;
 
 typedef struct {
@@ -96,6 +125,13 @@ typedef struct {
     f32 boty;
 } GeomInstance;
 
+// Sprites drawn by the last smile_Render, one draw per texture.
+typedef struct {
+    u32 nb_draws;
+    u32 nb_sprites;
+    u32 max_sprites_per_draw;
+} SpriteStats;
+
 typedef enum {
     eResourcesState_Unloaded
 ,   eResourcesState_Loaded
@@ -106,6 +142,10 @@ typedef struct {
     PlatformApi platform_api;
     struct SmileContextData* pdata;
     ResourcesState resources_state;
+    AssetData asset_pack; // baked assets owned by the platform, may be empty
+    u32 nb_smileys;       // 0 means 1
+    u32 nb_threads;       // running the core jobs, the calling one included; 0 - one per core
+    u32 threaded_update;  // non-zero: smile_Update is called on a thread of its own
 } SmileContext;
 
 EXTERN_BEGIN
@@ -115,12 +155,17 @@ const char* smile_ToString(Rcode rc);
 Rcode smile_SetUp(SmileContext* pCtx);
 Rcode smile_TearDown(SmileContext* pCtx);
 
+// With threaded_update smile_Update may run concurrently with the rest of
+// the calls, but must be stopped before smile_TearDown.
 Rcode smile_Update(SmileContext* pCtx, float dT /*sec*/);
 Rcode smile_Render(SmileContext* pCtx, FrameEncoderPtr pEncoder);
 
 Rcode smile_ReloadResources(SmileContext* pCtx, GraphContextPtr pGraph);
 Rcode smile_UnloadResources(SmileContext* pCtx);
 
+Rcode smile_GetSpriteStats(SmileContext* pCtx, SpriteStats* pStats);
+Rcode smile_GetFrameStats(SmileContext* pCtx, FrameStats* pStats);
+
 EXTERN_END
 
 
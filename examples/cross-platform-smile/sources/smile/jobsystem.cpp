@@ -0,0 +1,284 @@
+#include "jobsystem.hpp"
+
+#include <algorithm>
+#include <new>
+#include <system_error>
+
+#include "smile/log.hpp"
+#include "smile/profiler.hpp"
+
+
+using namespace smile;
+
+
+namespace {
+
+// a full queue makes its owner run the job in place
+constexpr u32 kQueueCapacity = 1024;
+
+// parallelFor makes a few ranges per thread to balance uneven ranges
+constexpr u32 kRangesPerThread = 4;
+
+
+thread_local const JobSystem* tls_system = nullptr;
+thread_local u32 tls_queue = 0;
+
+}
+
+
+struct alignas(64) JobSystem::Queue {
+    std::mutex mutex;
+
+    Job jobs[kQueueCapacity];
+    u32 first{0}; // the oldest job
+    u32 size{0};
+};
+
+
+JobSystem::JobSystem() noexcept
+    : _nbQueues(0), _nbWorkers(0), _nbQueued(0), _quit(false)
+{}
+
+
+JobSystem::~JobSystem() noexcept {
+    tearDown();
+}
+
+
+Rcode JobSystem::setUp(u32 nbThreads) noexcept {
+    if (_queues) {
+        return eRcode_Already;
+    }
+
+    if (0 == nbThreads) {
+        nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const u32 nbWorkers = nbThreads - 1;
+
+    try {
+        _queues = std::make_unique<Queue[]>(nbWorkers + 1);
+        _workers.reserve(nbWorkers);
+    } catch (std::bad_alloc&) {
+        _queues.reset();
+        return eRcode_MemError;
+    }
+
+    _nbQueues = nbWorkers + 1;
+    _nbQueued.store(0, std::memory_order_relaxed);
+    _quit = false;
+
+    for (u32 i = 1; i <= nbWorkers; ++i) {
+        try {
+            _workers.emplace_back(&JobSystem::work, this, i);
+        } catch (std::system_error& e) {
+            SMILE_LOG(Warning) << "Started " << _workers.size() << " of " << nbWorkers
+                               << " job workers: " << e.what();
+            break;
+        }
+    }
+
+    _nbWorkers = static_cast<u32>(_workers.size());
+
+    return eRcode_Ok;
+}
+
+
+void JobSystem::tearDown() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+
+    _workers.clear();
+    _nbWorkers = 0;
+
+    _queues.reset();
+    _nbQueues = 0;
+}
+
+
+void JobSystem::run(JobFunction fn, void* arg, u32 begin, u32 end, JobCounter& counter) noexcept {
+    counter._value.fetch_add(1, std::memory_order_relaxed);
+
+    const Job job{fn, arg, begin, end, &counter};
+    if (!push(queueIndex(), job)) {
+        execute(job);
+        return;
+    }
+
+    wakeUp(1);
+}
+
+
+void JobSystem::parallelFor(u32 count, u32 grain, JobFunction fn, void* arg, JobCounter& counter) noexcept {
+    if (0 == count) {
+        return;
+    }
+
+    grain = std::max(grain, 1u);
+
+    const u64 nbGrains = (static_cast<u64>(count) + grain - 1) / grain;
+    const u32 nbRanges = static_cast<u32>(std::min<u64>(nbGrains, nbThreads() * kRangesPerThread));
+    const u32 szRange = static_cast<u32>((static_cast<u64>(count) + nbRanges - 1) / nbRanges);
+
+    // all of the ranges are counted before any of them can finish
+    counter._value.fetch_add(nbRanges, std::memory_order_relaxed);
+
+    const u32 index = queueIndex();
+
+    u32 nbQueued = 0;
+    for (u32 begin = 0; begin < count; begin += szRange) {
+        const Job job{fn, arg, begin, std::min(count, begin + szRange), &counter};
+        if (push(index, job)) {
+            ++nbQueued;
+        } else {
+            execute(job);
+        }
+    }
+
+    wakeUp(nbQueued);
+}
+
+
+void JobSystem::wait(JobCounter& counter) noexcept {
+    const u32 index = queueIndex();
+
+    while (!counter.done()) {
+        Job job;
+        if (pop(index, job) || steal(index, job)) {
+            execute(job);
+        } else {
+            // the rest of the jobs are being run by the workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+u32 JobSystem::queueIndex() const noexcept {
+    return this == tls_system ? tls_queue : 0;
+}
+
+
+bool JobSystem::push(u32 index, const Job& job) noexcept {
+    if (!_queues) {
+        return false;
+    }
+
+    Queue& queue = _queues[index];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (kQueueCapacity == queue.size) {
+        return false;
+    }
+
+    queue.jobs[(queue.first + queue.size) % kQueueCapacity] = job;
+    ++queue.size;
+
+    _nbQueued.fetch_add(1, std::memory_order_release);
+
+    return true;
+}
+
+
+bool JobSystem::pop(u32 index, Job& job) noexcept {
+    if (!_queues) {
+        return false;
+    }
+
+    Queue& queue = _queues[index];
+
+    // the newest job, its data is likely still in the cache
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (0 == queue.size) {
+        return false;
+    }
+
+    --queue.size;
+    job = queue.jobs[(queue.first + queue.size) % kQueueCapacity];
+
+    _nbQueued.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+
+bool JobSystem::steal(u32 index, Job& job) noexcept {
+    for (u32 k = 1; k < _nbQueues; ++k) {
+        Queue& queue = _queues[(index + k) % _nbQueues];
+
+        // the oldest job, likely the largest piece of the work left
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (0 == queue.size) {
+            continue;
+        }
+
+        job = queue.jobs[queue.first];
+        queue.first = (queue.first + 1) % kQueueCapacity;
+        --queue.size;
+
+        _nbQueued.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    return false;
+}
+
+
+void JobSystem::execute(const Job& job) noexcept {
+    job.fn(job.arg, job.begin, job.end);
+    job.counter->_value.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+
+void JobSystem::wakeUp(u32 nbJobs) noexcept {
+    if (0 == _nbWorkers || 0 == nbJobs) {
+        return;
+    }
+
+    // a worker checks for jobs under the lock before going to sleep, so
+    // taking it here makes sure the worker either sees the jobs or sleeps
+    // already and gets notified
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+    }
+
+    if (1 == nbJobs) {
+        _wake.notify_one();
+    } else {
+        _wake.notify_all();
+    }
+}
+
+
+void JobSystem::work(u32 index) noexcept {
+    tls_system = this;
+    tls_queue = index;
+
+    smile::profiler::SetThreadName("job worker");
+
+    for (;;) {
+        Job job;
+        if (pop(index, job) || steal(index, job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait(lock, [this]() {
+            return _quit || _nbQueued.load(std::memory_order_acquire) > 0;
+        });
+
+        if (_quit) {
+            break;
+        }
+    }
+
+    tls_system = nullptr;
+}
@@ -0,0 +1,108 @@
+#ifndef SMILE_JOBSYSTEM_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Number of unfinished jobs; a job decrements its counter when done, so a
+// stage depending on the jobs waits for their counter to drop to zero.
+class JobCounter {
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator = (const JobCounter&) = delete;
+
+public:
+    JobCounter() noexcept : _value(0) {}
+
+    bool done() const noexcept { return 0 == _value.load(std::memory_order_acquire); }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<u32> _value;
+};
+
+
+// Processes items [begin, end) of whatever arg points to.
+typedef void (*JobFunction)(void* arg, u32 begin, u32 end);
+
+struct Job {
+    JobFunction fn;
+    void* arg;
+    u32 begin;
+    u32 end;
+    JobCounter* counter;
+};
+
+
+// Work-stealing job system: every worker thread owns a deque of jobs, it
+// takes the newest jobs from its own deque and steals the oldest ones from
+// the others when it runs dry. Threads which are not workers (like the one
+// owning the graphics context) share one more deque and run jobs while
+// waiting for a counter, so a system with no workers runs everything on the
+// waiting thread.
+class JobSystem {
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator = (const JobSystem&) = delete;
+
+public:
+    JobSystem() noexcept;
+   ~JobSystem() noexcept;
+
+    // nbThreads counts the waiting thread too, 0 - one thread per core
+    Rcode setUp(u32 nbThreads) noexcept;
+    void tearDown() noexcept;
+
+    u32 nbThreads() const noexcept { return _nbWorkers + 1; }
+    u32 nbWorkers() const noexcept { return _nbWorkers; }
+
+    void run(JobFunction fn, void* arg, u32 begin, u32 end, JobCounter& counter) noexcept;
+
+    // splits [0, count) into ranges of at least 'grain' items, a job per range
+    void parallelFor(u32 count, u32 grain, JobFunction fn, void* arg, JobCounter& counter) noexcept;
+
+    // runs the queued jobs until the counter drops to zero
+    void wait(JobCounter& counter) noexcept;
+
+private:
+    struct Queue;
+
+    u32 queueIndex() const noexcept;
+
+    bool push(u32 index, const Job& job) noexcept;
+    bool pop(u32 index, Job& job) noexcept;
+    bool steal(u32 index, Job& job) noexcept;
+
+    void execute(const Job& job) noexcept;
+    void wakeUp(u32 nbJobs) noexcept;
+
+    void work(u32 index) noexcept;
+
+    std::unique_ptr<Queue[]> _queues;
+    u32 _nbQueues;
+
+    std::vector<std::thread> _workers;
+    u32 _nbWorkers;
+
+    // jobs sitting in the queues, the workers sleep while there are none
+    std::atomic<u32> _nbQueued;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _quit;
+};
+
+
+}
+
+
+#define SMILE_JOBSYSTEM_HPP_
+#endif
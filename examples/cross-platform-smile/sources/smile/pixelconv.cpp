@@ -0,0 +1,659 @@
+#include "pixelconv.hpp"
+
+#include <array>
+#include <cstring>
+#include <utility>
+
+#include "cpu.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#   define PIXELCONV_X86_64 1
+#   include <immintrin.h>
+#   if defined(_MSC_VER) && !defined(__clang__)
+#       define PIXELCONV_TARGET_AVX2
+#   else
+#       define PIXELCONV_TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#   define PIXELCONV_NEON 1
+#   include <arm_neon.h>
+#endif
+
+
+using namespace imageutils;
+
+
+namespace {
+
+
+// NOTE: all supported platforms are little-endian, so a pixel of 'Size' bytes
+//       is the low part of the native u32 value (the same way ColorObject
+//       used to read u8/u16/u32 values).
+template <u32 Size>
+inline u32 load_pixel(const byte* p) noexcept {
+    u32 v = 0;
+    std::memcpy(&v, p, Size);
+    return v;
+}
+
+
+template <u32 Size>
+inline void store_pixel(byte* p, u32 v) noexcept {
+    std::memcpy(p, &v, Size);
+}
+
+
+// Channel values never exceed 255, so clamping is only needed for the target
+// channels which are narrower than 8 bits.
+template <class C, u32 c>
+inline constexpr bool kNeedsClamp = C::target.mask[c] != 0 && C::target.mask[c] < 255;
+
+
+template <class C, u32 c>
+inline u32 extract(u32 v) noexcept {
+    if constexpr (C::source.mask[c] == 0) {
+        return 0;
+    } else {
+        return (v >> C::source.shift[c]) & C::source.mask[c];
+    }
+}
+
+
+template <class C, u32 c>
+inline u32 place(u32 v) noexcept {
+    if constexpr (C::target.mask[c] == 0) {
+        return 0;
+    } else if constexpr (kNeedsClamp<C, c>) {
+        return (v < C::target.mask[c] ? v : C::target.mask[c]) << C::target.shift[c];
+    } else {
+        return v << C::target.shift[c];
+    }
+}
+
+
+template <class C>
+inline u32 pack(u32 r, u32 g, u32 b, u32 a) noexcept {
+    return place<C, 0>(r) | place<C, 1>(g) | place<C, 2>(b) | place<C, 3>(a);
+}
+
+
+inline u32 luma(u32 r, u32 g, u32 b) noexcept {
+    // double math rounded to float and truncated: SIMD kernels repeat exactly
+    // the same steps in the same order to produce identical results.
+    float clr = 0.299 * r + 0.587 * g + 0.114 * b;
+    return static_cast<byte>(clr);
+}
+
+
+template <class C>
+inline u32 convert_pixel(u32 v) noexcept {
+    if constexpr (C::mode == ConvertMode::AlphaToGray) {
+        u32 a = extract<C, 3>(v);
+        return pack<C>(a, a, a, 255);
+    } else if constexpr (C::mode == ConvertMode::Luma) {
+        u32 l = luma(extract<C, 0>(v), extract<C, 1>(v), extract<C, 2>(v));
+        return pack<C>(l, l, l, l);
+    } else {
+        return pack<C>(extract<C, 0>(v), extract<C, 1>(v), extract<C, 2>(v), extract<C, 3>(v));
+    }
+}
+
+
+template <class C>
+struct ScalarKernel {
+    static constexpr u32 S = C::source.size;
+    static constexpr u32 D = C::target.size;
+
+    static void run(byte* dst, const byte* src, u32 width) noexcept {
+        for (u32 x = 0; x < width; ++x, src += S, dst += D) {
+            store_pixel<D>(dst, convert_pixel<C>(load_pixel<S>(src)));
+        }
+    }
+};
+
+
+template <class C>
+void copy_row(byte* dst, const byte* src, u32 width) noexcept {
+    std::memcpy(dst, src, width * C::source.size);
+}
+
+
+#if defined(PIXELCONV_X86_64)
+
+template <u32 S>
+inline __m128i sse2_load(const byte* p) noexcept {
+    if constexpr (S == 4) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    } else if constexpr (S == 2) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+        return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    } else if constexpr (S == 1) {
+        __m128i v = _mm_cvtsi32_si128(static_cast<int>(load_pixel<4>(p)));
+        v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+        return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    } else {
+        return _mm_setr_epi32( static_cast<int>(load_pixel<S>(p))
+                             , static_cast<int>(load_pixel<S>(p + S))
+                             , static_cast<int>(load_pixel<S>(p + 2*S))
+                             , static_cast<int>(load_pixel<S>(p + 3*S)));
+    }
+}
+
+
+template <u32 D>
+inline void sse2_store(byte* p, __m128i v) noexcept {
+    if constexpr (D == 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+    } else if constexpr (D == 2) {
+        // sign-extend low halves so that the signed saturation keeps them
+        v = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(v, v));
+    } else if constexpr (D == 1) {
+        v = _mm_packs_epi32(v, v);
+        store_pixel<4>(p, static_cast<u32>(_mm_cvtsi128_si32(_mm_packus_epi16(v, v))));
+    } else {
+        alignas(16) u32 tmp[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(tmp), v);
+        for (u32 i = 0; i < 4; ++i) {
+            store_pixel<D>(p + i*D, tmp[i]);
+        }
+    }
+}
+
+
+template <class C, u32 c>
+inline __m128i sse2_extract(__m128i v) noexcept {
+    if constexpr (C::source.mask[c] == 0) {
+        return _mm_setzero_si128();
+    } else {
+        return _mm_and_si128( _mm_srli_epi32(v, C::source.shift[c])
+                            , _mm_set1_epi32(static_cast<int>(C::source.mask[c])));
+    }
+}
+
+
+// The upper halves of the 32-bit lanes are zero, so the signed 16-bit minimum
+// is the same as the 32-bit one (which SSE2 lacks).
+template <class C, u32 c>
+inline __m128i sse2_place(__m128i v) noexcept {
+    if constexpr (C::target.mask[c] == 0) {
+        return _mm_setzero_si128();
+    } else if constexpr (kNeedsClamp<C, c>) {
+        v = _mm_min_epi16(v, _mm_set1_epi32(static_cast<int>(C::target.mask[c])));
+        return _mm_slli_epi32(v, C::target.shift[c]);
+    } else {
+        return _mm_slli_epi32(v, C::target.shift[c]);
+    }
+}
+
+
+template <class C>
+inline __m128i sse2_pack(__m128i r, __m128i g, __m128i b, __m128i a) noexcept {
+    return _mm_or_si128( _mm_or_si128(sse2_place<C, 0>(r), sse2_place<C, 1>(g))
+                       , _mm_or_si128(sse2_place<C, 2>(b), sse2_place<C, 3>(a)));
+}
+
+
+inline __m128d sse2_luma_pd(__m128i r, __m128i g, __m128i b) noexcept {
+    __m128d v = _mm_add_pd( _mm_mul_pd(_mm_set1_pd(0.299), _mm_cvtepi32_pd(r))
+                          , _mm_mul_pd(_mm_set1_pd(0.587), _mm_cvtepi32_pd(g)));
+    return _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(0.114), _mm_cvtepi32_pd(b)));
+}
+
+
+inline __m128i sse2_luma(__m128i r, __m128i g, __m128i b) noexcept {
+    __m128 lo = _mm_cvtpd_ps(sse2_luma_pd(r, g, b));
+    __m128 hi = _mm_cvtpd_ps(sse2_luma_pd( _mm_shuffle_epi32(r, 0xEE)
+                                         , _mm_shuffle_epi32(g, 0xEE)
+                                         , _mm_shuffle_epi32(b, 0xEE)));
+    return _mm_cvttps_epi32(_mm_movelh_ps(lo, hi));
+}
+
+
+template <class C>
+inline __m128i sse2_convert(__m128i v) noexcept {
+    if constexpr (C::mode == ConvertMode::AlphaToGray) {
+        __m128i a = sse2_extract<C, 3>(v);
+        return sse2_pack<C>(a, a, a, _mm_set1_epi32(255));
+    } else if constexpr (C::mode == ConvertMode::Luma) {
+        __m128i l = sse2_luma(sse2_extract<C, 0>(v), sse2_extract<C, 1>(v), sse2_extract<C, 2>(v));
+        return sse2_pack<C>(l, l, l, l);
+    } else {
+        return sse2_pack<C>( sse2_extract<C, 0>(v), sse2_extract<C, 1>(v)
+                           , sse2_extract<C, 2>(v), sse2_extract<C, 3>(v));
+    }
+}
+
+
+template <class C>
+struct Sse2Kernel {
+    static constexpr u32 S = C::source.size;
+    static constexpr u32 D = C::target.size;
+
+    static void run(byte* dst, const byte* src, u32 width) noexcept {
+        u32 x = 0;
+        for (; x + 4 <= width; x += 4, src += 4*S, dst += 4*D) {
+            sse2_store<D>(dst, sse2_convert<C>(sse2_load<S>(src)));
+        }
+
+        ScalarKernel<C>::run(dst, src, width - x);
+    }
+};
+
+
+template <u32 S>
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_load(const byte* p) noexcept {
+    if constexpr (S == 4) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    } else if constexpr (S == 2) {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    } else if constexpr (S == 1) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    } else {
+        const __m256i kUnpack = _mm256_setr_epi8(
+             0,  1,  2, -1,  3,  4,  5, -1,  6,  7,  8, -1,  9, 10, 11, -1,
+             0,  1,  2, -1,  3,  4,  5, -1,  6,  7,  8, -1,  9, 10, 11, -1);
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4*S));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        return _mm256_shuffle_epi8(v, kUnpack);
+    }
+}
+
+
+template <u32 D>
+PIXELCONV_TARGET_AVX2
+inline void avx2_store(byte* p, __m256i v) noexcept {
+    if constexpr (D == 4) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+    } else if constexpr (D == 2) {
+        __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), w);
+    } else if constexpr (D == 1) {
+        __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(w, w));
+    } else {
+        const __m256i kPack = _mm256_setr_epi8(
+             0,  1,  2,  4,  5,  6,  8,  9, 10, 12, 13, 14, -1, -1, -1, -1,
+             0,  1,  2,  4,  5,  6,  8,  9, 10, 12, 13, 14, -1, -1, -1, -1);
+        v = _mm256_shuffle_epi8(v, kPack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 4*D), _mm256_extracti128_si256(v, 1));
+    }
+}
+
+
+template <class C, u32 c>
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_extract(__m256i v) noexcept {
+    if constexpr (C::source.mask[c] == 0) {
+        return _mm256_setzero_si256();
+    } else {
+        return _mm256_and_si256( _mm256_srli_epi32(v, C::source.shift[c])
+                               , _mm256_set1_epi32(static_cast<int>(C::source.mask[c])));
+    }
+}
+
+
+template <class C, u32 c>
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_place(__m256i v) noexcept {
+    if constexpr (C::target.mask[c] == 0) {
+        return _mm256_setzero_si256();
+    } else if constexpr (kNeedsClamp<C, c>) {
+        v = _mm256_min_epu32(v, _mm256_set1_epi32(static_cast<int>(C::target.mask[c])));
+        return _mm256_slli_epi32(v, C::target.shift[c]);
+    } else {
+        return _mm256_slli_epi32(v, C::target.shift[c]);
+    }
+}
+
+
+template <class C>
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_pack(__m256i r, __m256i g, __m256i b, __m256i a) noexcept {
+    return _mm256_or_si256( _mm256_or_si256(avx2_place<C, 0>(r), avx2_place<C, 1>(g))
+                          , _mm256_or_si256(avx2_place<C, 2>(b), avx2_place<C, 3>(a)));
+}
+
+
+PIXELCONV_TARGET_AVX2
+inline __m128 avx2_luma_ps(__m128i r, __m128i g, __m128i b) noexcept {
+    __m256d v = _mm256_add_pd( _mm256_mul_pd(_mm256_set1_pd(0.299), _mm256_cvtepi32_pd(r))
+                             , _mm256_mul_pd(_mm256_set1_pd(0.587), _mm256_cvtepi32_pd(g)));
+    v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_set1_pd(0.114), _mm256_cvtepi32_pd(b)));
+    return _mm256_cvtpd_ps(v);
+}
+
+
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_luma(__m256i r, __m256i g, __m256i b) noexcept {
+    __m128 lo = avx2_luma_ps( _mm256_castsi256_si128(r)
+                            , _mm256_castsi256_si128(g)
+                            , _mm256_castsi256_si128(b));
+    __m128 hi = avx2_luma_ps( _mm256_extracti128_si256(r, 1)
+                            , _mm256_extracti128_si256(g, 1)
+                            , _mm256_extracti128_si256(b, 1));
+    return _mm256_cvttps_epi32(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+}
+
+
+template <class C>
+PIXELCONV_TARGET_AVX2
+inline __m256i avx2_convert(__m256i v) noexcept {
+    if constexpr (C::mode == ConvertMode::AlphaToGray) {
+        __m256i a = avx2_extract<C, 3>(v);
+        return avx2_pack<C>(a, a, a, _mm256_set1_epi32(255));
+    } else if constexpr (C::mode == ConvertMode::Luma) {
+        __m256i l = avx2_luma(avx2_extract<C, 0>(v), avx2_extract<C, 1>(v), avx2_extract<C, 2>(v));
+        return avx2_pack<C>(l, l, l, l);
+    } else {
+        return avx2_pack<C>( avx2_extract<C, 0>(v), avx2_extract<C, 1>(v)
+                           , avx2_extract<C, 2>(v), avx2_extract<C, 3>(v));
+    }
+}
+
+
+template <class C>
+struct Avx2Kernel {
+    static constexpr u32 S = C::source.size;
+    static constexpr u32 D = C::target.size;
+
+    // 3-byte pixels are moved with full 16-byte loads and stores, so the loop
+    // has to stop a couple of pixels before the end of the row.
+    static constexpr u32 kOverrun = (S == 3 || D == 3) ? 2 : 0;
+
+    PIXELCONV_TARGET_AVX2
+    static void run(byte* dst, const byte* src, u32 width) noexcept {
+        u32 x = 0;
+        for (; x + 8 + kOverrun <= width; x += 8, src += 8*S, dst += 8*D) {
+            avx2_store<D>(dst, avx2_convert<C>(avx2_load<S>(src)));
+        }
+
+        ScalarKernel<C>::run(dst, src, width - x);
+    }
+};
+
+#endif // PIXELCONV_X86_64
+
+
+#if defined(PIXELCONV_NEON)
+
+template <u32 S>
+inline uint32x4_t neon_load(const byte* p) noexcept {
+    if constexpr (S == 4) {
+        return vreinterpretq_u32_u8(vld1q_u8(p));
+    } else if constexpr (S == 2) {
+        return vmovl_u16(vreinterpret_u16_u8(vld1_u8(p)));
+    } else if constexpr (S == 1) {
+        uint8x8_t v = vreinterpret_u8_u32(vdup_n_u32(load_pixel<4>(p)));
+        return vmovl_u16(vget_low_u16(vmovl_u8(v)));
+    } else {
+        alignas(16) u32 tmp[4] = {
+            load_pixel<S>(p), load_pixel<S>(p + S), load_pixel<S>(p + 2*S), load_pixel<S>(p + 3*S)
+        };
+        return vld1q_u32(tmp);
+    }
+}
+
+
+template <u32 D>
+inline void neon_store(byte* p, uint32x4_t v) noexcept {
+    if constexpr (D == 4) {
+        vst1q_u8(p, vreinterpretq_u8_u32(v));
+    } else if constexpr (D == 2) {
+        vst1_u8(p, vreinterpret_u8_u16(vmovn_u32(v)));
+    } else if constexpr (D == 1) {
+        uint16x4_t w = vmovn_u32(v);
+        uint8x8_t b = vmovn_u16(vcombine_u16(w, w));
+        store_pixel<4>(p, vget_lane_u32(vreinterpret_u32_u8(b), 0));
+    } else {
+        alignas(16) u32 tmp[4];
+        vst1q_u32(tmp, v);
+        for (u32 i = 0; i < 4; ++i) {
+            store_pixel<D>(p + i*D, tmp[i]);
+        }
+    }
+}
+
+
+template <class C, u32 c>
+inline uint32x4_t neon_extract(uint32x4_t v) noexcept {
+    if constexpr (C::source.mask[c] == 0) {
+        return vdupq_n_u32(0);
+    } else {
+        return vandq_u32( vshlq_u32(v, vdupq_n_s32(-static_cast<i32>(C::source.shift[c])))
+                        , vdupq_n_u32(C::source.mask[c]));
+    }
+}
+
+
+template <class C, u32 c>
+inline uint32x4_t neon_place(uint32x4_t v) noexcept {
+    if constexpr (C::target.mask[c] == 0) {
+        return vdupq_n_u32(0);
+    } else {
+        if constexpr (kNeedsClamp<C, c>) {
+            v = vminq_u32(v, vdupq_n_u32(C::target.mask[c]));
+        }
+        return vshlq_u32(v, vdupq_n_s32(static_cast<i32>(C::target.shift[c])));
+    }
+}
+
+
+template <class C>
+inline uint32x4_t neon_pack(uint32x4_t r, uint32x4_t g, uint32x4_t b, uint32x4_t a) noexcept {
+    return vorrq_u32( vorrq_u32(neon_place<C, 0>(r), neon_place<C, 1>(g))
+                    , vorrq_u32(neon_place<C, 2>(b), neon_place<C, 3>(a)));
+}
+
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+inline float32x2_t neon_luma_ps(uint32x2_t r, uint32x2_t g, uint32x2_t b) noexcept {
+    float64x2_t v = vaddq_f64( vmulq_f64(vdupq_n_f64(0.299), vcvtq_f64_u64(vmovl_u32(r)))
+                             , vmulq_f64(vdupq_n_f64(0.587), vcvtq_f64_u64(vmovl_u32(g))));
+    v = vaddq_f64(v, vmulq_f64(vdupq_n_f64(0.114), vcvtq_f64_u64(vmovl_u32(b))));
+    return vcvt_f32_f64(v);
+}
+
+
+inline uint32x4_t neon_luma(uint32x4_t r, uint32x4_t g, uint32x4_t b) noexcept {
+    float32x2_t lo = neon_luma_ps(vget_low_u32(r), vget_low_u32(g), vget_low_u32(b));
+    float32x2_t hi = neon_luma_ps(vget_high_u32(r), vget_high_u32(g), vget_high_u32(b));
+    return vcvtq_u32_f32(vcombine_f32(lo, hi));
+}
+#else
+// no double precision vectors on 32-bit ARM
+inline uint32x4_t neon_luma(uint32x4_t r, uint32x4_t g, uint32x4_t b) noexcept {
+    alignas(16) u32 rs[4], gs[4], bs[4];
+    vst1q_u32(rs, r);
+    vst1q_u32(gs, g);
+    vst1q_u32(bs, b);
+    for (u32 i = 0; i < 4; ++i) {
+        rs[i] = luma(rs[i], gs[i], bs[i]);
+    }
+    return vld1q_u32(rs);
+}
+#endif
+
+
+template <class C>
+inline uint32x4_t neon_convert(uint32x4_t v) noexcept {
+    if constexpr (C::mode == ConvertMode::AlphaToGray) {
+        uint32x4_t a = neon_extract<C, 3>(v);
+        return neon_pack<C>(a, a, a, vdupq_n_u32(255));
+    } else if constexpr (C::mode == ConvertMode::Luma) {
+        uint32x4_t l = neon_luma(neon_extract<C, 0>(v), neon_extract<C, 1>(v), neon_extract<C, 2>(v));
+        return neon_pack<C>(l, l, l, l);
+    } else {
+        return neon_pack<C>( neon_extract<C, 0>(v), neon_extract<C, 1>(v)
+                           , neon_extract<C, 2>(v), neon_extract<C, 3>(v));
+    }
+}
+
+
+template <class C>
+struct NeonKernel {
+    static constexpr u32 S = C::source.size;
+    static constexpr u32 D = C::target.size;
+
+    static void run(byte* dst, const byte* src, u32 width) noexcept {
+        u32 x = 0;
+        for (; x + 4 <= width; x += 4, src += 4*S, dst += 4*D) {
+            neon_store<D>(dst, neon_convert<C>(neon_load<S>(src)));
+        }
+
+        ScalarKernel<C>::run(dst, src, width - x);
+    }
+};
+
+#endif // PIXELCONV_NEON
+
+
+constexpr std::size_t kNbFormats = static_cast<std::size_t>(ColorFormat::A8) + 1;
+
+using KernelTable = std::array<RowConverter::Kernel, kNbFormats * kNbFormats>;
+
+
+template <template <class> class K, ColorFormat Src, ColorFormat Dst>
+constexpr RowConverter::Kernel kernel_for() noexcept {
+    if constexpr (Src == ColorFormat::Undefined || Dst == ColorFormat::Undefined) {
+        return nullptr;
+    } else if constexpr (Converter<Src, Dst>::mode == ConvertMode::Copy) {
+        return &copy_row<Converter<Src, Dst>>;
+    } else {
+        return &K<Converter<Src, Dst>>::run;
+    }
+}
+
+
+template <template <class> class K, std::size_t... I>
+constexpr KernelTable make_table(std::index_sequence<I...>) noexcept {
+    return KernelTable{ kernel_for< K
+                                  , static_cast<ColorFormat>(I / kNbFormats)
+                                  , static_cast<ColorFormat>(I % kNbFormats)>()... };
+}
+
+
+template <template <class> class K>
+constexpr KernelTable make_table() noexcept {
+    return make_table<K>(std::make_index_sequence<kNbFormats * kNbFormats>());
+}
+
+
+constexpr KernelTable kScalarKernels = make_table<ScalarKernel>();
+#if defined(PIXELCONV_X86_64)
+constexpr KernelTable kSse2Kernels = make_table<Sse2Kernel>();
+constexpr KernelTable kAvx2Kernels = make_table<Avx2Kernel>();
+#endif
+#if defined(PIXELCONV_NEON)
+constexpr KernelTable kNeonKernels = make_table<NeonKernel>();
+#endif
+
+
+const KernelTable* kernel_table(SimdLevel level) noexcept {
+    switch (level) {
+#if defined(PIXELCONV_X86_64)
+        case SimdLevel::Avx2  : return &kAvx2Kernels;
+        case SimdLevel::Sse2  : return &kSse2Kernels;
+#endif
+#if defined(PIXELCONV_NEON)
+        case SimdLevel::Neon  : return &kNeonKernels;
+#endif
+        case SimdLevel::Scalar: return &kScalarKernels;
+        default: return nullptr;
+    }
+}
+
+}
+
+
+bool imageutils::GetPixelLayout(ColorFormat format, PixelLayout& layout) noexcept {
+    switch (format) {
+        case ColorFormat::R8G8B8X8 : layout = FormatTraits<ColorFormat::R8G8B8X8>::layout; return true;
+        case ColorFormat::R8G8B8A8 : layout = FormatTraits<ColorFormat::R8G8B8A8>::layout; return true;
+        case ColorFormat::R8G8B8   : layout = FormatTraits<ColorFormat::R8G8B8>::layout;   return true;
+        case ColorFormat::R4G4B4A4 : layout = FormatTraits<ColorFormat::R4G4B4A4>::layout; return true;
+        case ColorFormat::R5G6B5   : layout = FormatTraits<ColorFormat::R5G6B5>::layout;   return true;
+        case ColorFormat::A8       : layout = FormatTraits<ColorFormat::A8>::layout;       return true;
+        case ColorFormat::Undefined: return false;
+    }
+
+    return false;
+}
+
+
+RowConverter::RowConverter() noexcept
+    : _src(), _dst()
+    , _level(SimdLevel::Scalar)
+    , _kernel(nullptr)
+{}
+
+
+/*static*/
+SimdLevel RowConverter::DetectSimdLevel() noexcept {
+    static const SimdLevel sLevel = []() noexcept {
+#if defined(PIXELCONV_X86_64)
+        return smile::HasCpuFeature(smile::CpuFeature::Avx2) ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#elif defined(PIXELCONV_NEON)
+        return smile::HasCpuFeature(smile::CpuFeature::Neon) ? SimdLevel::Neon : SimdLevel::Scalar;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }();
+
+    return sLevel;
+}
+
+
+/*static*/
+const char* RowConverter::ToString(SimdLevel level) noexcept {
+    switch (level) {
+        case SimdLevel::Scalar: return "Scalar";
+        case SimdLevel::Sse2  : return "SSE2";
+        case SimdLevel::Avx2  : return "AVX2";
+        case SimdLevel::Neon  : return "NEON";
+        default: return "Unknown";
+    }
+}
+
+
+Rcode RowConverter::setUp(ColorFormat source, ColorFormat target) noexcept {
+    return setUp(source, target, DetectSimdLevel());
+}
+
+
+Rcode RowConverter::setUp(ColorFormat source, ColorFormat target, SimdLevel level) noexcept {
+    PixelLayout src, dst;
+    if (!GetPixelLayout(source, src) || !GetPixelLayout(target, dst)) {
+        return eRcode_InvalidInput;
+    }
+
+    const KernelTable* table = kernel_table(level);
+    if (!table) {
+        return eRcode_InvalidInput;
+    }
+
+    Kernel kernel = (*table)[static_cast<std::size_t>(source) * kNbFormats
+                           + static_cast<std::size_t>(target)];
+    if (!kernel) {
+        return eRcode_InvalidInput;
+    }
+
+    _src = src;
+    _dst = dst;
+    _level = level;
+    _kernel = kernel;
+
+    return eRcode_Ok;
+}
+
+
+void RowConverter::setUp(const PixelLayout& src, const PixelLayout& dst, u32 source, u32 target) noexcept {
+    // the tables hold a kernel of every pair of defined formats
+    _src = src;
+    _dst = dst;
+    _level = DetectSimdLevel();
+    _kernel = (*kernel_table(_level))[source * kNbFormats + target];
+}
@@ -0,0 +1,152 @@
+#ifndef SMILE_PIXELCONV_HPP_
+
+#include "imageutils.hpp"
+
+
+namespace imageutils {
+
+
+// Bump whenever converted pixels change, this invalidates cached textures.
+constexpr u32 kPixelConvVersion = 1;
+
+
+enum class SimdLevel {
+    Scalar = 0
+,   Sse2
+,   Avx2
+,   Neon
+};
+
+
+// Describes how channels are packed into a pixel value. The pixel value is
+// read from (and written to) memory as a native-endian integer of 'size'
+// bytes, every channel occupies 'mask' bits starting at 'shift'.
+struct PixelLayout {
+    u32 size;
+    u32 shift[4]; // R, G, B, A
+    u32 mask[4];
+};
+
+
+constexpr PixelLayout MakePixelLayout(u32 nbBitsR, u32 nbBitsG, u32 nbBitsB, u32 nbBitsA) noexcept {
+    const u32 nbBits = nbBitsR + nbBitsG + nbBitsB + nbBitsA;
+
+    return PixelLayout{
+        (nbBits + 7) / 8,
+        { nbBits - nbBitsR, nbBitsB + nbBitsA, nbBitsA, 0 },
+        { (1u << nbBitsR) - 1, (1u << nbBitsG) - 1, (1u << nbBitsB) - 1, (1u << nbBitsA) - 1 }
+    };
+}
+
+
+constexpr bool IsSameLayout(const PixelLayout& a, const PixelLayout& b) noexcept {
+    if (a.size != b.size) {
+        return false;
+    }
+
+    for (u32 c = 0; c < 4; ++c) {
+        if (a.shift[c] != b.shift[c] || a.mask[c] != b.mask[c]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <ColorFormat>
+inline constexpr bool kIsColorFormatSupported = false;
+
+template <ColorFormat Format>
+struct FormatTraits {
+    static_assert(kIsColorFormatSupported<Format>, "Unsupported color format");
+};
+
+#define PIXELCONV_FORMAT_TRAITS(Format, R, G, B, A) \
+    template <> \
+    struct FormatTraits<ColorFormat::Format> { \
+        static constexpr PixelLayout layout = MakePixelLayout(R, G, B, A); \
+    }
+
+PIXELCONV_FORMAT_TRAITS(R8G8B8A8, 8, 8, 8, 8);
+PIXELCONV_FORMAT_TRAITS(R8G8B8  , 8, 8, 8, 0);
+PIXELCONV_FORMAT_TRAITS(R8G8B8X8, 8, 8, 8, 8);
+PIXELCONV_FORMAT_TRAITS(R4G4B4A4, 4, 4, 4, 4);
+PIXELCONV_FORMAT_TRAITS(R5G6B5  , 5, 6, 5, 0);
+PIXELCONV_FORMAT_TRAITS(A8      , 0, 0, 0, 8);
+
+#undef PIXELCONV_FORMAT_TRAITS
+
+
+enum class ConvertMode {
+    Channels = 0  // copy channels with clamping to the target channel width
+,   AlphaToGray   // (A, A, A, 255)
+,   Luma          // 0.299*R + 0.587*G + 0.114*B into every target channel
+,   Copy          // layouts are the same
+};
+
+
+// Compile-time description of a conversion. Instantiating it for an
+// unsupported pair of formats is a compile error.
+template <ColorFormat Src, ColorFormat Dst>
+struct Converter {
+    static constexpr PixelLayout source = FormatTraits<Src>::layout;
+    static constexpr PixelLayout target = FormatTraits<Dst>::layout;
+
+    static constexpr ConvertMode mode =
+        (Src == ColorFormat::A8 && Dst == ColorFormat::R8G8B8A8) ? ConvertMode::AlphaToGray :
+        (Src == ColorFormat::R8G8B8 && Dst == ColorFormat::A8)   ? ConvertMode::Luma :
+        IsSameLayout(source, target)                             ? ConvertMode::Copy :
+                                                                   ConvertMode::Channels;
+};
+
+
+bool GetPixelLayout(ColorFormat format, PixelLayout& layout) noexcept;
+
+
+class RowConverter {
+public:
+    using Kernel = void (*)(byte* dst, const byte* src, u32 width) noexcept;
+
+    RowConverter() noexcept;
+
+    static SimdLevel DetectSimdLevel() noexcept;
+    static const char* ToString(SimdLevel level) noexcept;
+
+    Rcode setUp(ColorFormat source, ColorFormat target) noexcept;
+    Rcode setUp(ColorFormat source, ColorFormat target, SimdLevel level) noexcept;
+
+    // Takes the kernel of Converter<Src, Dst> for the detected SIMD level;
+    // unsupported formats do not compile, so it cannot fail.
+    template <ColorFormat Src, ColorFormat Dst>
+    void setUp() noexcept {
+        using C = Converter<Src, Dst>;
+        setUp(C::source, C::target, static_cast<u32>(Src), static_cast<u32>(Dst));
+    }
+
+    void operator () (byte* dst, const byte* src, u32 width) const noexcept {
+        _kernel(dst, src, width);
+    }
+
+    const PixelLayout& source() const noexcept { return _src; }
+    const PixelLayout& target() const noexcept { return _dst; }
+
+    SimdLevel level() const noexcept { return _level; }
+
+private:
+    void setUp(const PixelLayout& src, const PixelLayout& dst, u32 source, u32 target) noexcept;
+
+    PixelLayout _src;
+    PixelLayout _dst;
+
+    SimdLevel _level;
+
+    Kernel _kernel;
+};
+
+
+}
+
+
+#define SMILE_PIXELCONV_HPP_
+#endif
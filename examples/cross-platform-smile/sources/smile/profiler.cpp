@@ -0,0 +1,206 @@
+#include "smile/profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "smile/log.hpp"
+
+
+using namespace smile::profiler;
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// time to count the ticks against
+constexpr std::chrono::milliseconds kCalibrationTime{20};
+
+
+struct registry_t {
+    std::mutex mutex;
+    // the rings live until the exit: the threads keep pointers to them
+    std::vector<std::unique_ptr<ZoneRing>> rings;
+
+    // the first ticks, the trace counts from them
+    u64 origin{Ticks()};
+};
+
+static registry_t& registry() noexcept {
+    static registry_t sRegistry;
+    return sRegistry;
+}
+
+// sets the origin before main, earlier than any zone
+static registry_t& sRegistryInit = registry();
+
+
+static f64 ticks_per_us() noexcept {
+    const Clock::time_point t0 = Clock::now();
+    const u64 ticks0 = Ticks();
+
+    std::this_thread::sleep_for(kCalibrationTime);
+
+    const u64 ticks1 = Ticks();
+    const Clock::time_point t1 = Clock::now();
+
+    const f64 us = std::chrono::duration<f64, std::micro>(t1 - t0).count();
+    return ticks1 > ticks0 && us > 0.0 ? static_cast<f64>(ticks1 - ticks0)/us : 1.0;
+}
+
+
+static void write_json_string(std::FILE* file, const char* str) noexcept {
+    std::fputc('"', file);
+    for (const char* c = str ? str : "?"; *c; ++c) {
+        const unsigned char ch = static_cast<unsigned char>(*c);
+        if ('"' == ch || '\\' == ch) {
+            std::fputc('\\', file);
+            std::fputc(ch, file);
+        } else if (ch < 0x20) {
+            std::fprintf(file, "\\u%04x", ch);
+        } else {
+            std::fputc(ch, file);
+        }
+    }
+    std::fputc('"', file);
+}
+
+
+// Writes the records of the ring as complete ("X") events, returns their
+// number. The records which the thread overwrote while they were being
+// written are skipped.
+static u64 write_ring(std::FILE* file, const ZoneRing& ring, u64 origin, f64 ticksPerUs, bool& first) noexcept {
+    const u64 head = ring.head.load(std::memory_order_acquire);
+    const u64 start = head > kZoneRingSize ? head - kZoneRingSize : 0;
+
+    std::vector<ZoneRecord> records;
+    try {
+        records.resize(head - start);
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+    for (u64 i = start; i < head; ++i) {
+        records[i - start] = ring.records[i & (kZoneRingSize - 1)];
+    }
+
+    // the thread is still writing: what it wrote since the head was read
+    // has overwritten the oldest of the copied records
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const u64 now = ring.head.load(std::memory_order_relaxed);
+    const u64 valid = now > start + kZoneRingSize ? now - kZoneRingSize : start;
+
+    u64 nbWritten = 0;
+    for (u64 i = valid; i < head; ++i) {
+        const ZoneRecord& record = records[i - start];
+        if (record.begin < origin || record.end < record.begin) {
+            continue;
+        }
+
+        std::fputs(first ? "\n" : ",\n", file);
+        first = false;
+
+        std::fputs("{\"name\":", file);
+        write_json_string(file, record.name);
+        std::fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}"
+                   , static_cast<f64>(record.begin - origin)/ticksPerUs
+                   , static_cast<f64>(record.end - record.begin)/ticksPerUs
+                   , ring.thread_index);
+        ++nbWritten;
+    }
+
+    return nbWritten;
+}
+
+}
+
+
+u64 smile::profiler::TicksFallback() noexcept {
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count());
+}
+
+
+ZoneRing* smile::profiler::ThisThreadRing() noexcept {
+    static thread_local ZoneRing* tls_ring = nullptr;
+    if (tls_ring) {
+        return tls_ring;
+    }
+
+    registry_t& reg = registry();
+    try {
+        std::unique_ptr<ZoneRing> ring = std::make_unique<ZoneRing>();
+
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        ring->thread_index = static_cast<u32>(reg.rings.size()) + 1;
+        reg.rings.push_back(std::move(ring));
+        tls_ring = reg.rings.back().get();
+    } catch (const std::exception& e) {
+        SMILE_LOG(Error) << "Failed to register a profiler thread: " << e.what();
+        return nullptr;
+    }
+
+    return tls_ring;
+}
+
+
+void smile::profiler::SetThreadName(const char* name) noexcept {
+    ZoneRing* ring = ThisThreadRing();
+    if (ring) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        ring->thread_name = name;
+    }
+}
+
+
+Rcode smile::profiler::WriteChromeTrace(const char* path) noexcept {
+    if (!path) {
+        return RC(InvalidInput);
+    }
+
+    registry_t& reg = registry();
+    const f64 ticksPerUs = ticks_per_us();
+
+    std::FILE* file = std::fopen(path, "w");
+    if (!file) {
+        SMILE_LOG(Error) << "Failed to open " << path << " for writing";
+        return RC(InternalError);
+    }
+
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+    bool first = true;
+    u64 nbZones = 0;
+    {
+        // the rings are never removed, only new threads wait for the dump
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const std::unique_ptr<ZoneRing>& ring : reg.rings) {
+            if (ring->thread_name) {
+                std::fputs(first ? "\n" : ",\n", file);
+                first = false;
+
+                std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":"
+                           , ring->thread_index);
+                write_json_string(file, ring->thread_name);
+                std::fputs("}}", file);
+            }
+
+            nbZones += write_ring(file, *ring, reg.origin, ticksPerUs, first);
+        }
+    }
+
+    std::fputs("\n]}\n", file);
+
+    const bool failed = std::ferror(file) != 0;
+    if (0 != std::fclose(file) || failed) {
+        SMILE_LOG(Error) << "Failed to write the trace to " << path;
+        return RC(InternalError);
+    }
+
+    SMILE_LOG(Info) << "Wrote " << nbZones << " zones to " << path;
+    return RC(Ok);
+}
@@ -3,13 +3,23 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstring>
+#include <memory>
 #include <new>
 
-#include "imageutils.hpp"
+#include "jobsystem.hpp"
+#include "smileys.hpp"
+#include "spritebatch.hpp"
+#include "textureloader.hpp"
+#include "triplebuffer.hpp"
 
+#include "smile/assetpack.hpp"
 #include "smile/log.hpp"
+#include "smile/profiler.hpp"
 
 
 extern "C"
@@ -27,11 +37,10 @@ const char* smile_ToString(Rcode rc) {
 }
 
 
-static constexpr f32 kG = 9.81f;
-static constexpr f32 kSmileySize = 0.5f;
-static constexpr f32 kK = 5000.0f;
-static constexpr f32 kFloorY = -0.75f;
-static constexpr f32 kFriction = 3.0f;
+using smile::kSmileySize;
+
+// smileys updated by a job at least
+static constexpr u32 kSmileysPerJob = 4096;
 
 static const Vertex kQuadVertices[] = {
     { -kSmileySize/2.0f, -kSmileySize/2.0f, 0.0f, 0.0f },
@@ -46,171 +55,257 @@ static const u16 kQuadIndicies[] = {
 
 static constexpr const char* kSmileyPng = "textures/smiley-face.png";
 
+static const char* const kTexturePngs[] = {
+    kSmileyPng,
+};
+static constexpr u32 kNbTextures = sizeof(kTexturePngs)/sizeof(kTexturePngs[0]);
+
+
+static f64 seconds_now() noexcept {
+    using Clock = std::chrono::steady_clock;
+    return std::chrono::duration<f64>(Clock::now().time_since_epoch()).count();
+}
+
+
+struct InstancesSnapshot {
+    std::unique_ptr<GeomInstance[]> instances;
+    f64 time{0.0}; // sec, when published; 0 if never
+};
+
 
 struct SmileContextData {
     ShaderBufferPtr smiley_vertices{0};
     ShaderBufferPtr smiley_indicies{0};
 
-    ShaderBufferPtr geom_instances{0};
-
     TextureDataPtr smiley_texture{0};
 
-    GeomInstance smiley_instance;
+    smile::AssetPack asset_pack;
 
-    f64 smiley_Vt{0.0f};
-    f64 smiley_Vb{0.0f};
+    smile::JobSystem jobs;
 
-    f64 smiley_dx{0.0f};
+    smile::Smileys smileys;
+
+    // owns the instances buffer, the smileys are one run of sprites
+    smile::SpriteBatch sprites;
+
+    // The threaded update publishes the instances through the snapshots,
+    // the render keeps the previously fetched ones to interpolate.
+    bool threaded_update{false};
+    smile::TripleBuffer<InstancesSnapshot> snapshots;
+    InstancesSnapshot previous;
 
     f32 T_elapsed{0.0f};
+    f64 T_accumulated{0.0}; // not yet simulated time
 
     f32 T{0.0f};
 
     bool ignore_frame{true};
+
+    // sec, the update may run on a thread of its own
+    std::atomic<f64> cpu_update{0.0};
+    std::atomic<f64> cpu_render{0.0};
 };
 
 
-extern "C"
-Rcode smile_SetUp(SmileContext* pCtx) {
-    if (!pCtx) {
-        return eRcode_InvalidInput;
+// Stores the time spent in the scope.
+struct CpuTimer {
+    std::atomic<f64>& time;
+    f64 start;
+
+    explicit CpuTimer(std::atomic<f64>& t) noexcept : time(t), start(seconds_now()) {}
+    ~CpuTimer() noexcept { time.store(seconds_now() - start, std::memory_order_relaxed); }
+};
+
+
+struct UpdateSmileys {
+    smile::Smileys* smileys;
+    GeomInstance* instances;
+    u32 nb_steps;
+    bool simulate;
+};
+
+static void update_smileys(void* arg, u32 begin, u32 end) {
+    SMILE_ZONE("update_smileys");
+
+    const UpdateSmileys& update = *static_cast<const UpdateSmileys*>(arg);
+
+    if (update.simulate) {
+        update.smileys->step(update.nb_steps, begin, end);
+        update.smileys->kick(begin, end);
     }
 
-    try {
-        pCtx->pdata = new SmileContextData();
-        if (!pCtx->pdata) {
-            return eRcode_MemError;
-        }
+    update.smileys->fill(update.instances, begin, end);
+}
 
-        pCtx->pdata->smiley_instance.botx = 0.0f;
-        pCtx->pdata->smiley_instance.boty = kFloorY;
-        pCtx->pdata->smiley_instance.topx = 0.0f;
-        pCtx->pdata->smiley_instance.topy = kFloorY;
 
-        pCtx->pdata->smiley_dx = pCtx->pdata->smiley_instance.topy - pCtx->pdata->smiley_instance.boty;
+// Simulates (if asked) and fills the instances of the smileys on the jobs
+// workers.
+static void update_smileys( SmileContextData& data, GeomInstance* instances
+                          , bool simulate, u32 nbSteps ) noexcept
+{
+    UpdateSmileys update{&data.smileys, instances, nbSteps, simulate};
 
-        pCtx->pdata->smiley_Vt = 0.0f;
-    } catch (std::bad_alloc&) {
+    smile::JobCounter counter;
+    data.jobs.parallelFor(data.smileys.size(), kSmileysPerJob, &update_smileys, &update, counter);
+    data.jobs.wait(counter);
+}
+
+
+// Submits the smileys as the sprites of the frame, the render draws them.
+static Rcode update_sprites(SmileContextData& data, bool simulate, u32 nbSteps) noexcept {
+    data.sprites.clear();
+
+    GeomInstance* instances = data.sprites.submit(data.smiley_texture, data.smileys.size());
+    if (!instances) {
         return eRcode_MemError;
-    } catch (...) {
-        return eRcode_InternalError;
     }
 
-    pCtx->resources_state = eResourcesState_Unloaded;
+    update_smileys(data, instances, simulate, nbSteps);
 
     return eRcode_Ok;
 }
 
 
-extern "C"
-Rcode smile_TearDown(SmileContext* pCtx) {
-    if (!pCtx) {
-        return eRcode_InvalidInput;
+// Fills the instances with the two latest snapshots of the threaded update
+// interpolated to the current time. Returns false if nothing is published
+// yet.
+static bool interpolate_instances(SmileContextData& data, GeomInstance* instances) noexcept {
+    if (data.snapshots.fresh()) {
+        // the front becomes the previous snapshot, its former instances
+        // go back to the update to be overwritten
+        InstancesSnapshot& front = data.snapshots.front();
+        std::swap(data.previous.instances, front.instances);
+        data.previous.time = front.time;
+
+        data.snapshots.fetch();
     }
 
-    if (!pCtx->pdata) {
-        return eRcode_Already;
+    const InstancesSnapshot& latest = data.snapshots.front();
+    if (0.0 == latest.time) {
+        return false;
     }
 
-    if (eResourcesState_Unloaded != pCtx->resources_state) {
-        smile_UnloadResources(pCtx);
+    const u32 n = data.smileys.size();
+
+    const InstancesSnapshot& previous = data.previous;
+    if (0.0 == previous.time || latest.time <= previous.time) {
+        std::memcpy(instances, latest.instances.get(), sizeof(GeomInstance)*n);
+        return true;
     }
 
-    delete pCtx->pdata;
-    pCtx->pdata = nullptr;
+    // show the motion between the two snapshots one update late, so it is
+    // smooth whatever the update and display rates are
+    const f32 alpha = static_cast<f32>(std::clamp(
+            (seconds_now() - latest.time)/(latest.time - previous.time), 0.0, 1.0));
 
-    return eRcode_Ok;
-}
+    const GeomInstance* __restrict a = previous.instances.get();
+    const GeomInstance* __restrict b = latest.instances.get();
+    GeomInstance* __restrict out = instances;
 
+    for (u32 i = 0; i < n; ++i) {
+        out[i].topx = a[i].topx + (b[i].topx - a[i].topx)*alpha;
+        out[i].topy = a[i].topy + (b[i].topy - a[i].topy)*alpha;
+        out[i].botx = a[i].botx + (b[i].botx - a[i].botx)*alpha;
+        out[i].boty = a[i].boty + (b[i].boty - a[i].boty)*alpha;
+    }
 
-static bool is_equal(f64 a, f64 b, f64 tol = 1e-5) noexcept {
-    return std::abs(a)-std::abs(b) <= tol;
+    return true;
 }
 
 
-static void compute_in_fly(SmileContextData& data, f64 dT) {
-    f64 dXdt = data.smiley_Vt - data.smiley_Vb;
+static Rcode set_up_snapshots(SmileContextData& data) noexcept {
+    const u32 n = data.smileys.size();
+
+    try {
+        for (u32 i = 0; i < 3; ++i) {
+            data.snapshots.slot(i).instances = std::make_unique<GeomInstance[]>(n);
+        }
+        data.previous.instances = std::make_unique<GeomInstance[]>(n);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
 
-    const f64 Vt_0 = data.smiley_Vt;
-    const f64 Vb_0 = data.smiley_Vb;
+    return eRcode_Ok;
+}
 
-    const f64 At = -(kG + kK * data.smiley_dx + kFriction*dXdt);
-    const f64 Ab = -(kG - kK * data.smiley_dx - kFriction*dXdt);
 
-    const f64 Vt = Vt_0 + At * dT;
-    const f64 Vb = Vb_0 + Ab * dT;
+static Rcode commit_static_buffers(SmileContextData& data, const PlatformApi& api) noexcept {
+    // Here we should fill our smiley sprite quad with vertices
+    void* contents;
+    Rcode rc;
 
-    f64 Tt1 = dT;
-    if (!is_equal(Vt, 0.0) && Vt_0*Vt < 0.0 && !is_equal(At, 0.0)) {
-        Tt1 = -Vt_0 / At;
-    }
-    f64 Tb1 = dT;
-    if (!is_equal(Vb, 0.0) && Vb_0*Vb < 0.0 && !is_equal(Ab, 0.0)) {
-        Tb1 = -Vb_0 / Ab;
+    contents = api.GetShaderBufferContent(data.smiley_vertices);
+    std::memcpy(contents, kQuadVertices, sizeof(kQuadVertices));
+    rc = api.CommitShaderBuffer(data.smiley_vertices, 0, sizeof(kQuadVertices));
+    if (eRcode_Ok != rc) {
+        return rc;
     }
 
-    f64 T[3] = { Tb1, Tt1 - Tb1, dT - Tt1 };
-    if (Tt1 < Tb1) {
-        T[0] = Tt1;
-        T[1] = Tb1 - Tt1;
-        T[2] = dT - Tb1;
+    contents = api.GetShaderBufferContent(data.smiley_indicies);
+    std::memcpy(contents, kQuadIndicies, sizeof(kQuadIndicies));
+    return api.CommitShaderBuffer(data.smiley_indicies, 0, sizeof(kQuadIndicies));
+}
+
+
+extern "C"
+Rcode smile_SetUp(SmileContext* pCtx) {
+    if (!pCtx) {
+        return eRcode_InvalidInput;
     }
-    if (T[0] < dT) {
-        compute_in_fly(data, T[0]);
-        if (!is_equal(T[1], 0.0)) {
-            compute_in_fly(data, T[1]);
-        }
-        if (!is_equal(T[2], 0.0)) {
-            compute_in_fly(data, T[2]);
+
+    try {
+        pCtx->pdata = new SmileContextData();
+        if (!pCtx->pdata) {
+            return eRcode_MemError;
         }
-        return;
+
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    } catch (...) {
+        return eRcode_InternalError;
     }
 
-    const f64 Ht = Vt_0 * dT + At * dT * dT / 2.0 + data.smiley_instance.topy;
-    const f64 Hb = Vb_0 * dT + Ab * dT * dT / 2.0 + data.smiley_instance.boty;
+    Rcode rc = pCtx->pdata->jobs.setUp(pCtx->nb_threads);
+    if (eRcode_Ok == rc) {
+        rc = pCtx->pdata->smileys.setUp(pCtx->nb_smileys > 0 ? pCtx->nb_smileys : 1);
+    }
+    if (eRcode_Ok == rc) {
+        rc = pCtx->pdata->sprites.setUp(kSmileySize/2.0f, pCtx->pdata->smileys.size());
+    }
+    if (eRcode_Ok == rc && pCtx->threaded_update) {
+        pCtx->pdata->threaded_update = true;
+        rc = set_up_snapshots(*pCtx->pdata);
+    }
+    if (eRcode_Ok != rc) {
+        delete pCtx->pdata;
+        pCtx->pdata = nullptr;
+        return rc;
+    }
 
-    const f64 x = Ht - Hb;
+    pCtx->resources_state = eResourcesState_Unloaded;
 
-    if (Hb < kFloorY) {
-        f64 dH = kFloorY - data.smiley_instance.boty;
-        f64 t1 = 0.0;
+    return eRcode_Ok;
+}
 
-        if (!is_equal(data.smiley_Vb, 0.0)) {
-            f64 t1 = (data.smiley_Vb/Ab)*(std::sqrt(1.0 + 2.0*dH*Ab/(data.smiley_Vb*data.smiley_Vb)) - 1.0);
-            if (t1 < 0.0) {
-                t1 = 0.0;
-            }
-            assert(t1 < dT);
-        } else if (!is_equal(Ab, 0.0)){
-            data.smiley_Vb = 0.0;
-            f64 t1 = std::sqrt(2*dH/Ab);
-            compute_in_fly(data, t1);
-        }
 
-        if (t1 > 0.0) {
-            compute_in_fly(data, t1);
-            assert(is_equal(data.smiley_instance.boty, kFloorY, 0.01));
-        }
-        data.smiley_Vb = -data.smiley_Vb;
-        if (t1 > 0.0) {
-            compute_in_fly(data, dT-t1);
-        } else {
-            data.smiley_dx = x;
-
-            data.smiley_Vt = Vt;
-            data.smiley_instance.topy = static_cast<f32>(Ht);
-        }
+extern "C"
+Rcode smile_TearDown(SmileContext* pCtx) {
+    if (!pCtx) {
+        return eRcode_InvalidInput;
+    }
 
-        return;
+    if (!pCtx->pdata) {
+        return eRcode_Already;
     }
 
-    data.smiley_dx = x;
+    if (eResourcesState_Unloaded != pCtx->resources_state) {
+        smile_UnloadResources(pCtx);
+    }
 
-    data.smiley_Vt = Vt;
-    data.smiley_instance.topy = static_cast<f32>(Ht);
+    delete pCtx->pdata;
+    pCtx->pdata = nullptr;
 
-    data.smiley_Vb = Vb;
-    data.smiley_instance.boty = static_cast<f32>(Hb);
+    return eRcode_Ok;
 }
 
 
@@ -224,47 +319,34 @@ Rcode smile_Update(SmileContext* pCtx, float dT) {
         return eRcode_NotInitialized;
     }
 
-    if (eResourcesState_Unloaded == pCtx->resources_state) {
-        return eRcode_Ok;
-    }
-
-    if (eResourcesState_Loaded == pCtx->resources_state) {
-        // Here we should fill our smiley sprite quad with vertices
-        void* contents;
-        Rcode rc;
-
-        SmileContextData* pdata = pCtx->pdata;
-
-        contents = pCtx->platform_api.GetShaderBufferContent(pdata->smiley_vertices);
-        std::memcpy(contents, kQuadVertices, sizeof(kQuadVertices));
-        rc = pCtx->platform_api.CommitShaderBuffer(
-                pdata->smiley_vertices, 0, sizeof(kQuadVertices));
-        if (eRcode_Ok != rc) {
-            return rc;
+    SmileContextData& data = *pCtx->pdata;
+    CpuTimer timer(data.cpu_update);
+    SMILE_ZONE("smile_Update");
+
+    // the threaded update never touches the graphics resources, the render
+    // prepares them instead
+    if (!data.threaded_update) {
+        if (eResourcesState_Unloaded == pCtx->resources_state) {
+            return eRcode_Ok;
         }
 
-        contents = pCtx->platform_api.GetShaderBufferContent(pdata->smiley_indicies);
-        std::memcpy(contents, kQuadIndicies, sizeof(kQuadIndicies));
-        rc = pCtx->platform_api.CommitShaderBuffer(
-                pdata->smiley_indicies, 0, sizeof(kQuadIndicies));
-        if (eRcode_Ok != rc) {
-            return rc;
-        }
+        if (eResourcesState_Loaded == pCtx->resources_state) {
+            Rcode rc = commit_static_buffers(data, pCtx->platform_api);
+            if (eRcode_Ok != rc) {
+                return rc;
+            }
 
-        contents = pCtx->platform_api.GetShaderBufferContent(pdata->geom_instances);
-        std::memcpy(contents, &pdata->smiley_instance, sizeof(pdata->smiley_instance));
-        rc = pCtx->platform_api.CommitShaderBuffer(
-                pdata->geom_instances, 0, sizeof(pdata->smiley_instance));
-        if (eRcode_Ok != rc) {
-            return rc;
-        }
+            rc = update_sprites(data, false, 0);
+            if (eRcode_Ok != rc) {
+                return rc;
+            }
 
-        pCtx->resources_state = eResourcesState_Ready;
-        pCtx->pdata->ignore_frame = true;
-        return eRcode_Ok;
+            pCtx->resources_state = eResourcesState_Ready;
+            data.ignore_frame = true;
+            return eRcode_Ok;
+        }
     }
 
-    SmileContextData& data = *pCtx->pdata;
     if (data.ignore_frame) {
         data.ignore_frame = false;
         return eRcode_Ok;
@@ -272,33 +354,21 @@ Rcode smile_Update(SmileContext* pCtx, float dT) {
 
     data.T_elapsed += dT;
 
-    if (data.T_elapsed >= 1.0f) {
-        f64 dt = dT * 0.001;
-        for (f64 t0 = 0; t0 < dT; t0 += dt) {
-            compute_in_fly(data, dt);
-        }
-        if (is_equal(data.smiley_instance.boty, kFloorY) &&
-            is_equal(data.smiley_Vt, 0.0, 0.01) &&
-            is_equal(data.smiley_Vb, 0.0, 0.01))
-        {
-            data.smiley_Vt = -12.0;
-            data.smiley_Vb = 0.0;
-        } else {
-            const f64 ds = kSmileySize*kSmileySize/(kSmileySize-data.smiley_dx) - kSmileySize;
-            data.smiley_instance.botx = ds/2.0;
-            data.smiley_instance.topx = -ds/2.0;
-        }
+    u32 nbSteps = 0;
+    const bool simulate = data.T_elapsed >= 1.0f;
+    if (simulate) {
+        nbSteps = smile::TakeSimSteps(data.T_accumulated, dT);
     }
 
-    void* contents = pCtx->platform_api.GetShaderBufferContent(data.geom_instances);
-    std::memcpy(contents, &data.smiley_instance, sizeof(data.smiley_instance));
-    Rcode rc = pCtx->platform_api.CommitShaderBuffer(
-            data.geom_instances, 0, sizeof(data.smiley_instance));
-    if (eRcode_Ok != rc) {
-        return rc;
+    if (data.threaded_update) {
+        InstancesSnapshot& snapshot = data.snapshots.back();
+        update_smileys(data, snapshot.instances.get(), simulate, nbSteps);
+        snapshot.time = seconds_now();
+        data.snapshots.publish();
+        return eRcode_Ok;
     }
 
-    return eRcode_Ok;
+    return update_sprites(data, simulate, nbSteps);
 }
 
 
@@ -312,32 +382,41 @@ Rcode smile_Render(SmileContext* pCtx, FrameEncoderPtr pEncoder) {
         return eRcode_NotInitialized;
     }
 
+    SmileContextData& data = *pCtx->pdata;
+    CpuTimer timer(data.cpu_render);
+    SMILE_ZONE("smile_Render");
+
+    Rcode rc;
+
+    if (data.threaded_update && eResourcesState_Loaded == pCtx->resources_state) {
+        rc = commit_static_buffers(data, pCtx->platform_api);
+        if (eRcode_Ok != rc) return rc;
+
+        pCtx->resources_state = eResourcesState_Ready;
+    }
+
     if (eResourcesState_Ready != pCtx->resources_state) {
         return eRcode_Ok;
     }
-    SmileContextData& data = *pCtx->pdata;
 
-    Rcode rc;
-    
     rc = pCtx->platform_api.SetClearColor(pEncoder, 0.23f, 0.39f, 0.51f);
     if (eRcode_Ok != rc) return rc;
 
-    rc = pCtx->platform_api.SetVertexBuffer(
-        pEncoder, data.smiley_vertices, 0);
-    if (eRcode_Ok != rc) return rc;
+    if (data.threaded_update) {
+        data.sprites.clear();
 
-    rc = pCtx->platform_api.SetVertexBuffer(
-        pEncoder, data.geom_instances, 0);
-    if (eRcode_Ok != rc) return rc;
+        GeomInstance* instances = data.sprites.submit(data.smiley_texture, data.smileys.size());
+        if (!instances) {
+            return eRcode_MemError;
+        }
 
-    rc = pCtx->platform_api.SetTextureSlot(
-        pEncoder, data.smiley_texture);
-    if (eRcode_Ok != rc) return rc;
+        if (!interpolate_instances(data, instances)) {
+            data.sprites.clear();
+            return eRcode_Ok;
+        }
+    }
 
-    rc = pCtx->platform_api.DrawIndexedPrimitive(
-        pEncoder, sizeof(kQuadIndicies)/sizeof(kQuadIndicies[0]),
-        1, data.smiley_indicies);
-    return rc;
+    return data.sprites.flush(pCtx->platform_api, pEncoder);
 }
 
 
@@ -378,12 +457,12 @@ Rcode smile_ReloadResources(SmileContext* pCtx, GraphContextPtr pGraph) {
     }
 
     SmileContextData& data = *pCtx->pdata;
+    SMILE_ZONE("smile_ReloadResources");
 
     Rcode rc;
 
     _RaiiShaderBuffer raiiVertices(pCtx, &data.smiley_vertices);
     _RaiiShaderBuffer raiiIndicies(pCtx, &data.smiley_indicies);
-    _RaiiShaderBuffer raiiInstance(pCtx, &data.geom_instances);
 
     SMILE_LOG(Debug) << "Create vertices shader buffer";
     rc = pCtx->platform_api.CreateShaderBuffer(
@@ -399,44 +478,45 @@ Rcode smile_ReloadResources(SmileContext* pCtx, GraphContextPtr pGraph) {
         return rc;
     }
 
-    SMILE_LOG(Debug) << "Create instances shader buffer";
-    rc = pCtx->platform_api.CreateShaderBuffer(
-            &raiiInstance.ptr, pGraph, sizeof(GeomInstance), eBufferType_Instance, 0);
-    if (eRcode_Ok != rc) {
-        return rc;
-    }
-
-    SMILE_LOG(Debug) << "load smiley texture asset";
-    AssetData asset;
-    rc = pCtx->platform_api.LoadAsset(
-            &asset, const_cast<char*>(kSmileyPng));
-    if (eRcode_Ok != rc) {
-        return rc;
-    }
-
-    SMILE_LOG(Debug) << "load smiley texture png";
-    imageutils::Png png;
-    rc = png.load(asset);
-    pCtx->platform_api.FreeAsset(&asset);
-    if (eRcode_Ok != rc) {
-        return rc;
+    data.asset_pack.close();
+    if (pCtx->asset_pack.data) {
+        rc = data.asset_pack.open(pCtx->asset_pack);
+        if (eRcode_Ok != rc) {
+            SMILE_LOG(Warning) << "Ignore broken asset pack: " << smile_ToString(rc);
+        }
     }
 
-    rc = png.convert(imageutils::ColorFormat::R8G8B8A8);
+    SMILE_LOG(Debug) << "Load textures";
+    TextureDataPtr textures[kNbTextures];
+    smile::TextureLoadStats stats;
+    rc = smile::LoadTextures( pCtx, pGraph
+                            , kTexturePngs, kNbTextures
+                            , textures, &data.asset_pack
+                            , data.jobs, &stats );
     if (eRcode_Ok != rc) {
         return rc;
     }
-
-    SMILE_LOG(Debug) << "Create texture from image";
-    rc = pCtx->platform_api.CreateTextureFromImage(&data.smiley_texture, pGraph, &png.image());
+    data.smiley_texture = textures[0];
+    SMILE_LOG(Info) << "Loaded " << stats.nb_textures << " textures ("
+                    << stats.nb_baked << " baked, " << stats.nb_cached << " cached, "
+                    << (stats.nb_baked + stats.nb_cached == stats.nb_textures ? "warm" : "cold") << ") on "
+                    << stats.nb_threads << " threads in " << stats.wall_time << "s"
+                    << " (read " << stats.read_time << "s, decode " << stats.decode_time
+                    << "s, upload " << stats.upload_time << "s)";
+
+    SMILE_LOG(Debug) << "Create sprites instances buffer";
+    const smile::SpriteQuad quad{
+        raiiVertices.ptr, raiiIndicies.ptr, sizeof(kQuadIndicies)/sizeof(kQuadIndicies[0])
+    };
+    rc = data.sprites.load(pCtx->platform_api, pGraph, quad);
     if (eRcode_Ok != rc) {
+        pCtx->platform_api.ReleaseTexture(data.smiley_texture);
         return rc;
     }
 
     SMILE_LOG(Debug) << "Commit buffers";
     raiiVertices.commit();
     raiiIndicies.commit();
-    raiiInstance.commit();
 
     pCtx->resources_state = eResourcesState_Loaded;
 
@@ -462,7 +542,7 @@ Rcode smile_UnloadResources(SmileContext* pCtx) {
 
     pCtx->platform_api.ReleaseShaderBuffer(data.smiley_vertices);
     pCtx->platform_api.ReleaseShaderBuffer(data.smiley_indicies);
-    pCtx->platform_api.ReleaseShaderBuffer(data.geom_instances);
+    data.sprites.unload(pCtx->platform_api);
     pCtx->platform_api.ReleaseTexture(data.smiley_texture);
 
     pCtx->resources_state = eResourcesState_Unloaded;
@@ -470,3 +550,45 @@ Rcode smile_UnloadResources(SmileContext* pCtx) {
     return eRcode_Ok;
 }
 
+
+extern "C"
+Rcode smile_GetSpriteStats(SmileContext* pCtx, SpriteStats* pStats) {
+    if (!pCtx || !pStats) {
+        return eRcode_InvalidInput;
+    }
+
+    if (!pCtx->pdata) {
+        return eRcode_NotInitialized;
+    }
+
+    *pStats = pCtx->pdata->sprites.stats();
+
+    return eRcode_Ok;
+}
+
+
+extern "C"
+Rcode smile_GetFrameStats(SmileContext* pCtx, FrameStats* pStats) {
+    if (!pCtx || !pStats) {
+        return eRcode_InvalidInput;
+    }
+
+    if (!pCtx->pdata) {
+        return eRcode_NotInitialized;
+    }
+
+    FrameStats stats{};
+    stats.cpu_update = pCtx->pdata->cpu_update.load(std::memory_order_relaxed);
+    stats.cpu_render = pCtx->pdata->cpu_render.load(std::memory_order_relaxed);
+
+    if (pCtx->platform_api.GetGpuTimings) {
+        FrameStats gpu = stats;
+        if (eRcode_Ok == pCtx->platform_api.GetGpuTimings(&gpu)) {
+            stats = gpu;
+        }
+    }
+
+    *pStats = stats;
+
+    return eRcode_Ok;
+}
@@ -0,0 +1,239 @@
+#include "smileys.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+#include "cpu.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#   define SMILEYS_X86_64 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#   define SMILEYS_INLINE __forceinline
+#else
+#   define SMILEYS_INLINE inline __attribute__((always_inline))
+#   if defined(SMILEYS_X86_64)
+#       define SMILEYS_TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+#endif
+
+
+using namespace smile;
+
+
+namespace {
+
+constexpr f32 kG = 9.81f;
+constexpr f32 kK = 5000.0f;
+constexpr f32 kFloorY = -0.75f;
+constexpr f32 kFriction = 3.0f;
+
+constexpr f32 kKickSpeed = 12.0f;
+
+// the bottom slower than this stays on the floor instead of bouncing
+constexpr f32 kRestSpeed = static_cast<f32>(2.0*kG*kSimStep);
+
+// a smiley on the floor with both edges slower than this is lying still
+constexpr f32 kStillSpeed = 0.01f;
+constexpr f32 kFloorTolerance = 1e-5f;
+
+
+// Transition of the spring between the smiley top and bottom over one
+// simulation step. With unit masses the relative coordinate x = top - bottom
+// obeys x'' = -2K*x - 2F*x' while the center of mass just falls, so both are
+// advanced exactly, which is stable for any step.
+struct SpringStep {
+    f32 xx, xv;
+    f32 vx, vv;
+};
+
+static_assert(kFriction*kFriction < 2.0f*kK, "the spring is expected to be underdamped");
+
+static SpringStep make_spring_step(f64 h) noexcept {
+    const f64 w0 = std::sqrt(2.0*kK);
+    const f64 zeta = kFriction/w0;
+    const f64 wd = w0*std::sqrt(1.0 - zeta*zeta);
+
+    const f64 e = std::exp(-zeta*w0*h);
+    const f64 c = std::cos(wd*h);
+    const f64 s = std::sin(wd*h);
+
+    return SpringStep{
+        static_cast<f32>(e*(c + zeta*w0/wd*s)), static_cast<f32>(e*s/wd),
+        static_cast<f32>(-e*w0*w0/wd*s),        static_cast<f32>(e*(c - zeta*w0/wd*s)),
+    };
+}
+
+
+// Branchless on purpose: the loop over smileys is vectorized by the compiler.
+SMILEYS_INLINE void step_smileys( f32* __restrict topy, f32* __restrict boty
+                                , f32* __restrict topv, f32* __restrict botv
+                                , u32 n, u32 nbSteps, const SpringStep& k ) noexcept
+{
+    constexpr f32 h = static_cast<f32>(kSimStep);
+    constexpr f32 dc = -0.5f*kG*h*h;
+    constexpr f32 dv = -kG*h;
+
+    for (u32 s = 0; s < nbSteps; ++s) {
+        for (u32 i = 0; i < n; ++i) {
+            const f32 t = topy[i];
+            const f32 b = boty[i];
+            const f32 vt = topv[i];
+            const f32 vb = botv[i];
+
+            const f32 c = 0.5f*(t + b) + 0.5f*(vt + vb)*h + dc;
+            const f32 vc = 0.5f*(vt + vb) + dv;
+
+            const f32 x = k.xx*(t - b) + k.xv*(vt - vb);
+            const f32 vx = k.vx*(t - b) + k.vv*(vt - vb);
+
+            const f32 hb = c - 0.5f*x;
+            const f32 nvb = vc - 0.5f*vx;
+
+            // bounce off the floor when falling on it, lie on it otherwise
+            const bool hit = hb < kFloorY;
+            const bool falling = b > kFloorY && nvb < -kRestSpeed;
+
+            topy[i] = c + 0.5f*x;
+            topv[i] = vc + 0.5f*vx;
+            boty[i] = hit ? kFloorY : hb;
+            botv[i] = hit ? (falling ? -nvb : 0.0f) : nvb;
+        }
+    }
+}
+
+
+static void step_smileys_default( f32* topy, f32* boty, f32* topv, f32* botv
+                                , u32 n, u32 nbSteps, const SpringStep& k ) noexcept
+{
+    step_smileys(topy, boty, topv, botv, n, nbSteps, k);
+}
+
+
+#if defined(SMILEYS_TARGET_AVX2)
+SMILEYS_TARGET_AVX2
+static void step_smileys_avx2( f32* topy, f32* boty, f32* topv, f32* botv
+                             , u32 n, u32 nbSteps, const SpringStep& k ) noexcept
+{
+    step_smileys(topy, boty, topv, botv, n, nbSteps, k);
+}
+#endif
+
+}
+
+
+u32 smile::TakeSimSteps(f64& accumulated, f64 dT) noexcept {
+    accumulated += dT;
+
+    u32 nbSteps = 0;
+    while (accumulated >= kSimStep && nbSteps < kMaxSimSteps) {
+        accumulated -= kSimStep;
+        ++nbSteps;
+    }
+    if (kMaxSimSteps == nbSteps) {
+        // too long frame, let the simulation fall behind instead of
+        // spending even more time on the next one
+        accumulated = std::min(accumulated, kSimStep);
+    }
+
+    return nbSteps;
+}
+
+
+Smileys::Smileys() noexcept
+    : _size(0)
+    , _topy(nullptr), _boty(nullptr), _topv(nullptr), _botv(nullptr)
+    , _posx(nullptr), _kickv(nullptr)
+{}
+
+
+Rcode Smileys::setUp(u32 nbSmileys) noexcept {
+    constexpr u32 kNbArrays = 6;
+
+    std::unique_ptr<f32[]> storage;
+    try {
+        storage = std::make_unique<f32[]>(static_cast<std::size_t>(nbSmileys) * kNbArrays);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
+
+    _storage = std::move(storage);
+    _size = nbSmileys;
+
+    _topy  = _storage.get();
+    _boty  = _topy + nbSmileys;
+    _topv  = _boty + nbSmileys;
+    _botv  = _topv + nbSmileys;
+    _posx  = _botv + nbSmileys;
+    _kickv = _posx + nbSmileys;
+
+    // spread the smileys evenly over the floor and vary their kicks, so
+    // they don't jump in sync; a single smiley stands in the middle
+    constexpr f64 kGoldenRatioFrac = 0.6180339887498949;
+    for (u32 i = 0; i < nbSmileys; ++i) {
+        const f64 t = (i + 0.5) / nbSmileys;
+        const f64 r = std::fmod(i * kGoldenRatioFrac, 1.0);
+
+        _topy[i] = _boty[i] = kFloorY;
+        _topv[i] = _botv[i] = 0.0f;
+
+        _posx[i] = static_cast<f32>((2.0*t - 1.0) * (1.0 - kSmileySize/2.0));
+        _kickv[i] = static_cast<f32>(kKickSpeed * (1.0 - 0.25*r));
+    }
+
+    return eRcode_Ok;
+}
+
+
+void Smileys::step(u32 nbSteps, u32 begin, u32 end) noexcept {
+    static const SpringStep kStep = make_spring_step(kSimStep);
+
+    const u32 n = end - begin;
+
+#if defined(SMILEYS_TARGET_AVX2)
+    if (HasCpuFeature(CpuFeature::Avx2)) {
+        step_smileys_avx2(_topy + begin, _boty + begin, _topv + begin, _botv + begin, n, nbSteps, kStep);
+        return;
+    }
+#endif
+
+    step_smileys_default(_topy + begin, _boty + begin, _topv + begin, _botv + begin, n, nbSteps, kStep);
+}
+
+
+void Smileys::kick(u32 begin, u32 end) noexcept {
+    f32* __restrict topv = _topv;
+    f32* __restrict botv = _botv;
+    const f32* __restrict boty = _boty;
+    const f32* __restrict kickv = _kickv;
+
+    for (u32 i = begin; i < end; ++i) {
+        const bool still = boty[i] <= kFloorY + kFloorTolerance &&
+                           std::abs(topv[i]) <= kStillSpeed &&
+                           std::abs(botv[i]) <= kStillSpeed;
+
+        topv[i] = still ? -kickv[i] : topv[i];
+        botv[i] = still ? 0.0f : botv[i];
+    }
+}
+
+
+void Smileys::fill(GeomInstance* instances, u32 begin, u32 end) const noexcept {
+    const f32* __restrict topy = _topy;
+    const f32* __restrict boty = _boty;
+    const f32* __restrict posx = _posx;
+    GeomInstance* __restrict out = instances;
+
+    for (u32 i = begin; i < end; ++i) {
+        // keep the area of the squashed (or stretched) smiley
+        const f32 dx = topy[i] - boty[i];
+        const f32 ds = kSmileySize*kSmileySize/(kSmileySize - dx) - kSmileySize;
+
+        out[i].topx = posx[i] - ds/2.0f;
+        out[i].topy = topy[i];
+        out[i].botx = posx[i] + ds/2.0f;
+        out[i].boty = boty[i];
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SMILE_SMILEYS_HPP_
+
+#include <memory>
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+constexpr f32 kSmileySize = 0.5f;
+
+// fixed simulation step, sec
+constexpr f64 kSimStep = 1.0/240.0;
+
+// steps per frame at most, longer frames slow the simulation down
+constexpr u32 kMaxSimSteps = 24;
+
+
+// Adds the frame time dT to the accumulated time and takes the whole steps
+// out of it, returns their number.
+u32 TakeSimSteps(f64& accumulated, f64 dT) noexcept;
+
+
+// Bouncing smileys stored as structure of arrays, so a simulation step is
+// vectorized across the smileys. Every smiley is a top and a bottom edge
+// connected with a damped spring; the bottom bounces off (or lies on) the
+// floor and the smileys lying still are kicked down from the top.
+class Smileys {
+    Smileys(const Smileys&) = delete;
+    Smileys& operator = (const Smileys&) = delete;
+
+public:
+    Smileys() noexcept;
+
+    Rcode setUp(u32 nbSmileys) noexcept;
+
+    u32 size() const noexcept { return _size; }
+
+    // All of the methods below touch only the smileys [begin, end), so
+    // disjoint ranges are safe to process on different threads.
+
+    void step(u32 nbSteps, u32 begin, u32 end) noexcept;
+
+    // kicks the smileys lying still
+    void kick(u32 begin, u32 end) noexcept;
+
+    // fills instances[begin, end)
+    void fill(GeomInstance* instances, u32 begin, u32 end) const noexcept;
+
+private:
+    u32 _size;
+
+    std::unique_ptr<f32[]> _storage;
+
+    f32* _topy;
+    f32* _boty;
+    f32* _topv;
+    f32* _botv;
+
+    f32* _posx;
+    f32* _kickv;
+};
+
+
+}
+
+
+#define SMILE_SMILEYS_HPP_
+#endif
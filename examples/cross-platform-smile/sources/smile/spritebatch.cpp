@@ -0,0 +1,279 @@
+#include "spritebatch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <new>
+
+#include "smile/log.hpp"
+
+
+using namespace smile;
+
+
+SpriteBatch::SpriteBatch() noexcept
+    : _size(0), _reserved(0)
+    , _quadHalfSize(0.0f)
+    , _api(nullptr), _graph(nullptr), _quad{}, _buffer(nullptr), _capacity(0)
+    , _direct(nullptr), _committed(false)
+    , _stats{0, 0, 0}
+{}
+
+
+Rcode SpriteBatch::setUp(f32 quadHalfSize, u32 nbSprites) noexcept {
+    _quadHalfSize = quadHalfSize;
+    return reserve(nbSprites);
+}
+
+
+Rcode SpriteBatch::reserve(u32 nbSprites) noexcept {
+    if (nbSprites <= _reserved) {
+        return eRcode_Ok;
+    }
+
+    std::unique_ptr<GeomInstance[]> instances;
+    try {
+        instances = std::make_unique<GeomInstance[]>(nbSprites);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
+
+    if (_size > 0) {
+        std::memcpy(instances.get(), _instances.get(), sizeof(GeomInstance)*_size);
+    }
+
+    _instances = std::move(instances);
+    _reserved = nbSprites;
+
+    return eRcode_Ok;
+}
+
+
+void SpriteBatch::clear() noexcept {
+    _size = 0;
+    _runs.clear();
+
+    // the next region is taken by the first submit, this one is dropped
+    _direct = nullptr;
+    _committed = false;
+}
+
+
+Rcode SpriteBatch::submit( TextureDataPtr texture
+                         , const SpriteRect& rect, const SpriteTransform& transform ) noexcept
+{
+    GeomInstance* instance = append(texture, 1);
+    if (!instance) {
+        return eRcode_MemError;
+    }
+
+    // the instance offsets the corners of the quad
+    const f32 h = _quadHalfSize;
+    instance->topx = rect.right*transform.sx + transform.x - h;
+    instance->topy = rect.top*transform.sy + transform.y - h;
+    instance->botx = rect.left*transform.sx + transform.x + h;
+    instance->boty = rect.bottom*transform.sy + transform.y + h;
+
+    return eRcode_Ok;
+}
+
+
+GeomInstance* SpriteBatch::submit(TextureDataPtr texture, u32 nbSprites) noexcept {
+    return append(texture, nbSprites);
+}
+
+
+GeomInstance* SpriteBatch::append(TextureDataPtr texture, u32 nbSprites) noexcept {
+    if (0 == _size && !_direct && _buffer && nbSprites <= _capacity) {
+        _direct = static_cast<GeomInstance*>(_api->GetShaderBufferContent(_buffer));
+    }
+
+    if (_direct) {
+        // the flush draws the runs in the order they are written, so a
+        // texture may not come back once another one follows it
+        const bool inOrder = _runs.empty() || texture == _runs.back().texture
+                          || std::less<TextureDataPtr>()(_runs.back().texture, texture);
+        if (!inOrder || _size + nbSprites > _capacity) {
+            if (eRcode_Ok != stage(_size + nbSprites)) {
+                return nullptr;
+            }
+        }
+    }
+
+    if (!_direct && _size + nbSprites > _reserved) {
+        if (eRcode_Ok != reserve(std::max(_size + nbSprites, 2*_reserved))) {
+            return nullptr;
+        }
+    }
+
+    if (!_runs.empty() && texture == _runs.back().texture) {
+        _runs.back().count += nbSprites;
+    } else {
+        try {
+            _runs.push_back(Run{texture, _size, nbSprites});
+        } catch (std::bad_alloc&) {
+            return nullptr;
+        }
+    }
+
+    GeomInstance* instances = (_direct ? _direct : _instances.get()) + _size;
+    _size += nbSprites;
+
+    return instances;
+}
+
+
+Rcode SpriteBatch::stage(u32 nbSprites) noexcept {
+    // reads the region back, it's rare enough not to matter
+    const u32 size = _size;
+    _size = 0;
+
+    Rcode rc = reserve(std::max(nbSprites, 2*_reserved));
+    _size = size;
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
+
+    std::memcpy(_instances.get(), _direct, sizeof(GeomInstance)*_size);
+    _direct = nullptr;
+
+    return eRcode_Ok;
+}
+
+
+Rcode SpriteBatch::load(const PlatformApi& api, GraphContextPtr graph, const SpriteQuad& quad) noexcept {
+    if (_buffer) {
+        return eRcode_Already;
+    }
+
+    const u32 capacity = std::max(_reserved, 1u);
+    Rcode rc = api.CreateShaderBuffer(&_buffer, graph, sizeof(GeomInstance)*capacity, eBufferType_Instance, 0);
+    if (eRcode_Ok != rc) {
+        _buffer = nullptr;
+        return rc;
+    }
+
+    _api = &api;
+    _graph = graph;
+    _quad = quad;
+    _capacity = capacity;
+
+    return eRcode_Ok;
+}
+
+
+void SpriteBatch::unload(const PlatformApi& api) noexcept {
+    if (_buffer) {
+        api.ReleaseShaderBuffer(_buffer);
+    }
+
+    _buffer = nullptr;
+    _capacity = 0;
+
+    _api = nullptr;
+    _direct = nullptr;
+    _committed = false;
+}
+
+
+Rcode SpriteBatch::grow(const PlatformApi& api) noexcept {
+    const u32 capacity = std::max(_size, 2*_capacity);
+
+    ShaderBufferPtr buffer = nullptr;
+    Rcode rc = api.CreateShaderBuffer(&buffer, _graph, sizeof(GeomInstance)*capacity, eBufferType_Instance, 0);
+    if (eRcode_Ok != rc) {
+        return rc;
+    }
+
+    api.ReleaseShaderBuffer(_buffer);
+    _buffer = buffer;
+    _capacity = capacity;
+
+    SMILE_LOG(Debug) << "Sprite instance buffer grown to " << capacity << " sprites";
+
+    return eRcode_Ok;
+}
+
+
+Rcode SpriteBatch::flush(const PlatformApi& api, FrameEncoderPtr encoder) noexcept {
+    _stats = SpriteStats{0, 0, 0};
+
+    if (!_buffer) {
+        return eRcode_NotInitialized;
+    }
+
+    if (0 == _size) {
+        return eRcode_Ok;
+    }
+
+    Rcode rc;
+
+    if (!_direct) {
+        if (_size > _capacity) {
+            rc = grow(api);
+            if (eRcode_Ok != rc) return rc;
+        }
+
+        // group the runs by texture, stable to keep the submission order (so
+        // the overlapping) of the sprites within a texture
+        const auto byTexture = [](const Run& a, const Run& b) noexcept {
+            return std::less<TextureDataPtr>()(a.texture, b.texture);
+        };
+        if (!std::is_sorted(_runs.begin(), _runs.end(), byTexture)) {
+            try {
+                std::stable_sort(_runs.begin(), _runs.end(), byTexture);
+            } catch (std::bad_alloc&) {
+                return eRcode_MemError;
+            }
+        }
+
+        GeomInstance* contents = static_cast<GeomInstance*>(api.GetShaderBufferContent(_buffer));
+        if (!contents) {
+            return eRcode_InternalError;
+        }
+
+        u32 at = 0;
+        for (const Run& run : _runs) {
+            std::memcpy(contents + at, &_instances[run.first], sizeof(GeomInstance)*run.count);
+            at += run.count;
+        }
+    }
+
+    // a frame with no new sprites draws the committed region again
+    if (!_committed) {
+        rc = api.CommitShaderBuffer(_buffer, 0, sizeof(GeomInstance)*_size);
+        if (eRcode_Ok != rc) return rc;
+
+        _committed = nullptr != _direct;
+    }
+
+    rc = api.SetVertexBuffer(encoder, _quad.vertices, 0);
+    if (eRcode_Ok != rc) return rc;
+
+    u32 first = 0;
+    for (std::size_t i = 0; i < _runs.size();) {
+        const TextureDataPtr texture = _runs[i].texture;
+
+        u32 count = 0;
+        for (; i < _runs.size() && texture == _runs[i].texture; ++i) {
+            count += _runs[i].count;
+        }
+
+        rc = api.SetVertexBuffer(encoder, _buffer, sizeof(GeomInstance)*first);
+        if (eRcode_Ok != rc) return rc;
+
+        rc = api.SetTextureSlot(encoder, texture);
+        if (eRcode_Ok != rc) return rc;
+
+        rc = api.DrawIndexedPrimitive(encoder, _quad.nb_indicies, count, _quad.indicies);
+        if (eRcode_Ok != rc) return rc;
+
+        ++_stats.nb_draws;
+        _stats.nb_sprites += count;
+        _stats.max_sprites_per_draw = std::max(_stats.max_sprites_per_draw, count);
+
+        first += count;
+    }
+
+    return eRcode_Ok;
+}
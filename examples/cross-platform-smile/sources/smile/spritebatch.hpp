@@ -0,0 +1,122 @@
+#ifndef SMILE_SPRITEBATCH_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Axis aligned rectangle in the view space.
+struct SpriteRect {
+    f32 left;
+    f32 bottom;
+    f32 right;
+    f32 top;
+};
+
+// Scale about the origin followed by a translation. The instances keep the
+// quad axis aligned, so there is no rotation.
+struct SpriteTransform {
+    f32 x{0.0f};
+    f32 y{0.0f};
+    f32 sx{1.0f};
+    f32 sy{1.0f};
+};
+
+// The shared quad every sprite is an instance of.
+struct SpriteQuad {
+    ShaderBufferPtr vertices;
+    ShaderBufferPtr indicies;
+    u32 nb_indicies;
+};
+
+
+// Collects the sprites of a frame and draws them with one instanced call
+// per texture: the sprites are grouped by texture (keeping the submission
+// order within a texture) into a growable instance buffer. Once loaded, the
+// sprites are written straight into the streamed instance buffer as long as
+// the textures come in order (say, a single one) and fit the buffer;
+// otherwise they are staged and sorted into the buffer by the flush.
+class SpriteBatch {
+    SpriteBatch(const SpriteBatch&) = delete;
+    SpriteBatch& operator = (const SpriteBatch&) = delete;
+
+public:
+    SpriteBatch() noexcept;
+
+    // CPU side, works with no graphics resources loaded.
+
+    // the quad vertices span [-quadHalfSize, quadHalfSize] on both axes
+    Rcode setUp(f32 quadHalfSize, u32 nbSprites) noexcept;
+
+    Rcode reserve(u32 nbSprites) noexcept;
+
+    // starts a new frame
+    void clear() noexcept;
+
+    Rcode submit(TextureDataPtr texture, const SpriteRect& rect, const SpriteTransform& transform) noexcept;
+
+    // Appends nbSprites sprites of the texture and returns their instances
+    // for the caller to fill (write only, they may be mapped GPU memory)
+    // until the next submit; nullptr if out of memory.
+    GeomInstance* submit(TextureDataPtr texture, u32 nbSprites) noexcept;
+
+    u32 size() const noexcept { return _size; }
+
+    // Graphics side.
+
+    // Creates the instance buffer for the reserved number of sprites; the
+    // sprites are submitted on the thread of the graphics context from now.
+    Rcode load(const PlatformApi& api, GraphContextPtr graph, const SpriteQuad& quad) noexcept;
+    void unload(const PlatformApi& api) noexcept;
+
+    // draws the sprites submitted since the last clear
+    Rcode flush(const PlatformApi& api, FrameEncoderPtr encoder) noexcept;
+
+    // of the last flush
+    const SpriteStats& stats() const noexcept { return _stats; }
+
+private:
+    // sprites of one texture submitted in a row
+    struct Run {
+        TextureDataPtr texture;
+        u32 first;
+        u32 count;
+    };
+
+    GeomInstance* append(TextureDataPtr texture, u32 nbSprites) noexcept;
+
+    // moves the sprites written straight into the buffer to the staging ones
+    Rcode stage(u32 nbSprites) noexcept;
+
+    Rcode grow(const PlatformApi& api) noexcept;
+
+    std::unique_ptr<GeomInstance[]> _instances;
+    u32 _size;
+    u32 _reserved;
+
+    std::vector<Run> _runs;
+
+    f32 _quadHalfSize;
+
+    const PlatformApi* _api;
+    GraphContextPtr _graph;
+    SpriteQuad _quad;
+    ShaderBufferPtr _buffer;
+    u32 _capacity; // of the instance buffer, sprites
+
+    GeomInstance* _direct; // the region of the frame if written straight into
+    bool _committed;       // the region is drawn as is by the next flushes
+
+    SpriteStats _stats;
+};
+
+
+}
+
+
+#define SMILE_SPRITEBATCH_HPP_
+#endif
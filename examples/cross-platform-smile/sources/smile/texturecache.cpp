@@ -0,0 +1,107 @@
+#include "texturecache.hpp"
+
+#include <stdio.h>
+
+#include <cstring>
+
+#include "pixelconv.hpp"
+
+
+using namespace smile;
+
+
+namespace {
+
+constexpr u32 kTextureBlobMagic = 0x58544D53; // 'SMTX'
+constexpr u32 kTextureBlobLayoutVersion = 1;
+
+constexpr u32 kTextureBlobVersion =
+    (kTextureBlobLayoutVersion << 16) | imageutils::kPixelConvVersion;
+
+constexpr u64 kFnvOffsetBasis = 0xcbf29ce484222325ull;
+constexpr u64 kFnvPrime = 0x100000001b3ull;
+
+}
+
+
+u64 smile::HashAsset(const AssetData& asset) noexcept {
+    // FNV-1a, the size is mixed in so truncated files never collide
+    u64 hash = kFnvOffsetBasis;
+    for (u32 i = 0; i < asset.size; ++i) {
+        hash = (hash ^ asset.data[i]) * kFnvPrime;
+    }
+
+    return (hash ^ asset.size) * kFnvPrime;
+}
+
+
+bool smile::MakeTextureBlobName(const char* assetname, char (&name)[kMaxTextureBlobName]) noexcept {
+    const int nb = snprintf(name, kMaxTextureBlobName, "%s.blob", assetname);
+    return nb > 0 && static_cast<u32>(nb) < kMaxTextureBlobName;
+}
+
+
+bool smile::ReadTextureBlob( const AssetData& blob, u64 sourceHash
+                           , imageutils::ColorFormat format, ImageData& image ) noexcept
+{
+    TextureBlobHeader header;
+    if (!blob.data || blob.size < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, blob.data, sizeof(header));
+
+    if (kTextureBlobMagic != header.magic || kTextureBlobVersion != header.version) {
+        return false;
+    }
+
+    if (sourceHash != header.source_hash || static_cast<u32>(format) != header.format) {
+        return false;
+    }
+
+    if (header.szdata != blob.size - sizeof(header) ||
+        static_cast<u64>(header.szrow) * header.height > header.szdata)
+    {
+        return false;
+    }
+
+    image.data = blob.data + sizeof(header);
+    image.szdata = header.szdata;
+    image.width = header.width;
+    image.height = header.height;
+    image.szrow = header.szrow;
+
+    return true;
+}
+
+
+Rcode smile::StoreTextureBlob( const PlatformApi& api, const char* assetname, u64 sourceHash
+                             , imageutils::ColorFormat format, const ImageData& image ) noexcept
+{
+    if (!api.StoreCachedAsset) {
+        return eRcode_NotInitialized;
+    }
+
+    char name[kMaxTextureBlobName];
+    if (!MakeTextureBlobName(assetname, name)) {
+        return eRcode_InvalidInput;
+    }
+
+    TextureBlobHeader header;
+    header.magic = kTextureBlobMagic;
+    header.version = kTextureBlobVersion;
+    header.source_hash = sourceHash;
+    header.width = image.width;
+    header.height = image.height;
+    header.szrow = image.szrow;
+    header.format = static_cast<u32>(format);
+    header.szdata = image.szdata;
+    header.reserved = 0;
+
+    const AssetData chunks[] = {
+        { reinterpret_cast<byte*>(&header), static_cast<u32>(sizeof(header)) },
+        { image.data, image.szdata },
+    };
+
+    return api.StoreCachedAsset(name, chunks, sizeof(chunks)/sizeof(chunks[0]));
+}
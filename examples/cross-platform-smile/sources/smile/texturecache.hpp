@@ -0,0 +1,47 @@
+#ifndef SMILE_TEXTURECACHE_HPP_
+
+#include "smile/smile.h"
+
+#include "imageutils.hpp"
+
+
+namespace smile {
+
+
+// Cached texture blob: this header followed by 'szdata' bytes of pixels.
+struct TextureBlobHeader {
+    u32 magic;
+    u32 version;     // blob layout and pixel converter versions
+    u64 source_hash; // of the source asset bytes
+    u32 width;
+    u32 height;
+    u32 szrow;
+    u32 format;      // imageutils::ColorFormat
+    u32 szdata;
+    u32 reserved;
+};
+
+static_assert(sizeof(TextureBlobHeader) == 40, "TextureBlobHeader is stored as is");
+
+
+u64 HashAsset(const AssetData& asset) noexcept;
+
+constexpr u32 kMaxTextureBlobName = 512;
+
+// Name under which the blob of the given asset is cached.
+bool MakeTextureBlobName(const char* assetname, char (&name)[kMaxTextureBlobName]) noexcept;
+
+// Points 'image' to the pixels of 'blob' if the blob is intact, up to date
+// with the source and holds pixels of the given format.
+bool ReadTextureBlob( const AssetData& blob, u64 sourceHash
+                    , imageutils::ColorFormat format, ImageData& image ) noexcept;
+
+Rcode StoreTextureBlob( const PlatformApi& api, const char* assetname, u64 sourceHash
+                      , imageutils::ColorFormat format, const ImageData& image ) noexcept;
+
+
+}
+
+
+#define SMILE_TEXTURECACHE_HPP_
+#endif
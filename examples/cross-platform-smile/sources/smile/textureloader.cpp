@@ -0,0 +1,301 @@
+#include "textureloader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "imageutils.hpp"
+#include "pixelconv.hpp"
+#include "texturecache.hpp"
+
+#include "smile/log.hpp"
+
+
+using namespace smile;
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+static f64 seconds_since(Clock::time_point t0) noexcept {
+    return std::chrono::duration<f64>(Clock::now() - t0).count();
+}
+
+
+constexpr imageutils::ColorFormat kTextureFormat = imageutils::ColorFormat::R8G8B8A8;
+
+
+struct decoded_texture_t {
+    std::unique_ptr<imageutils::Png> png; // decoded image, or
+    AssetData blob{nullptr, 0};           // the cached one
+    ImageData image;
+
+    Rcode rc{eRcode_Ok};
+    bool cached{false};
+    bool baked{false};
+
+    f64 read_time{0.0};
+    f64 decode_time{0.0};
+};
+
+struct batch_t {
+    const PlatformApi* api{nullptr};
+    JobSystem* jobs{nullptr}; // large images are converted in bands on them
+    const char* const* names{nullptr};
+    u32 nb_names{0};
+
+    decoded_texture_t* results{nullptr};
+
+    // indices of the textures to decode, the rest come from the asset pack
+    std::vector<u32> pending;
+
+    std::atomic<u32> next{0};
+    std::atomic<bool> cancelled{false};
+
+    // indices of decoded textures in completion order, reserved for all
+    // of the names so the workers never allocate under the lock
+    std::vector<u32> completed;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+
+static bool load_cached_texture(const batch_t& batch, u32 index, u64 sourceHash) noexcept {
+    decoded_texture_t& result = batch.results[index];
+
+    char name[kMaxTextureBlobName];
+    if (!batch.api->LoadCachedAsset || !MakeTextureBlobName(batch.names[index], name)) {
+        return false;
+    }
+
+    if (eRcode_Ok != batch.api->LoadCachedAsset(&result.blob, name)) {
+        result.blob.data = nullptr;
+        return false;
+    }
+
+    if (!ReadTextureBlob(result.blob, sourceHash, kTextureFormat, result.image)) {
+        SMILE_LOG(Debug) << "Cached texture " << name << " is stale";
+        batch.api->FreeAsset(&result.blob);
+        result.blob.data = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+static void decode_texture(const batch_t& batch, u32 index) noexcept {
+    decoded_texture_t& result = batch.results[index];
+
+    Clock::time_point t0 = Clock::now();
+
+    AssetData asset;
+    result.rc = batch.api->LoadAsset(&asset, const_cast<char*>(batch.names[index]));
+    if (eRcode_Ok != result.rc) {
+        result.read_time = seconds_since(t0);
+        return;
+    }
+
+    const u64 sourceHash = HashAsset(asset);
+
+    result.cached = load_cached_texture(batch, index, sourceHash);
+    result.read_time = seconds_since(t0);
+    if (result.cached) {
+        batch.api->FreeAsset(&asset);
+        return;
+    }
+
+    t0 = Clock::now();
+    try {
+        result.png = std::make_unique<imageutils::Png>();
+        result.rc = result.png->load(asset, kTextureFormat, *batch.jobs);
+    } catch (std::bad_alloc&) {
+        result.rc = eRcode_MemError;
+    }
+    batch.api->FreeAsset(&asset);
+    result.decode_time = seconds_since(t0);
+
+    if (eRcode_Ok != result.rc) {
+        return;
+    }
+
+    result.image = result.png->image();
+
+    if (batch.api->StoreCachedAsset) {
+        Rcode rc = StoreTextureBlob( *batch.api, batch.names[index], sourceHash
+                                   , kTextureFormat, result.image );
+        if (eRcode_Ok != rc) {
+            SMILE_LOG(Warning) << "Failed to cache texture " << batch.names[index]
+                               << ": " << smile_ToString(rc);
+        }
+    }
+}
+
+
+static void decode_textures(batch_t& batch) noexcept {
+    while (!batch.cancelled.load(std::memory_order_relaxed)) {
+        const u32 next = batch.next.fetch_add(1, std::memory_order_relaxed);
+        if (next >= batch.pending.size()) {
+            break;
+        }
+
+        const u32 index = batch.pending[next];
+
+        decode_texture(batch, index);
+
+        {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.completed.push_back(index);
+        }
+        batch.cv.notify_one();
+    }
+}
+
+
+static void decode_textures_job(void* arg, u32, u32) {
+    decode_textures(*static_cast<batch_t*>(arg));
+}
+
+}
+
+
+Rcode smile::LoadTextures( SmileContext* pCtx, GraphContextPtr pGraph
+                         , const char* const* names, u32 nbNames
+                         , TextureDataPtr* outTextures, const AssetPack* pPack
+                         , JobSystem& jobs, TextureLoadStats* pStats ) noexcept
+{
+    if (!pCtx || (nbNames > 0 && (!names || !outTextures))) {
+        return eRcode_InvalidInput;
+    }
+
+    const Clock::time_point tStart = Clock::now();
+
+    std::unique_ptr<decoded_texture_t[]> results;
+    batch_t batch;
+
+    try {
+        results = std::make_unique<decoded_texture_t[]>(nbNames);
+        batch.completed.reserve(nbNames);
+        batch.pending.reserve(nbNames);
+    } catch (std::bad_alloc&) {
+        return eRcode_MemError;
+    }
+
+    batch.api = &pCtx->platform_api;
+    batch.jobs = &jobs;
+    batch.names = names;
+    batch.nb_names = nbNames;
+    batch.results = results.get();
+
+    // textures baked with another converter are decoded from the sources
+    const bool usePack = pPack && pPack->isOpen() &&
+                         imageutils::kPixelConvVersion == pPack->pixelConvVersion();
+
+    for (u32 i = 0; i < nbNames; ++i) {
+        outTextures[i] = nullptr;
+
+        if (usePack && pPack->texture(names[i], static_cast<u32>(kTextureFormat), results[i].image)) {
+            results[i].baked = true;
+            batch.completed.push_back(i);
+        } else {
+            batch.pending.push_back(i);
+        }
+    }
+
+    // a decoder per worker, every one takes the next pending texture until
+    // there are none left
+    const u32 nbDecoders = std::min(jobs.nbWorkers(), static_cast<u32>(batch.pending.size()));
+
+    JobCounter decoders;
+    for (u32 t = 0; t < nbDecoders; ++t) {
+        jobs.run(&decode_textures_job, &batch, 0, 0, decoders);
+    }
+
+    TextureLoadStats stats;
+    stats.nb_textures = nbNames;
+    stats.nb_threads = nbDecoders > 0 ? nbDecoders : 1;
+
+    if (0 == nbDecoders) {
+        decode_textures(batch);
+    }
+
+    Rcode rc = eRcode_Ok;
+
+    for (u32 k = 0; k < nbNames; ++k) {
+        u32 index;
+        {
+            std::unique_lock<std::mutex> lock(batch.mutex);
+            batch.cv.wait(lock, [&batch, k]() { return batch.completed.size() > k; });
+            index = batch.completed[k];
+        }
+
+        decoded_texture_t& result = results[index];
+        stats.read_time += result.read_time;
+        stats.decode_time += result.decode_time;
+        stats.nb_cached += result.cached ? 1 : 0;
+        stats.nb_baked += result.baked ? 1 : 0;
+
+        if (eRcode_Ok != result.rc) {
+            SMILE_LOG(Error) << "Failed to decode texture " << names[index]
+                             << ": " << smile_ToString(result.rc);
+            rc = result.rc;
+            break;
+        }
+
+        const Clock::time_point t0 = Clock::now();
+        TextureDataPtr texture = nullptr;
+        rc = pCtx->platform_api.CreateTextureFromImage(&texture, pGraph, &result.image);
+        stats.upload_time += seconds_since(t0);
+
+        // the image is in the texture now, no need to hold it till the end
+        result.png.reset();
+        if (result.blob.data) {
+            pCtx->platform_api.FreeAsset(&result.blob);
+            result.blob.data = nullptr;
+        }
+
+        if (eRcode_Ok != rc) {
+            SMILE_LOG(Error) << "Failed to create texture " << names[index]
+                             << ": " << smile_ToString(rc);
+            break;
+        }
+
+        outTextures[index] = texture;
+    }
+
+    if (eRcode_Ok != rc) {
+        batch.cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    jobs.wait(decoders);
+
+    // blobs of the textures left not uploaded
+    for (u32 i = 0; i < nbNames; ++i) {
+        if (results[i].blob.data) {
+            pCtx->platform_api.FreeAsset(&results[i].blob);
+        }
+    }
+
+    if (eRcode_Ok != rc) {
+        for (u32 i = 0; i < nbNames; ++i) {
+            if (outTextures[i]) {
+                pCtx->platform_api.ReleaseTexture(outTextures[i]);
+                outTextures[i] = nullptr;
+            }
+        }
+    }
+
+    stats.wall_time = seconds_since(tStart);
+
+    if (pStats) {
+        *pStats = stats;
+    }
+
+    return rc;
+}
@@ -0,0 +1,41 @@
+#ifndef SMILE_TEXTURELOADER_HPP_
+
+#include "jobsystem.hpp"
+
+#include "smile/assetpack.hpp"
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+struct TextureLoadStats {
+    u32 nb_textures{0};
+    u32 nb_threads{0}; // decoding ones
+    u32 nb_cached{0}; // taken from the texture cache, not decoded
+    u32 nb_baked{0};  // taken from the asset pack, not decoded
+
+    // seconds, summed over all of the loaded textures
+    f64 read_time{0.0};
+    f64 decode_time{0.0};
+    f64 upload_time{0.0};
+
+    // seconds, from the call till the last upload
+    f64 wall_time{0.0};
+};
+
+
+// Decodes the textures to R8G8B8A8 as jobs, skipping the ones baked into
+// pPack (may be null) or cached by the platform, and uploads them on the
+// calling thread, which owns the graphics context; none is left on failure.
+Rcode LoadTextures( SmileContext* pCtx, GraphContextPtr pGraph
+                  , const char* const* names, u32 nbNames
+                  , TextureDataPtr* outTextures, const AssetPack* pPack
+                  , JobSystem& jobs, TextureLoadStats* pStats ) noexcept;
+
+
+}
+
+
+#define SMILE_TEXTURELOADER_HPP_
+#endif
@@ -0,0 +1,66 @@
+#ifndef SMILE_TRIPLEBUFFER_HPP_
+
+#include <atomic>
+
+#include "smile/smile.h"
+
+
+namespace smile {
+
+
+// Lock-free triple buffer: a single writer fills the back slot and publishes
+// it, a single reader fetches the latest published slot. Neither side ever
+// waits, the writer just overwrites the snapshots the reader didn't fetch.
+template <typename T>
+class TripleBuffer {
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator = (const TripleBuffer&) = delete;
+
+public:
+    TripleBuffer() noexcept : _back(0), _middle(1), _front(2) {}
+
+    // Writer side.
+
+    T& back() noexcept { return _slots[_back]; }
+
+    void publish() noexcept {
+        _back = _middle.exchange(_back | kFresh, std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // Reader side.
+
+    bool fresh() const noexcept { return 0 != (_middle.load(std::memory_order_relaxed) & kFresh); }
+
+    // returns false if nothing was published since the last fetch
+    bool fetch() noexcept {
+        if (!fresh()) {
+            return false;
+        }
+
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+
+    T& front() noexcept { return _slots[_front]; }
+
+    // Any side, while the other one doesn't touch the buffer.
+
+    T& slot(u32 index) noexcept { return _slots[index]; }
+
+private:
+    static constexpr u32 kIndexMask = 0x3;
+    static constexpr u32 kFresh = 0x4;
+
+    T _slots[3];
+
+    alignas(64) u32 _back;
+    alignas(64) std::atomic<u32> _middle;
+    alignas(64) u32 _front;
+};
+
+
+}
+
+
+#define SMILE_TRIPLEBUFFER_HPP_
+#endif
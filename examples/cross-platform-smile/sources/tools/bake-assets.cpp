@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "imageutils.hpp"
+#include "pixelconv.hpp"
+
+#include "smile/assetpack.hpp"
+#include "smile/smile.h"
+
+
+using namespace smile;
+
+
+// Textures are baked into the format the engine uploads.
+static constexpr imageutils::ColorFormat kTextureFormat = imageutils::ColorFormat::R8G8B8A8;
+
+
+struct BakedAsset {
+    AssetPackEntry entry;
+    std::vector<byte> data;
+};
+
+
+static
+bool ReadFile(const std::string& path, std::vector<byte>& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+
+    fseek(f, 0L, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+
+    out.resize(sz > 0 ? static_cast<std::size_t>(sz) : 0);
+    size_t nb = fread(out.data(), 1, out.size(), f);
+    fclose(f);
+
+    return nb == out.size();
+}
+
+
+static
+Rcode BakeAsset(const std::string& name, const std::string& path, BakedAsset& out) {
+    if (name.size() >= kMaxAssetPackName) {
+        std::cerr << "Asset name is too long: " << name << std::endl;
+        return eRcode_InvalidInput;
+    }
+
+    std::vector<byte> content;
+    if (!ReadFile(path, content)) {
+        std::cerr << "Failed to read " << path << std::endl;
+        return eRcode_InvalidInput;
+    }
+
+    std::memset(&out.entry, 0, sizeof(out.entry));
+    std::memcpy(out.entry.name, name.c_str(), name.size());
+
+    if (!std::string_view(name).ends_with(".png")) {
+        out.entry.kind = static_cast<u32>(AssetPackKind::Raw);
+        out.data = std::move(content);
+        return eRcode_Ok;
+    }
+
+    AssetData asset{content.data(), static_cast<u32>(content.size())};
+
+    imageutils::Png png;
+    Rcode rc = png.load(asset, kTextureFormat);
+    if (eRcode_Ok != rc) {
+        std::cerr << "Failed to decode " << path << ": " << smile_ToString(rc) << std::endl;
+        return rc;
+    }
+
+    const ImageData& image = png.image();
+
+    out.entry.kind = static_cast<u32>(AssetPackKind::Texture);
+    out.entry.format = static_cast<u32>(kTextureFormat);
+    out.entry.width = image.width;
+    out.entry.height = image.height;
+    out.entry.szrow = image.szrow;
+    out.data.assign(image.data, image.data + image.szdata);
+
+    return eRcode_Ok;
+}
+
+
+static
+bool WritePack(const std::string& path, std::vector<BakedAsset>& assets) {
+    std::sort(assets.begin(), assets.end(), [](const BakedAsset& a, const BakedAsset& b) {
+        return std::strcmp(a.entry.name, b.entry.name) < 0;
+    });
+
+    // the engine looks entries up by name
+    for (std::size_t i = 1; i < assets.size(); ++i) {
+        if (0 == std::strcmp(assets[i - 1].entry.name, assets[i].entry.name)) {
+            std::cerr << "Duplicate asset " << assets[i].entry.name << std::endl;
+            return false;
+        }
+    }
+
+    AssetPackHeader header;
+    header.magic = kAssetPackMagic;
+    header.version = kAssetPackVersion;
+    header.pixelconv_version = imageutils::kPixelConvVersion;
+    header.nb_entries = static_cast<u32>(assets.size());
+
+    u64 offset = sizeof(header) + sizeof(AssetPackEntry) * assets.size();
+    for (auto& asset : assets) {
+        offset = (offset + kAssetPackAlignment - 1) / kAssetPackAlignment * kAssetPackAlignment;
+        asset.entry.offset = static_cast<u32>(offset);
+        asset.entry.size = static_cast<u32>(asset.data.size());
+        offset += asset.data.size();
+    }
+
+    if (offset > UINT32_MAX) {
+        std::cerr << "Asset pack is too large" << std::endl;
+        return false;
+    }
+
+    std::vector<byte> pack(static_cast<std::size_t>(offset), 0);
+    std::memcpy(pack.data(), &header, sizeof(header));
+    for (std::size_t i = 0; i < assets.size(); ++i) {
+        std::memcpy(pack.data() + sizeof(header) + i * sizeof(AssetPackEntry),
+                    &assets[i].entry, sizeof(AssetPackEntry));
+        std::copy(assets[i].data.begin(), assets[i].data.end(),
+                  pack.begin() + assets[i].entry.offset);
+    }
+
+    // write aside and rename, so an interrupted build never leaves a partial pack
+    const std::string tmppath = path + ".tmp";
+    FILE* f = fopen(tmppath.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Failed to open " << tmppath << std::endl;
+        return false;
+    }
+
+    bool ok = pack.size() == fwrite(pack.data(), 1, pack.size(), f);
+    ok = (0 == fclose(f)) && ok;
+
+    if (ok) {
+        remove(path.c_str());
+        ok = 0 == rename(tmppath.c_str(), path.c_str());
+    }
+
+    if (!ok) {
+        std::cerr << "Failed to write " << path << std::endl;
+        remove(tmppath.c_str());
+    }
+
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <pack> [<name>=<path>...]" << std::endl;
+        return 1;
+    }
+
+    std::vector<BakedAsset> assets(static_cast<std::size_t>(argc - 2));
+
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        std::size_t eq = arg.find('=');
+        if (std::string_view::npos == eq || 0 == eq) {
+            std::cerr << "Expected <name>=<path>, got " << arg << std::endl;
+            return 1;
+        }
+
+        Rcode rc = BakeAsset( std::string(arg.substr(0, eq))
+                            , std::string(arg.substr(eq + 1))
+                            , assets[i - 2] );
+        if (eRcode_Ok != rc) {
+            return 1;
+        }
+    }
+
+    if (!WritePack(argv[1], assets)) {
+        return 1;
+    }
+
+    std::cout << "Baked " << assets.size() << " assets into " << argv[1] << std::endl;
+
+    return 0;
+}
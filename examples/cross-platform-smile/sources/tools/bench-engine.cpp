@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "nullapi.hpp"
+
+#include "smile/apitrace.hpp"
+#include "smile/profiler.hpp"
+#include "smile/smile.h"
+
+
+// the engine is stepped with the same time every frame, so the runs repeat
+static constexpr float kFrameTime = 1.0f/60.0f; // sec
+
+
+static
+Rcode LoadAsset(AssetData* out, char* assetname) {
+    if (!out || !assetname) {
+        return eRcode_InvalidInput;
+    }
+
+    const std::string path = std::string(SMILE_BENCH_ASSETS_DIR "/") + assetname;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return eRcode_InvalidInput;
+    }
+
+    fseek(f, 0L, SEEK_END);
+    long sz = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+
+    if (sz <= 0) {
+        fclose(f);
+        return eRcode_InvalidInput;
+    }
+
+    out->data = static_cast<byte*>(malloc(static_cast<size_t>(sz)));
+    if (!out->data) {
+        fclose(f);
+        return eRcode_MemError;
+    }
+
+    out->size = static_cast<u32>(fread(out->data, 1, static_cast<size_t>(sz), f));
+    fclose(f);
+
+    if (out->size != static_cast<u32>(sz)) {
+        free(out->data);
+        out->data = nullptr;
+        return eRcode_InternalError;
+    }
+
+    return eRcode_Ok;
+}
+
+
+static
+Rcode FreeAsset(AssetData* data) {
+    if (!data || !data->data)
+        return eRcode_Already;
+
+    free(data->data);
+    data->data = nullptr;
+
+    return eRcode_Ok;
+}
+
+
+struct BenchResult {
+    u64 nbFrames{0};    // completed
+    f64 total{0.0};     // sec
+    f64 cpuUpdate{0.0}; // sec
+    f64 cpuRender{0.0}; // sec
+    null_api::NullApiStats stats;
+};
+
+
+// Sets up the engine, runs the frames and tears it down; the graphics calls
+// are captured to capturePath unless it's null. Returns false if any step
+// failed, the result then covers the frames run before the failure.
+static
+bool RunEngine(u64 nbFrames, u32 nbSmileys, u32 nbThreads, const char* capturePath, BenchResult& result) {
+    SmileContext ctx{};
+    null_api::SetGraphicsApi(ctx.platform_api);
+    ctx.platform_api.LoadAsset = &LoadAsset;
+    ctx.platform_api.FreeAsset = &FreeAsset;
+    ctx.nb_smileys = nbSmileys;
+    ctx.nb_threads = nbThreads;
+
+    // the graphics calls are written to a trace, the same on every run
+    const bool capturing = capturePath && *capturePath;
+    if (capturing) {
+        Rcode rc = smile::StartApiCapture(ctx.platform_api, capturePath);
+        if (eRcode_Ok != rc) {
+            std::cerr << "Failed to start api capture: " << smile_ToString(rc) << std::endl;
+            return false;
+        }
+    }
+
+    Rcode rc = smile_SetUp(&ctx);
+    if (eRcode_Ok != rc) {
+        std::cerr << "Failed to set up smile engine: " << smile_ToString(rc) << std::endl;
+        return false;
+    }
+
+    rc = smile_ReloadResources(&ctx, nullptr);
+    if (eRcode_Ok != rc) {
+        std::cerr << "Failed to reload resources: " << smile_ToString(rc) << std::endl;
+        smile_TearDown(&ctx);
+        return false;
+    }
+
+    if (capturing) {
+        smile::MarkApiCaptureFrame();
+    }
+
+    // only the frames are counted
+    null_api::ResetNullApiStats();
+
+    FrameEncoder encoder;
+    result = BenchResult{};
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+
+    bool succeeded = true;
+    for (u64 i = 0; i < nbFrames; ++i) {
+        rc = smile_Update(&ctx, kFrameTime);
+        if (eRcode_Ok != rc) {
+            std::cerr << "Failed to update frame " << i << ": " << smile_ToString(rc) << std::endl;
+            succeeded = false;
+            break;
+        }
+
+        rc = smile_Render(&ctx, &encoder);
+        if (eRcode_Ok != rc) {
+            std::cerr << "Failed to render frame " << i << ": " << smile_ToString(rc) << std::endl;
+            succeeded = false;
+            break;
+        }
+
+        if (capturing) {
+            smile::MarkApiCaptureFrame();
+        }
+
+        FrameStats frameStats;
+        if (eRcode_Ok == smile_GetFrameStats(&ctx, &frameStats)) {
+            result.cpuUpdate += frameStats.cpu_update;
+            result.cpuRender += frameStats.cpu_render;
+        }
+
+        ++result.nbFrames;
+    }
+
+    result.total = std::chrono::duration<f64>(Clock::now() - start).count();
+    result.stats = null_api::GetNullApiStats();
+
+    rc = smile_UnloadResources(&ctx);
+    if (eRcode_Ok != rc) {
+        std::cerr << "WARNING: failed to unload resources: " << smile_ToString(rc) << std::endl;
+    }
+
+    rc = smile_TearDown(&ctx);
+    if (eRcode_Ok != rc) {
+        std::cerr << "Error while tearing down smile engine: " << smile_ToString(rc) << std::endl;
+    }
+
+    if (capturing) {
+        rc = smile::StopApiCapture(ctx.platform_api);
+        if (eRcode_Ok != rc) {
+            std::cerr << "WARNING: failed to write api trace " << capturePath << ": "
+                      << smile_ToString(rc) << std::endl;
+        }
+    }
+
+    const null_api::NullApiStats left = null_api::GetNullApiStats();
+    if (left.buffers || left.textures) {
+        std::cerr << "WARNING: " << left.buffers << " buffers and " << left.textures
+                  << " textures are not released" << std::endl;
+    }
+
+    return succeeded;
+}
+
+
+// Runs the engine on 1 to maxThreads job threads and prints the time of a
+// frame and of the update on each, with the speedup over a single thread.
+static
+int SweepThreads(u64 nbFrames, u32 nbSmileys, u32 maxThreads) {
+    std::cout << nbFrames << " frames of " << nbSmileys << " smileys, ns per frame (speedup)" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(24) << "frame" << std::setw(24) << "update" << std::endl;
+
+    f64 serialFrame = 0.0, serialUpdate = 0.0;
+    for (u32 nbThreads = 1; nbThreads <= maxThreads; ++nbThreads) {
+        BenchResult result;
+        if (!RunEngine(nbFrames, nbSmileys, nbThreads, nullptr, result)) {
+            return 1;
+        }
+
+        const f64 n = static_cast<f64>(result.nbFrames);
+        const f64 frame = result.total/n*1e9;
+        const f64 update = result.cpuUpdate/n*1e9;
+        if (1 == nbThreads) {
+            serialFrame = frame;
+            serialUpdate = update;
+        }
+
+        std::cout << std::setw(8) << nbThreads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << frame << " (" << std::setw(5) << std::setprecision(2) << serialFrame/frame << "x)"
+                  << std::setprecision(1)
+                  << std::setw(14) << update << " (" << std::setw(5) << std::setprecision(2) << serialUpdate/update << "x)"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    const char* program = argv[0];
+
+    // with --sweep the number of threads is the largest one of the sweep
+    const bool sweep = argc > 1 && 0 == strcmp(argv[1], "--sweep");
+    if (sweep) {
+        --argc;
+        ++argv;
+    }
+
+    u64 nbFrames = 1000000;
+    u32 nbSmileys = 100;
+    u32 nbThreads = sweep ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+    if (argc > 1) {
+        long long f = strtoll(argv[1], nullptr, 10);
+        long n = argc > 2 ? strtol(argv[2], nullptr, 10) : nbSmileys;
+        long t = argc > 3 ? strtol(argv[3], nullptr, 10) : nbThreads;
+        if (f <= 0 || n <= 0 || n > 10000000 || t < (sweep ? 1 : 0) || t > 1024) {
+            std::cerr << "Usage: " << program
+                      << " [--sweep] [<number of frames> [<number of smileys> [<number of threads>]]]"
+                      << std::endl;
+            return 1;
+        }
+        nbFrames = static_cast<u64>(f);
+        nbSmileys = static_cast<u32>(n);
+        nbThreads = static_cast<u32>(t);
+    }
+
+    if (sweep) {
+        return SweepThreads(nbFrames, nbSmileys, nbThreads);
+    }
+
+    BenchResult result;
+    const bool succeeded = RunEngine(nbFrames, nbSmileys, nbThreads, std::getenv("SMILE_CAPTURE"), result);
+    if (0 == result.nbFrames) {
+        return 1;
+    }
+
+    const f64 n = static_cast<f64>(result.nbFrames);
+    const null_api::NullApiStats& stats = result.stats;
+    std::cout << result.nbFrames << " frames of " << nbSmileys << " smileys on " << nbThreads
+              << " threads in " << result.total << " s" << std::endl;
+    std::cout << "Per frame: " << result.total/n*1e9 << " ns (update " << result.cpuUpdate/n*1e9
+              << " ns, render " << result.cpuRender/n*1e9 << " ns)" << std::endl;
+    std::cout << "Platform calls per frame: " << static_cast<f64>(stats.calls)/n
+              << ", commits " << static_cast<f64>(stats.nb_commits)/n
+              << " of " << static_cast<f64>(stats.bytes_committed)/n << " bytes"
+              << ", draws " << static_cast<f64>(stats.nb_draws)/n
+              << " of " << static_cast<f64>(stats.nb_instances)/n << " instances" << std::endl;
+
+    // the zones of the last frames, for chrome://tracing or Perfetto
+    const char* tracePath = std::getenv("SMILE_TRACE");
+    if (tracePath && *tracePath) {
+        smile::profiler::WriteChromeTrace(tracePath);
+    }
+
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "imageutils.hpp"
+#include "jobsystem.hpp"
+
+#include "smile/smile.h"
+
+
+using namespace imageutils;
+
+
+static constexpr u32 kSizes[] = { 256, 1024, 4096 };
+
+// the conversion of the texture loader for RGB images
+static constexpr ColorFormat kSource = ColorFormat::R8G8B8;
+static constexpr ColorFormat kTarget = ColorFormat::R8G8B8A8;
+
+// every image is converted again and again for at least this long
+static constexpr double kMinRunTime = 0.2; // sec
+
+
+static
+u64 HashImage(const ImageData& image) noexcept {
+    u64 hash = 1469598103934665603ull;
+    for (u32 i = 0; i < image.szdata; ++i) {
+        hash = (hash ^ image.data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+
+// Converts a copy of the source on the jobs, returns seconds per image and
+// the hash of the result.
+static
+bool Measure(const Png& source, smile::JobSystem& jobs, double& time, u64& hash) {
+    using Clock = std::chrono::steady_clock;
+
+    const ImageData& src = source.image();
+
+    u32 nbRuns = 0;
+    double elapsed = 0.0;
+    do {
+        Png png;
+        if (eRcode_Ok != png.create(src.width, src.height, source.format())) {
+            return false;
+        }
+        std::memcpy(png.image().data, src.data, src.szdata);
+
+        const Clock::time_point start = Clock::now();
+        if (eRcode_Ok != png.convert(kTarget, jobs)) {
+            return false;
+        }
+        elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+        ++nbRuns;
+
+        if (1 == nbRuns) {
+            hash = HashImage(png.image());
+        }
+    } while (elapsed < kMinRunTime);
+
+    time = elapsed / nbRuns;
+
+    return true;
+}
+
+
+// Scaling of Png::convert in row bands with the number of job threads.
+int main(int argc, char** argv) {
+    u32 maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        long t = strtol(argv[1], nullptr, 10);
+        if (t <= 0 || t > 1024) {
+            std::cerr << "Usage: " << argv[0] << " [<max number of threads>]" << std::endl;
+            return 1;
+        }
+        maxThreads = static_cast<u32>(t);
+    }
+
+    std::cout << "R8G8B8 -> R8G8B8A8 conversion, ms per image (speedup)" << std::endl;
+    std::cout << std::setw(8) << "threads";
+    for (u32 size : kSizes) {
+        std::cout << std::setw(20) << (std::to_string(size) + "x" + std::to_string(size));
+    }
+    std::cout << std::endl;
+
+    std::vector<Png> sources(sizeof(kSizes)/sizeof(kSizes[0]));
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (eRcode_Ok != sources[i].create(kSizes[i], kSizes[i], kSource)) {
+            std::cerr << "Failed to create a " << kSizes[i] << " pixels image" << std::endl;
+            return 1;
+        }
+
+        u32 state = 0x12345678u;
+        ImageData& image = sources[i].image();
+        for (u32 k = 0; k < image.szdata; ++k) {
+            state = state * 1664525u + 1013904223u;
+            image.data[k] = static_cast<byte>(state >> 24);
+        }
+    }
+
+    std::vector<double> serial(sources.size(), 0.0);
+    std::vector<u64> expected(sources.size(), 0);
+
+    int result = 0;
+
+    for (u32 nbThreads = 1; nbThreads <= maxThreads; ++nbThreads) {
+        smile::JobSystem jobs;
+        if (eRcode_Ok != jobs.setUp(nbThreads)) {
+            std::cerr << "Failed to set up " << nbThreads << " job threads" << std::endl;
+            return 1;
+        }
+
+        std::cout << std::setw(8) << jobs.nbThreads();
+        for (size_t i = 0; i < sources.size(); ++i) {
+            double time = 0.0;
+            u64 hash = 0;
+            if (!Measure(sources[i], jobs, time, hash)) {
+                std::cerr << "Failed to convert" << std::endl;
+                return 1;
+            }
+
+            if (1 == nbThreads) {
+                serial[i] = time;
+                expected[i] = hash;
+            } else if (expected[i] != hash) {
+                std::cerr << "The result on " << nbThreads << " threads differs!" << std::endl;
+                result = 1;
+            }
+
+            std::cout << std::fixed << std::setprecision(3) << std::setw(12) << time*1000.0
+                      << std::setprecision(2) << " (" << std::setw(4) << serial[i] / time << "x)";
+        }
+        std::cout << std::endl;
+    }
+
+    return result;
+}
@@ -0,0 +1,112 @@
+#include <stdlib.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "imageutils.hpp"
+#include "pixelconv.hpp"
+#include "pixelconv-reference.hpp"
+
+#include "smile/smile.h"
+
+
+using namespace imageutils;
+
+
+static constexpr ColorFormat kFormats[] = {
+    ColorFormat::R8G8B8A8, ColorFormat::R8G8B8, ColorFormat::R8G8B8X8,
+    ColorFormat::R4G4B4A4, ColorFormat::R5G6B5, ColorFormat::A8
+};
+
+static constexpr const char* kFormatNames[] = {
+    "Undefined", "R8G8B8A8", "R8G8B8", "R8G8B8X8", "R4G4B4A4", "R5G6B5", "A8"
+};
+
+// every conversion is repeated for at least this long
+static constexpr double kMinRunTime = 0.1; // sec
+
+
+// Converts the image over and over, returns megapixels per second.
+template <typename ConvertRow>
+static
+double Measure(u32 size, ConvertRow&& convertRow) {
+    using Clock = std::chrono::steady_clock;
+
+    u64 nbRuns = 0;
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        for (u32 y = 0; y < size; ++y) {
+            convertRow(y);
+        }
+        ++nbRuns;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < kMinRunTime);
+
+    return static_cast<double>(size) * size * nbRuns / elapsed / 1e6;
+}
+
+
+// Throughput of the row converters of every format pair against the
+// ColorObject conversion they replaced.
+int main(int argc, char** argv) {
+    u32 size = 1024;
+    if (argc > 1) {
+        long s = strtol(argv[1], nullptr, 10);
+        if (s <= 0 || s > 16384) {
+            std::cerr << "Usage: " << argv[0] << " [<image side in pixels>]" << std::endl;
+            return 1;
+        }
+        size = static_cast<u32>(s);
+    }
+
+    const SimdLevel detected = RowConverter::DetectSimdLevel();
+    std::cout << size << "x" << size << " images, megapixels per second ("
+              << RowConverter::ToString(detected) << " detected)" << std::endl;
+
+    std::vector<byte> src(static_cast<size_t>(size) * size * 4);
+    u32 state = 0x12345678u;
+    for (byte& b : src) {
+        state = state * 1664525u + 1013904223u;
+        b = static_cast<byte>(state >> 24);
+    }
+    std::vector<byte> dst(src.size());
+
+    std::cout << std::setw(20) << "conversion" << std::setw(12) << "ColorObject"
+              << std::setw(12) << "Scalar" << std::setw(12) << RowConverter::ToString(detected)
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (ColorFormat source : kFormats) {
+        for (ColorFormat target : kFormats) {
+            RowConverter scalar, simd;
+            if (eRcode_Ok != scalar.setUp(source, target, SimdLevel::Scalar)
+             || eRcode_Ok != simd.setUp(source, target, detected))
+            {
+                continue;
+            }
+
+            const u32 srcRow = size * scalar.source().size;
+            const u32 dstRow = size * scalar.target().size;
+
+            const double ref = Measure(size, [&](u32 y) {
+                reference::ConvertRow(source, target, &dst[y*dstRow], &src[y*srcRow], size);
+            });
+            const double scalarRate = Measure(size, [&](u32 y) {
+                scalar(&dst[y*dstRow], &src[y*srcRow], size);
+            });
+            const double simdRate = Measure(size, [&](u32 y) {
+                simd(&dst[y*dstRow], &src[y*srcRow], size);
+            });
+
+            std::cout << std::setw(9) << kFormatNames[static_cast<int>(source)] << " -> "
+                      << std::setw(8) << std::left << kFormatNames[static_cast<int>(target)] << std::right
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(12) << ref << std::setw(12) << scalarRate << std::setw(12) << simdRate
+                      << std::setw(9) << simdRate / ref << "x" << std::endl;
+        }
+    }
+
+    return 0;
+}
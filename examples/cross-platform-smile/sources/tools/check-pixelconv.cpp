@@ -0,0 +1,132 @@
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "imageutils.hpp"
+#include "pixelconv.hpp"
+#include "pixelconv-reference.hpp"
+
+#include "smile/smile.h"
+
+
+using namespace imageutils;
+
+
+static constexpr ColorFormat kFormats[] = {
+    ColorFormat::R8G8B8A8, ColorFormat::R8G8B8, ColorFormat::R8G8B8X8,
+    ColorFormat::R4G4B4A4, ColorFormat::R5G6B5, ColorFormat::A8
+};
+
+static constexpr SimdLevel kLevels[] = {
+    SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2, SimdLevel::Neon
+};
+
+// the tails of every vector width and a long row
+static constexpr u32 kMaxShortWidth = 70;
+static constexpr u32 kLongWidth = 1037;
+
+// bytes after the row which the kernels must not touch
+static constexpr u32 kGuardSize = 64;
+static constexpr byte kGuard = 0xA5;
+
+
+static
+u32 NextRandom(u32& state) noexcept {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+static
+bool CheckRow( const RowConverter& converter, ColorFormat source, ColorFormat target
+             , const std::vector<byte>& src, u32 width)
+{
+    const u32 dstSize = width * converter.target().size;
+
+    std::vector<byte> expected(dstSize, 0);
+    reference::ConvertRow(source, target, expected.data(), src.data(), width);
+
+    std::vector<byte> actual(dstSize + kGuardSize, kGuard);
+    converter(actual.data(), src.data(), width);
+
+    if (0 != std::memcmp(actual.data(), expected.data(), dstSize)) {
+        u32 i = 0;
+        while (actual[i] == expected[i]) ++i;
+        std::cerr << "Mismatch at byte " << i << " of a row of " << width << " pixels: "
+                  << (int)actual[i] << " instead of " << (int)expected[i] << std::endl;
+        return false;
+    }
+
+    for (u32 i = dstSize; i < actual.size(); ++i) {
+        if (kGuard != actual[i]) {
+            std::cerr << "Written past the end of a row of " << width << " pixels" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Checks the row converters of every format pair and every SIMD level the
+// CPU runs against the ColorObject conversion, returns non-zero on mismatch.
+int main() {
+    const SimdLevel detected = RowConverter::DetectSimdLevel();
+    std::cout << "Detected SIMD level: " << RowConverter::ToString(detected) << std::endl;
+
+    u32 state = 0x12345678u;
+    std::vector<byte> src(kLongWidth * 4);
+    for (byte& b : src) {
+        b = static_cast<byte>(NextRandom(state));
+    }
+
+    u32 nbChecked = 0, nbFailed = 0;
+
+    for (SimdLevel level : kLevels) {
+        if (level > detected) {
+            continue;
+        }
+
+        for (ColorFormat source : kFormats) {
+            for (ColorFormat target : kFormats) {
+                RowConverter converter;
+                if (eRcode_Ok != converter.setUp(source, target, level)) {
+                    continue; // the level is of the other architecture
+                }
+
+                bool ok = true;
+                for (u32 width = 1; ok && width <= kMaxShortWidth; ++width) {
+                    ok = CheckRow(converter, source, target, src, width);
+                }
+                ok = ok && CheckRow(converter, source, target, src, kLongWidth);
+
+                ++nbChecked;
+                if (!ok) {
+                    ++nbFailed;
+                    std::cerr << RowConverter::ToString(level) << " conversion " << (int)source
+                              << " -> " << (int)target << " FAILED" << std::endl;
+                }
+            }
+        }
+    }
+
+    // the compile time set up of the conversions to the texture format
+    RowConverter rgb, alpha;
+    rgb.setUp<ColorFormat::R8G8B8, ColorFormat::R8G8B8A8>();
+    alpha.setUp<ColorFormat::A8, ColorFormat::R8G8B8A8>();
+    for (const RowConverter* converter : { &rgb, &alpha }) {
+        const ColorFormat source = converter == &rgb ? ColorFormat::R8G8B8 : ColorFormat::A8;
+
+        ++nbChecked;
+        if (!CheckRow(*converter, source, ColorFormat::R8G8B8A8, src, kLongWidth)) {
+            ++nbFailed;
+            std::cerr << "Compile time conversion " << (int)source << " FAILED" << std::endl;
+        }
+    }
+
+    std::cout << nbChecked << " converters checked, " << nbFailed << " failed" << std::endl;
+
+    return (nbFailed > 0 || 0 == nbChecked) ? 1 : 0;
+}
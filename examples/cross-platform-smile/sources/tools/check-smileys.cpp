@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "smileys.hpp"
+
+#include "smile/smile.h"
+
+
+// The smiley is compared with the solver it replaced for a second after the
+// kick, at these frame rates.
+static constexpr f64 kFrameRates[] = { 30.0, 60.0, 144.0 };
+static constexpr f64 kComparedTime = 1.0; // sec
+
+// of the top and the bottom, the screen is 2 units tall
+static constexpr f64 kTolerance = 0.05;
+
+// frames run to measure the cost of a frame
+static constexpr u32 kBenchFrames = 1000;
+
+
+namespace reference {
+
+// The recursive spring integrator smile_Update ran before the fixed step
+// solver, a thousand substeps of every frame.
+
+constexpr f32 kG = 9.81f;
+constexpr f32 kK = 5000.0f;
+constexpr f32 kFloorY = -0.75f;
+constexpr f32 kFriction = 3.0f;
+
+struct Smiley {
+    f32 topy{kFloorY};
+    f32 boty{kFloorY};
+    f64 Vt{0.0};
+    f64 Vb{0.0};
+    f64 dx{0.0};
+};
+
+
+static bool is_equal(f64 a, f64 b, f64 tol = 1e-5) noexcept {
+    return std::abs(a)-std::abs(b) <= tol;
+}
+
+
+static void compute_in_fly(Smiley& data, f64 dT) {
+    f64 dXdt = data.Vt - data.Vb;
+
+    const f64 Vt_0 = data.Vt;
+    const f64 Vb_0 = data.Vb;
+
+    const f64 At = -(kG + kK * data.dx + kFriction*dXdt);
+    const f64 Ab = -(kG - kK * data.dx - kFriction*dXdt);
+
+    const f64 Vt = Vt_0 + At * dT;
+    const f64 Vb = Vb_0 + Ab * dT;
+
+    f64 Tt1 = dT;
+    if (!is_equal(Vt, 0.0) && Vt_0*Vt < 0.0 && !is_equal(At, 0.0)) {
+        Tt1 = -Vt_0 / At;
+    }
+    f64 Tb1 = dT;
+    if (!is_equal(Vb, 0.0) && Vb_0*Vb < 0.0 && !is_equal(Ab, 0.0)) {
+        Tb1 = -Vb_0 / Ab;
+    }
+
+    f64 T[3] = { Tb1, Tt1 - Tb1, dT - Tt1 };
+    if (Tt1 < Tb1) {
+        T[0] = Tt1;
+        T[1] = Tb1 - Tt1;
+        T[2] = dT - Tb1;
+    }
+    if (T[0] < dT) {
+        compute_in_fly(data, T[0]);
+        if (!is_equal(T[1], 0.0)) {
+            compute_in_fly(data, T[1]);
+        }
+        if (!is_equal(T[2], 0.0)) {
+            compute_in_fly(data, T[2]);
+        }
+        return;
+    }
+
+    const f64 Ht = Vt_0 * dT + At * dT * dT / 2.0 + data.topy;
+    const f64 Hb = Vb_0 * dT + Ab * dT * dT / 2.0 + data.boty;
+
+    const f64 x = Ht - Hb;
+
+    if (Hb < kFloorY) {
+        f64 dH = kFloorY - data.boty;
+        f64 t1 = 0.0;
+
+        if (!is_equal(data.Vb, 0.0)) {
+            f64 t1 = (data.Vb/Ab)*(std::sqrt(1.0 + 2.0*dH*Ab/(data.Vb*data.Vb)) - 1.0);
+            if (t1 < 0.0) {
+                t1 = 0.0;
+            }
+        } else if (!is_equal(Ab, 0.0)){
+            data.Vb = 0.0;
+            f64 t1 = std::sqrt(2*dH/Ab);
+            compute_in_fly(data, t1);
+        }
+
+        if (t1 > 0.0) {
+            compute_in_fly(data, t1);
+        }
+        data.Vb = -data.Vb;
+        if (t1 > 0.0) {
+            compute_in_fly(data, dT-t1);
+        } else {
+            data.dx = x;
+
+            data.Vt = Vt;
+            data.topy = static_cast<f32>(Ht);
+        }
+
+        return;
+    }
+
+    data.dx = x;
+
+    data.Vt = Vt;
+    data.topy = static_cast<f32>(Ht);
+
+    data.Vb = Vb;
+    data.boty = static_cast<f32>(Hb);
+}
+
+
+static void update(Smiley& data, f32 dT) {
+    f64 dt = dT * 0.001;
+    for (f64 t0 = 0; t0 < dT; t0 += dt) {
+        compute_in_fly(data, dt);
+    }
+}
+
+}
+
+
+// A single smiley, stepped and kicked the way the update jobs of
+// smile_Update do, with the engine's accumulator.
+class Simulation {
+public:
+    bool setUp() noexcept {
+        if (eRcode_Ok != _smileys.setUp(1)) {
+            return false;
+        }
+
+        // it stands still on the floor, so it's kicked right away
+        _smileys.kick(0, 1);
+        return true;
+    }
+
+    void update(f64 dT) noexcept {
+        const u32 nbSteps = smile::TakeSimSteps(_accumulated, dT);
+        _smileys.step(nbSteps, 0, 1);
+        _smileys.kick(0, 1);
+    }
+
+    GeomInstance instance() const noexcept {
+        GeomInstance instance;
+        _smileys.fill(&instance, 0, 1);
+        return instance;
+    }
+
+private:
+    smile::Smileys _smileys;
+    f64 _accumulated{0.0};
+};
+
+
+// Compares the trajectory of the smiley after the kick with the one of the
+// old solver, returns the largest difference.
+static
+bool Compare(f64 frameRate, f64& maxDiff) {
+    const f32 dT = static_cast<f32>(1.0/frameRate);
+
+    Simulation simulation;
+    if (!simulation.setUp()) {
+        return false;
+    }
+
+    reference::Smiley smiley;
+    smiley.Vt = -12.0; // the kick of the old smile_Update
+
+    maxDiff = 0.0;
+    for (f64 t = 0.0; t < kComparedTime; t += dT) {
+        simulation.update(dT);
+        reference::update(smiley, dT);
+
+        const GeomInstance instance = simulation.instance();
+        maxDiff = std::max({ maxDiff
+                           , std::abs(static_cast<f64>(instance.topy) - smiley.topy)
+                           , std::abs(static_cast<f64>(instance.boty) - smiley.boty) });
+    }
+
+    return true;
+}
+
+
+// Measures the microseconds of a frame of both solvers over the compared
+// second, the old one recurses without end on some later bounces.
+static
+void Measure(f64 frameRate, f64& oldCost, f64& newCost) {
+    using Clock = std::chrono::steady_clock;
+
+    const f32 dT = static_cast<f32>(1.0/frameRate);
+    const u32 nbFrames = static_cast<u32>(kComparedTime * frameRate);
+    const u32 nbRuns = std::max(1u, kBenchFrames / nbFrames);
+
+    f32 sink = 0.0f; // keeps the solvers from being optimized out
+
+    f64 elapsed = 0.0;
+    for (u32 r = 0; r < nbRuns; ++r) {
+        reference::Smiley smiley;
+        smiley.Vt = -12.0;
+
+        const Clock::time_point start = Clock::now();
+        for (u32 i = 0; i < nbFrames; ++i) {
+            reference::update(smiley, dT);
+        }
+        elapsed += std::chrono::duration<f64>(Clock::now() - start).count();
+        sink += smiley.topy;
+    }
+    oldCost = elapsed / (nbRuns * nbFrames) * 1e6;
+
+    elapsed = 0.0;
+    for (u32 r = 0; r < nbRuns; ++r) {
+        Simulation simulation;
+        if (!simulation.setUp()) {
+            break;
+        }
+
+        const Clock::time_point start = Clock::now();
+        for (u32 i = 0; i < nbFrames; ++i) {
+            simulation.update(dT);
+        }
+        elapsed += std::chrono::duration<f64>(Clock::now() - start).count();
+        sink += simulation.instance().topy;
+    }
+    newCost = elapsed / (nbRuns * nbFrames) * 1e6;
+
+    if (sink > 1e9f) {
+        std::cout << sink << std::endl;
+    }
+}
+
+
+// Checks the smiley trajectory against the old solver and prints the cost
+// of a frame of both, returns non-zero if the trajectories diverge.
+int main() {
+    int result = 0;
+
+    for (f64 frameRate : kFrameRates) {
+        f64 maxDiff = 0.0;
+        if (!Compare(frameRate, maxDiff)) {
+            std::cerr << "Failed to set up the smileys" << std::endl;
+            return 1;
+        }
+
+        f64 oldCost = 0.0, newCost = 0.0;
+        Measure(frameRate, oldCost, newCost);
+
+        const bool ok = maxDiff <= kTolerance;
+        std::cout << frameRate << " fps: max difference " << maxDiff << (ok ? "" : " FAILED")
+                  << ", frame cost " << oldCost << " us (old) vs " << newCost << " us" << std::endl;
+
+        if (!ok) {
+            result = 1;
+        }
+    }
+
+    return result;
+}
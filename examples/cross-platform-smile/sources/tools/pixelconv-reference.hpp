@@ -0,0 +1,145 @@
+#ifndef TOOLS_PIXELCONV_REFERENCE_HPP_
+
+#include <algorithm>
+#include <cstring>
+
+#include "imageutils.hpp"
+
+#include "smile/smile.h"
+
+
+// The per pixel ColorObject conversion of Png::convert before the row
+// converters, kept as the reference they must match bit for bit. Pixels are
+// loaded and saved through a 4 byte value, as the original did, but only
+// 'size' bytes of it are touched in the rows.
+
+namespace reference {
+
+
+class ColorObject {
+public:
+    static ColorObject FromFormat(imageutils::ColorFormat format) noexcept {
+        using imageutils::ColorFormat;
+        switch (format) {
+            case ColorFormat::R8G8B8X8 : return ColorObject(8, 8, 8, 8);
+            case ColorFormat::R8G8B8A8 : return ColorObject(8, 8, 8, 8);
+            case ColorFormat::R8G8B8   : return ColorObject(8, 8, 8, 0);
+            case ColorFormat::R4G4B4A4 : return ColorObject(4, 4, 4, 4);
+            case ColorFormat::R5G6B5   : return ColorObject(5, 6, 5, 0);
+            case ColorFormat::A8       : return ColorObject(0, 0, 0, 8);
+            case ColorFormat::Undefined: return ColorObject(0, 0, 0, 0);
+        }
+        return ColorObject(0, 0, 0, 0);
+    }
+
+    ColorObject(u32 nbBitsR, u32 nbBitsG, u32 nbBitsB, u32 nbBitsA) noexcept
+        : _nbBitsR(nbBitsR), _nbBitsG(nbBitsG), _nbBitsB(nbBitsB), _nbBitsA(nbBitsA)
+        , _nbBits(nbBitsA + nbBitsB + nbBitsG + nbBitsR)
+        , _nbBytes((_nbBits + 7) / 8)
+        , _r(0), _g(0), _b(0), _a(0)
+    {}
+
+    bool isValid() const noexcept { return _nbBits > 0 && _nbBits <= 32; }
+
+    u32 size() const noexcept { return _nbBytes; }
+
+    byte R() const noexcept { return _r; }
+    byte G() const noexcept { return _g; }
+    byte B() const noexcept { return _b; }
+    byte A() const noexcept { return _a; }
+
+    void set(byte r, byte g, byte b, byte a) noexcept {
+        const u32 maxR = (1 << _nbBitsR) - 1;
+        const u32 maxG = (1 << _nbBitsG) - 1;
+        const u32 maxB = (1 << _nbBitsB) - 1;
+        const u32 maxA = (1 << _nbBitsA) - 1;
+
+        _r = static_cast<byte>(std::min((u32)r, maxR));
+        _g = static_cast<byte>(std::min((u32)g, maxG));
+        _b = static_cast<byte>(std::min((u32)b, maxB));
+        _a = static_cast<byte>(std::min((u32)a, maxA));
+    }
+
+    void save(byte* pBuffer) const noexcept {
+        u32 colorval;
+        if (_nbBits <= 8) {
+            colorval = static_cast<byte>((_r << (_nbBits-_nbBitsR))
+                                       | (_g << (_nbBitsB + _nbBitsA))
+                                       | (_b << _nbBitsA)
+                                       | (_a));
+        } else if (_nbBits <= 16) {
+            colorval = static_cast<u16>((static_cast<u16>(_r) << (_nbBits-_nbBitsR))
+                                      | (static_cast<u16>(_g) << (_nbBitsB + _nbBitsA))
+                                      | (static_cast<u16>(_b) << _nbBitsA)
+                                      | static_cast<u16>(_a));
+        } else {
+            colorval = (static_cast<u32>(_r) << (_nbBits-_nbBitsR))
+                     | (static_cast<u32>(_g) << (_nbBitsB + _nbBitsA))
+                     | (static_cast<u32>(_b) << _nbBitsA)
+                     | static_cast<u32>(_a);
+        }
+        std::memcpy(pBuffer, &colorval, _nbBytes);
+    }
+
+    void load(const byte* pBuffer) noexcept {
+        const u32 maxG = (1 << _nbBitsG) - 1;
+        const u32 maxB = (1 << _nbBitsB) - 1;
+        const u32 maxA = (1 << _nbBitsA) - 1;
+
+        u32 colorval = 0;
+        std::memcpy(&colorval, pBuffer, _nbBytes);
+
+        byte rv = _nbBitsR > 0 ? static_cast<byte>(colorval >> (_nbBits-_nbBitsR)) : 0;
+        byte gv = _nbBitsG > 0 ? static_cast<byte>((colorval >> (_nbBitsB + _nbBitsA)) & maxG) : 0;
+        byte bv = _nbBitsB > 0 ? static_cast<byte>((colorval >> _nbBitsA) & maxB) : 0;
+        byte av = _nbBitsA > 0 ? static_cast<byte>(colorval & maxA) : 255;
+        set(rv, gv, bv, av);
+    }
+
+private:
+    u32 _nbBitsR;
+    u32 _nbBitsG;
+    u32 _nbBitsB;
+    u32 _nbBitsA;
+
+    u32 _nbBits;
+    u32 _nbBytes;
+
+    byte _r, _g, _b, _a;
+};
+
+
+// false for the undefined format
+inline bool ConvertRow( imageutils::ColorFormat source, imageutils::ColorFormat target
+                      , byte* dst, const byte* src, u32 width) noexcept
+{
+    using imageutils::ColorFormat;
+
+    ColorObject srcColor = ColorObject::FromFormat(source);
+    ColorObject dstColor = ColorObject::FromFormat(target);
+    if (!srcColor.isValid() || !dstColor.isValid()) {
+        return false;
+    }
+
+    for (u32 x = 0; x < width; ++x, src += srcColor.size(), dst += dstColor.size()) {
+        srcColor.load(src);
+        if (ColorFormat::A8 == source && ColorFormat::R8G8B8A8 == target) {
+            dstColor.set(srcColor.A(), srcColor.A(), srcColor.A(), 255);
+        } else if (ColorFormat::R8G8B8 == source && ColorFormat::A8 == target) {
+            float clr = 0.299 * srcColor.R() + 0.587 * srcColor.G() + 0.114 * srcColor.B();
+            dstColor.set(clr, clr, clr, clr);
+        } else {
+            dstColor.set(srcColor.R(), srcColor.G(), srcColor.B(), srcColor.A());
+        }
+        dstColor.save(dst);
+    }
+
+    return true;
+}
+
+
+}
+
+
+#define TOOLS_PIXELCONV_REFERENCE_HPP_
+#endif